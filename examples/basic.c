@@ -73,7 +73,7 @@ int main(void)
 			"preferred-interval", LOCATION_INTERVAL_DEFAULT,
 			NULL);
 
-	/* TODO: Polling interval */
+	/* At most one "changed" per second */
 	device->interval = LOCATION_INTERVAL_1S;
 
 	g_signal_connect(control, "error-verbose", G_CALLBACK(on_error), loop);
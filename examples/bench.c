@@ -0,0 +1,472 @@
+/*
+ * Copyright (c) 2020 Ivan J. <parazyd@dyne.org>
+ *
+ * This file is part of liblocation
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Measures the LocationGPSDevice data plane: how long it takes from
+ * location-daemon sending an epoch to the "changed" handler running, what
+ * that costs in CPU time and allocations on the device thread, and the
+ * highest epoch rate that is kept up with.
+ *
+ * An emitter thread owns org.maemo.LocationDaemon and sends each epoch
+ * with its CLOCK_MONOTONIC send time in TimeChanged, so the handler can
+ * compute the latency from the fix alone. Needs a bus of its own:
+ *
+ *   ./run-private-bus.sh --no-mock -- ./bench
+ *
+ * Results are printed as JSON on stdout. Exits with 1 if a run received
+ * no epoch at all.
+ *
+ * "changed_per_epoch" counts every "changed" emission, so running the
+ * same build of this file against two versions of the library compares
+ * both the latency and the number of emissions per epoch. --interval sets
+ * device->interval, for the figures a throttled consumer sees.
+ */
+
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <dbus/dbus.h>
+#include <glib.h>
+
+#include <location/location-gps-device.h>
+
+#define LOCATION_DAEMON_SERVICE "org.maemo.LocationDaemon"
+#define LOCATION_DAEMON_PATH    "/org/maemo/LocationDaemon"
+
+/* each epoch is Time, Position, Course, Accuracy and Satellites */
+#define SIGNALS_PER_EPOCH 5
+
+/* how long to wait for the last epoch to come through */
+#define DRAIN_MS 250
+
+typedef struct {
+	double rate;
+	guint epochs;
+	guint sent;
+	guint received;
+	guint changed;
+	GArray *latencies;	/* of gint64, microseconds */
+	gint64 cpu_ns;
+	gint64 allocs;
+} Run;
+
+/* options */
+static gint duration = 10;
+static gint satellites = 12;
+static gint interval = 0;
+static gboolean immediate = FALSE;
+static gboolean no_ramp = FALSE;
+
+static GOptionEntry entries[] = {
+	{ "duration", 'd', 0, G_OPTION_ARG_INT, &duration,
+		"Seconds per fixed rate run (default 10)", "S" },
+	{ "satellites", 's', 0, G_OPTION_ARG_INT, &satellites,
+		"Satellites in view (default 12)", "N" },
+	{ "interval", 'I', 0, G_OPTION_ARG_INT, &interval,
+		"Device interval in milliseconds (default 0)", "MS" },
+	{ "immediate", 'i', 0, G_OPTION_ARG_NONE, &immediate,
+		"Use LOCATION_GPS_DEVICE_INTERVAL_IMMEDIATE", NULL },
+	{ "no-ramp", 0, 0, G_OPTION_ARG_NONE, &no_ramp,
+		"Skip the maximum sustained rate search", NULL },
+	{ NULL }
+};
+
+static GMainLoop *loop;
+static Run *current;
+static double last_time;
+
+#ifdef __GLIBC__
+/*
+ * Count the allocations made on the device thread while a run is going,
+ * by wrapping the allocator for the whole process.
+ */
+extern void *__libc_malloc(size_t);
+extern void *__libc_calloc(size_t, size_t);
+extern void *__libc_realloc(void *, size_t);
+
+static __thread gboolean counting = FALSE;
+static gint64 allocs = 0;
+
+void *malloc(size_t size)
+{
+	if (counting)
+		allocs++;
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size)
+{
+	if (counting)
+		allocs++;
+	return __libc_calloc(n, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	if (counting)
+		allocs++;
+	return __libc_realloc(ptr, size);
+}
+
+#define ALLOCS_SUPPORTED TRUE
+#else
+static gboolean counting = FALSE;
+static gint64 allocs = 0;
+#define ALLOCS_SUPPORTED FALSE
+#endif
+
+/* function declarations */
+static gint64 thread_cpu_ns(void);
+static void emit(DBusConnection *, const char *, const char *, int, ...);
+static void emit_satellites(DBusConnection *, guint);
+static gpointer emitter(gpointer);
+static gboolean quit_loop(gpointer);
+static void on_changed(LocationGPSDevice *, gpointer);
+static void run(LocationGPSDevice *, Run *);
+static int compare_gint64(const void *, const void *);
+static gint64 percentile(GArray *, double);
+static gboolean kept_up(const Run *);
+static void print_run(const Run *, gboolean);
+
+gint64 thread_cpu_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void emit(DBusConnection *bus, const char *interface, const char *member,
+		int first_type, ...)
+{
+	DBusMessage *msg;
+	va_list args;
+
+	msg = dbus_message_new_signal(LOCATION_DAEMON_PATH, interface, member);
+
+	va_start(args, first_type);
+	dbus_message_append_args_valist(msg, first_type, args);
+	va_end(args);
+
+	dbus_connection_send(bus, msg, NULL);
+	dbus_message_unref(msg);
+}
+
+void emit_satellites(DBusConnection *bus, guint n)
+{
+	DBusMessageIter iter, arr, st;
+	DBusMessage *msg;
+	dbus_int16_t prn;
+	dbus_bool_t in_use = TRUE;
+	double elevation = 45.0, azimuth = 180.0, snr = 35.0;
+	guint i;
+
+	msg = dbus_message_new_signal(LOCATION_DAEMON_PATH,
+			LOCATION_DAEMON_SERVICE".Satellite", "SatellitesChanged");
+
+	dbus_message_iter_init_append(msg, &iter);
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY, "(ndddb)",
+			&arr);
+
+	for (i = 0; i < n; i++) {
+		prn = i + 1;
+		dbus_message_iter_open_container(&arr, DBUS_TYPE_STRUCT,
+				NULL, &st);
+		dbus_message_iter_append_basic(&st, DBUS_TYPE_INT16, &prn);
+		dbus_message_iter_append_basic(&st, DBUS_TYPE_DOUBLE, &elevation);
+		dbus_message_iter_append_basic(&st, DBUS_TYPE_DOUBLE, &azimuth);
+		dbus_message_iter_append_basic(&st, DBUS_TYPE_DOUBLE, &snr);
+		dbus_message_iter_append_basic(&st, DBUS_TYPE_BOOLEAN, &in_use);
+		dbus_message_iter_close_container(&arr, &st);
+	}
+
+	dbus_message_iter_close_container(&iter, &arr);
+	dbus_connection_send(bus, msg, NULL);
+	dbus_message_unref(msg);
+}
+
+/* sends the epochs of the current run at its rate, then stops the loop */
+gpointer emitter(gpointer data)
+{
+	DBusConnection *bus = data;
+	Run *r = current;
+	struct timespec next, sent;
+	dbus_int64_t sec, nsec;
+	double lat, lon, alt = 20.0, speed = 15.0, track = 90.0, climb = 0.0;
+	double ept = 0.01, epv = 8.0, epd = 2.0, eps = 1.0, epc = 0.5,
+		eph = 500.0;
+	gint64 period = 1e9 / r->rate;
+	guint i;
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+
+	for (i = 0; i < r->epochs; i++) {
+		next.tv_nsec += period;
+		while (next.tv_nsec >= 1000000000) {
+			next.tv_nsec -= 1000000000;
+			next.tv_sec++;
+		}
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+
+		clock_gettime(CLOCK_MONOTONIC, &sent);
+		sec = sent.tv_sec;
+		nsec = sent.tv_nsec;
+		lat = 65.0 + i * 1e-6;
+		lon = 25.0;
+
+		emit(bus, LOCATION_DAEMON_SERVICE".Time", "TimeChanged",
+				DBUS_TYPE_INT64, &sec,
+				DBUS_TYPE_INT64, &nsec,
+				DBUS_TYPE_INVALID);
+		emit(bus, LOCATION_DAEMON_SERVICE".Position", "PositionChanged",
+				DBUS_TYPE_DOUBLE, &lat,
+				DBUS_TYPE_DOUBLE, &lon,
+				DBUS_TYPE_DOUBLE, &alt,
+				DBUS_TYPE_INVALID);
+		emit(bus, LOCATION_DAEMON_SERVICE".Course", "CourseChanged",
+				DBUS_TYPE_DOUBLE, &speed,
+				DBUS_TYPE_DOUBLE, &track,
+				DBUS_TYPE_DOUBLE, &climb,
+				DBUS_TYPE_INVALID);
+		emit(bus, LOCATION_DAEMON_SERVICE".Accuracy", "AccuracyChanged",
+				DBUS_TYPE_DOUBLE, &ept,
+				DBUS_TYPE_DOUBLE, &epv,
+				DBUS_TYPE_DOUBLE, &epd,
+				DBUS_TYPE_DOUBLE, &eps,
+				DBUS_TYPE_DOUBLE, &epc,
+				DBUS_TYPE_DOUBLE, &eph,
+				DBUS_TYPE_INVALID);
+		emit_satellites(bus, satellites);
+		dbus_connection_flush(bus);
+
+		r->sent++;
+	}
+
+	g_usleep(DRAIN_MS * 1000);
+	g_idle_add(quit_loop, NULL);
+	return NULL;
+}
+
+gboolean quit_loop(gpointer data)
+{
+	g_main_loop_quit(loop);
+	return FALSE;
+}
+
+void on_changed(LocationGPSDevice *device, gpointer data)
+{
+	struct timespec now;
+	double t = device->fix->time;
+	gint64 latency;
+
+	if (!current)
+		return;
+
+	current->changed++;
+
+	/* with an immediate interval an epoch may be seen more than once */
+	if (t == last_time)
+		return;
+
+	last_time = t;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	latency = (now.tv_sec - t) * G_USEC_PER_SEC + now.tv_nsec / 1000;
+
+	g_array_append_val(current->latencies, latency);
+	current->received++;
+}
+
+void run(LocationGPSDevice *device, Run *r)
+{
+	DBusConnection *bus;
+	GThread *thread;
+	gint64 cpu;
+
+	r->latencies = g_array_sized_new(FALSE, FALSE, sizeof(gint64),
+			r->epochs);
+
+	bus = dbus_bus_get_private(DBUS_BUS_SYSTEM, NULL);
+	if (!bus || dbus_bus_request_name(bus, LOCATION_DAEMON_SERVICE,
+				DBUS_NAME_FLAG_DO_NOT_QUEUE, NULL)
+			!= DBUS_REQUEST_NAME_REPLY_PRIMARY_OWNER) {
+		g_printerr("Could not own %s, is another daemon running?\n",
+				LOCATION_DAEMON_SERVICE);
+		exit(1);
+	}
+
+	current = r;
+	last_time = 0;
+	allocs = 0;
+	cpu = thread_cpu_ns();
+	counting = ALLOCS_SUPPORTED;
+
+	thread = g_thread_new("emitter", emitter, bus);
+	g_main_loop_run(loop);
+	g_thread_join(thread);
+
+	counting = FALSE;
+	r->cpu_ns = thread_cpu_ns() - cpu;
+	r->allocs = allocs;
+	current = NULL;
+
+	dbus_connection_close(bus);
+	dbus_connection_unref(bus);
+}
+
+int compare_gint64(const void *a, const void *b)
+{
+	gint64 x = *(const gint64 *)a, y = *(const gint64 *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* nearest rank; the array must be sorted */
+gint64 percentile(GArray *values, double p)
+{
+	guint rank;
+
+	if (!values->len)
+		return -1;
+
+	rank = ceil(p * values->len);
+	return g_array_index(values, gint64, CLAMP(rank, 1, values->len) - 1);
+}
+
+/* every epoch arrived, and the tail stayed within one period */
+gboolean kept_up(const Run *r)
+{
+	return r->received >= r->sent
+		&& percentile(r->latencies, 0.99) < 1e6 / r->rate;
+}
+
+void print_run(const Run *r, gboolean last)
+{
+	guint signals = r->sent * SIGNALS_PER_EPOCH;
+
+	qsort(r->latencies->data, r->latencies->len, sizeof(gint64),
+			compare_gint64);
+
+	printf("    { \"rate_hz\": %g, \"epochs_sent\": %u, "
+			"\"epochs_received\": %u,\n", r->rate, r->sent,
+			r->received);
+	printf("      \"latency_us\": { \"p50\": %" G_GINT64_FORMAT
+			", \"p99\": %" G_GINT64_FORMAT
+			", \"p999\": %" G_GINT64_FORMAT
+			", \"max\": %" G_GINT64_FORMAT " },\n",
+			percentile(r->latencies, 0.5),
+			percentile(r->latencies, 0.99),
+			percentile(r->latencies, 0.999),
+			percentile(r->latencies, 1.0));
+	printf("      \"changed_per_epoch\": %.2f,\n",
+			r->sent ? (double)r->changed / r->sent : 0.0);
+	printf("      \"cpu_ns_per_signal\": %.0f,\n",
+			signals ? (double)r->cpu_ns / signals : 0.0);
+
+	if (ALLOCS_SUPPORTED && r->received)
+		printf("      \"allocs_per_epoch\": %.1f }%s\n",
+				(double)r->allocs / r->received, last ? "" : ",");
+	else
+		printf("      \"allocs_per_epoch\": null }%s\n",
+				last ? "" : ",");
+}
+
+int main(int argc, char **argv)
+{
+	static const double rates[] = { 1, 10, 25, 50 };
+	LocationGPSDevice *device;
+	GOptionContext *context;
+	GError *err = NULL;
+	Run runs[G_N_ELEMENTS(rates)], ramp;
+	double sustained = 0, rate;
+	guint i;
+	gboolean missed = FALSE;
+
+	context = g_option_context_new("- LocationGPSDevice benchmark");
+	g_option_context_add_main_entries(context, entries, NULL);
+	if (!g_option_context_parse(context, &argc, &argv, &err)) {
+		g_printerr("%s\n", err->message);
+		return 1;
+	}
+	g_option_context_free(context);
+
+	/* the emitter thread has a connection of its own */
+	dbus_threads_init_default();
+
+	loop = g_main_loop_new(NULL, FALSE);
+	device = g_object_new(LOCATION_TYPE_GPS_DEVICE, NULL);
+	device->interval = interval;
+#ifdef LOCATION_GPS_DEVICE_INTERVAL_IMMEDIATE
+	if (immediate)
+		device->interval = LOCATION_GPS_DEVICE_INTERVAL_IMMEDIATE;
+#endif
+	g_signal_connect(device, "changed", G_CALLBACK(on_changed), NULL);
+
+	printf("{\n  \"satellites\": %d,\n  \"interval\": %d,\n"
+			"  \"runs\": [\n", satellites, device->interval);
+
+	for (i = 0; i < G_N_ELEMENTS(rates); i++) {
+		memset(&runs[i], 0, sizeof(Run));
+		runs[i].rate = rates[i];
+		runs[i].epochs = MAX(rates[i] * duration, 1);
+		run(device, &runs[i]);
+		print_run(&runs[i], i == G_N_ELEMENTS(rates) - 1);
+		if (!runs[i].received)
+			missed = TRUE;
+		g_array_free(runs[i].latencies, TRUE);
+	}
+
+	printf("  ]");
+
+	/*
+	 * Double the rate for two seconds at a time until it falls behind.
+	 * Epochs closer than the epoch window would be merged otherwise, so
+	 * every update is delivered on its own here.
+	 */
+	if (!no_ramp) {
+#ifdef LOCATION_GPS_DEVICE_INTERVAL_IMMEDIATE
+		device->interval = LOCATION_GPS_DEVICE_INTERVAL_IMMEDIATE;
+#endif
+
+		for (rate = 50; rate <= 12800; rate *= 2) {
+			memset(&ramp, 0, sizeof(Run));
+			ramp.rate = rate;
+			ramp.epochs = rate * 2;
+			run(device, &ramp);
+			qsort(ramp.latencies->data, ramp.latencies->len,
+					sizeof(gint64), compare_gint64);
+			if (kept_up(&ramp))
+				sustained = rate;
+			g_array_free(ramp.latencies, TRUE);
+			if (sustained != rate)
+				break;
+		}
+
+		printf(",\n  \"max_sustained_hz\": %g", sustained);
+	}
+
+	printf("\n}\n");
+
+	g_object_unref(device);
+	g_main_loop_unref(loop);
+	return missed ? 1 : 0;
+}
@@ -0,0 +1,206 @@
+/*
+ * Copyright (c) 2020 Ivan J. <parazyd@dyne.org>
+ *
+ * This file is part of liblocation
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Compares the two ways the LocationGPSDevice bus filter has picked out
+ * location-daemon signals: a chain of dbus_message_is_signal() tests, one
+ * per interface and member, and the lookup table keyed on the interface
+ * that lookup_signal_handler() uses now. Both are copied here, as the
+ * library keeps them private.
+ *
+ * Each is timed over the six daemon signals and over messages meant for
+ * other filters, which the chain has to test against every pair. No bus
+ * is needed, the messages are only built, never sent. Exits with 1 if the
+ * two ever pick a different handler.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <dbus/dbus.h>
+#include <glib.h>
+
+#define LOCATION_DAEMON_PATH "/org/maemo/LocationDaemon"
+
+typedef struct {
+	const char *interface;
+	const char *member;
+} Handler;
+
+static const Handler handlers[] = {
+	{ "org.maemo.LocationDaemon.Time", "TimeChanged" },
+	{ "org.maemo.LocationDaemon.Position", "PositionChanged" },
+	{ "org.maemo.LocationDaemon.Course", "CourseChanged" },
+	{ "org.maemo.LocationDaemon.Accuracy", "AccuracyChanged" },
+	{ "org.maemo.LocationDaemon.Device", "FixStatusChanged" },
+	{ "org.maemo.LocationDaemon.Satellite", "SatellitesChanged" },
+};
+
+/* what else a system bus connection typically sees */
+static const Handler others[] = {
+	{ "org.freedesktop.DBus", "NameOwnerChanged" },
+	{ "org.freedesktop.DBus", "NameAcquired" },
+	{ "com.nokia.mce.signal", "display_status_ind" },
+	{ "org.freedesktop.Hal.Device", "PropertyModified" },
+};
+
+/* options */
+static gint iterations = 2000000;
+
+static GOptionEntry entries[] = {
+	{ "iterations", 'n', 0, G_OPTION_ARG_INT, &iterations,
+		"Lookups per message set (default 2000000)", "N" },
+	{ NULL }
+};
+
+static GHashTable *table;
+
+/* function declarations */
+static const Handler *lookup_chain(DBusMessage *);
+static const Handler *lookup_table(DBusMessage *);
+static DBusMessage **build(const Handler *, guint);
+static double time_lookups(const Handler *(*)(DBusMessage *),
+		DBusMessage **, guint, guint *);
+static gboolean agree(DBusMessage **, guint);
+
+const Handler *lookup_chain(DBusMessage *msg)
+{
+	guint i;
+
+	for (i = 0; i < G_N_ELEMENTS(handlers); i++)
+		if (dbus_message_is_signal(msg, handlers[i].interface,
+					handlers[i].member))
+			return &handlers[i];
+
+	return NULL;
+}
+
+const Handler *lookup_table(DBusMessage *msg)
+{
+	const Handler *handler;
+	const char *interface, *member;
+
+	if (dbus_message_get_type(msg) != DBUS_MESSAGE_TYPE_SIGNAL)
+		return NULL;
+
+	interface = dbus_message_get_interface(msg);
+	member = dbus_message_get_member(msg);
+	if (!interface || !member)
+		return NULL;
+
+	handler = g_hash_table_lookup(table, interface);
+	if (!handler || strcmp(member, handler->member))
+		return NULL;
+
+	return handler;
+}
+
+DBusMessage **build(const Handler *set, guint n)
+{
+	DBusMessage **msgs = g_new(DBusMessage *, n);
+	guint i;
+
+	for (i = 0; i < n; i++)
+		msgs[i] = dbus_message_new_signal(LOCATION_DAEMON_PATH,
+				set[i].interface, set[i].member);
+
+	return msgs;
+}
+
+/* nanoseconds per lookup; *matched keeps the calls from being elided */
+double time_lookups(const Handler *(*lookup)(DBusMessage *),
+		DBusMessage **msgs, guint n, guint *matched)
+{
+	gint64 start;
+	gint i;
+
+	*matched = 0;
+	start = g_get_monotonic_time();
+
+	for (i = 0; i < iterations; i++)
+		if (lookup(msgs[i % n]))
+			(*matched)++;
+
+	return (g_get_monotonic_time() - start) * 1000.0 / iterations;
+}
+
+gboolean agree(DBusMessage **msgs, guint n)
+{
+	guint i;
+
+	for (i = 0; i < n; i++)
+		if (lookup_chain(msgs[i]) != lookup_table(msgs[i]))
+			return FALSE;
+
+	return TRUE;
+}
+
+int main(int argc, char **argv)
+{
+	GOptionContext *context;
+	GError *err = NULL;
+	DBusMessage **daemon, **foreign;
+	guint i, matched;
+	double chain, lookup;
+	gboolean same;
+
+	context = g_option_context_new("- signal dispatch benchmark");
+	g_option_context_add_main_entries(context, entries, NULL);
+	if (!g_option_context_parse(context, &argc, &argv, &err)) {
+		g_printerr("%s\n", err->message);
+		return 1;
+	}
+	g_option_context_free(context);
+
+	table = g_hash_table_new(g_str_hash, g_str_equal);
+	for (i = 0; i < G_N_ELEMENTS(handlers); i++)
+		g_hash_table_insert(table, (gpointer)handlers[i].interface,
+				(gpointer)&handlers[i]);
+
+	daemon = build(handlers, G_N_ELEMENTS(handlers));
+	foreign = build(others, G_N_ELEMENTS(others));
+	same = agree(daemon, G_N_ELEMENTS(handlers))
+		&& agree(foreign, G_N_ELEMENTS(others));
+
+	printf("{\n  \"iterations\": %d,\n", iterations);
+
+	chain = time_lookups(lookup_chain, daemon,
+			G_N_ELEMENTS(handlers), &matched);
+	lookup = time_lookups(lookup_table, daemon,
+			G_N_ELEMENTS(handlers), &matched);
+	printf("  \"daemon_signals_ns\": { \"chain\": %.1f, \"table\": %.1f },\n",
+			chain, lookup);
+
+	chain = time_lookups(lookup_chain, foreign,
+			G_N_ELEMENTS(others), &matched);
+	lookup = time_lookups(lookup_table, foreign,
+			G_N_ELEMENTS(others), &matched);
+	printf("  \"other_messages_ns\": { \"chain\": %.1f, \"table\": %.1f },\n",
+			chain, lookup);
+	printf("  \"agree\": %s\n}\n", same ? "true" : "false");
+
+	for (i = 0; i < G_N_ELEMENTS(handlers); i++)
+		dbus_message_unref(daemon[i]);
+	for (i = 0; i < G_N_ELEMENTS(others); i++)
+		dbus_message_unref(foreign[i]);
+	g_free(daemon);
+	g_free(foreign);
+	g_hash_table_destroy(table);
+	return same ? 0 : 1;
+}
@@ -0,0 +1,147 @@
+/*
+ * Copyright (c) 2020 Ivan J. <parazyd@dyne.org>
+ *
+ * This file is part of liblocation
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Measures the LocationGeodesyMethod trade-off: the time per
+ * location_geodesy_distance() call and the largest error relative to
+ * LOCATION_GEODESY_VINCENTY, for point pairs up to 1 km, 100 km and
+ * 10000 km apart. Results are printed as JSON on stdout.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <time.h>
+
+#include <glib.h>
+
+#include <location/location-geodesy.h>
+
+#define N_METHODS 3
+#define N_RANGES 3
+
+static const char *method_names[N_METHODS] = {
+	"equirectangular", "haversine", "vincenty",
+};
+
+static const double ranges[N_RANGES] = { 1e3, 1e5, 1e7 };
+
+static gint pairs = 100000;
+static gint seed = 1;
+static double max_latitude = 80;
+
+static GOptionEntry entries[] = {
+	{ "pairs", 'p', 0, G_OPTION_ARG_INT, &pairs,
+		"Point pairs per distance range (default 100000)", "N" },
+	{ "seed", 0, 0, G_OPTION_ARG_INT, &seed,
+		"Random seed (default 1)", "N" },
+	{ "max-latitude", 0, 0, G_OPTION_ARG_DOUBLE, &max_latitude,
+		"Largest start latitude (default 80)", "DEG" },
+	{ NULL }
+};
+
+/* function declarations */
+static gint64 now_ns(void);
+
+gint64 now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+int main(int argc, char **argv)
+{
+	GOptionContext *context;
+	GError *err = NULL;
+	GRand *rand;
+	double *lat_s, *lon_s, *lat_f, *lon_f, *truth;
+	double ns[N_METHODS] = { 0 }, error[N_METHODS][N_RANGES] = { { 0 } };
+	double sink = 0, d;
+	gint64 start;
+	gint m, r, i;
+
+	context = g_option_context_new("- LocationGeodesyMethod benchmark");
+	g_option_context_add_main_entries(context, entries, NULL);
+	if (!g_option_context_parse(context, &argc, &argv, &err)) {
+		g_printerr("%s\n", err->message);
+		return 1;
+	}
+	g_option_context_free(context);
+
+	if (pairs <= 0) {
+		g_printerr("--pairs must be positive\n");
+		return 1;
+	}
+
+	rand = g_rand_new_with_seed(seed);
+	lat_s = g_new(double, pairs);
+	lon_s = g_new(double, pairs);
+	lat_f = g_new(double, pairs);
+	lon_f = g_new(double, pairs);
+	truth = g_new(double, pairs);
+
+	for (r = 0; r < N_RANGES; r++) {
+		for (i = 0; i < pairs; i++) {
+			lat_s[i] = g_rand_double_range(rand, -max_latitude, max_latitude);
+			lon_s[i] = g_rand_double_range(rand, -180, 180);
+			location_geodesy_destination(LOCATION_GEODESY_VINCENTY,
+					lat_s[i], lon_s[i],
+					g_rand_double_range(rand, 0, 360),
+					g_rand_double_range(rand, 1, ranges[r]),
+					&lat_f[i], &lon_f[i]);
+			truth[i] = location_geodesy_distance(LOCATION_GEODESY_VINCENTY,
+					lat_s[i], lon_s[i], lat_f[i], lon_f[i]);
+		}
+
+		for (m = 0; m < N_METHODS; m++) {
+			start = now_ns();
+			for (i = 0; i < pairs; i++)
+				sink += location_geodesy_distance(m, lat_s[i], lon_s[i],
+						lat_f[i], lon_f[i]);
+			ns[m] += (double)(now_ns() - start) / pairs / N_RANGES;
+
+			for (i = 0; i < pairs; i++) {
+				d = location_geodesy_distance(m, lat_s[i], lon_s[i],
+						lat_f[i], lon_f[i]);
+				error[m][r] = MAX(error[m][r], fabs(d - truth[i]) / truth[i]);
+			}
+		}
+	}
+
+	printf("{\n  \"pairs\": %d,\n  \"max_latitude\": %g,\n", pairs,
+			max_latitude);
+	printf("  \"methods\": [\n");
+	for (m = 0; m < N_METHODS; m++) {
+		printf("    { \"method\": \"%s\", \"ns\": %.1f, "
+				"\"max_rel_error\": { \"1km\": %.2e, \"100km\": %.2e, "
+				"\"10000km\": %.2e } }%s\n", method_names[m], ns[m],
+				error[m][0], error[m][1], error[m][2],
+				m + 1 < N_METHODS ? "," : "");
+	}
+	printf("  ],\n  \"checksum\": %g\n}\n", sink);
+
+	g_free(lat_s);
+	g_free(lon_s);
+	g_free(lat_f);
+	g_free(lon_f);
+	g_free(truth);
+	g_rand_free(rand);
+	return 0;
+}
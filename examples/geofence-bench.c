@@ -0,0 +1,157 @@
+/*
+ * Copyright (c) 2020 Ivan J. <parazyd@dyne.org>
+ *
+ * This file is part of liblocation
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Measures LocationGeofenceSet: fills a city sized area with fences and
+ * times location_geofence_set_update() along a random walk through it.
+ * Results are printed as JSON on stdout.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <glib.h>
+
+#include <location/location-geofence.h>
+
+/* 50 x 50 km around Oulu */
+#define CENTER_LAT 65.0121
+#define CENTER_LON 25.4651
+#define SPAN_LAT 0.45
+#define SPAN_LON 1.05
+
+static gint fences = 100000;
+static gint updates = 100000;
+static gint seed = 1;
+
+static GOptionEntry entries[] = {
+	{ "fences", 'f', 0, G_OPTION_ARG_INT, &fences,
+		"Number of fences (default 100000)", "N" },
+	{ "updates", 'u', 0, G_OPTION_ARG_INT, &updates,
+		"Number of positions (default 100000)", "N" },
+	{ "seed", 0, 0, G_OPTION_ARG_INT, &seed,
+		"Random seed (default 1)", "N" },
+	{ NULL }
+};
+
+static guint transitions = 0;
+
+/* function declarations */
+static gint64 now_ns(void);
+static void on_transition(guint, LocationGeofenceTransition, gpointer);
+static int compare_gint64(const void *, const void *);
+
+gint64 now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void on_transition(guint id, LocationGeofenceTransition transition,
+		gpointer data)
+{
+	transitions++;
+}
+
+int compare_gint64(const void *a, const void *b)
+{
+	gint64 x = *(const gint64 *)a, y = *(const gint64 *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+int main(int argc, char **argv)
+{
+	LocationGeofenceSet *set;
+	GOptionContext *context;
+	GError *err = NULL;
+	GRand *rand;
+	gint64 *times, start, total = 0;
+	double lat, lon, radius, h;
+	gint i;
+
+	context = g_option_context_new("- LocationGeofenceSet benchmark");
+	g_option_context_add_main_entries(context, entries, NULL);
+	if (!g_option_context_parse(context, &argc, &argv, &err)) {
+		g_printerr("%s\n", err->message);
+		return 1;
+	}
+	g_option_context_free(context);
+
+	rand = g_rand_new_with_seed(seed);
+	set = location_geofence_set_new(10, 60000);
+
+	start = now_ns();
+	for (i = 0; i < fences; i++) {
+		lat = CENTER_LAT + g_rand_double_range(rand, -SPAN_LAT, SPAN_LAT) / 2;
+		lon = CENTER_LON + g_rand_double_range(rand, -SPAN_LON, SPAN_LON) / 2;
+
+		/* mostly circles of 50 - 500 m, some blocks */
+		if (i % 4) {
+			radius = g_rand_double_range(rand, 50, 500);
+			location_geofence_set_add_circle(set, lat, lon, radius);
+		} else {
+			h = g_rand_double_range(rand, 0.001, 0.005);
+			location_geofence_set_add_rectangle(set, lat, lon,
+					lat + h, lon + 2 * h);
+		}
+	}
+	printf("{\n  \"fences\": %d,\n  \"build_ms\": %.1f,\n", fences,
+			(now_ns() - start) / 1e6);
+
+	/* a walk at driving speed, one position a second */
+	times = g_new(gint64, updates);
+	lat = CENTER_LAT;
+	lon = CENTER_LON;
+
+	for (i = 0; i < updates; i++) {
+		lat += g_rand_double_range(rand, -1.5e-4, 1.5e-4);
+		lon += g_rand_double_range(rand, -3.5e-4, 3.5e-4);
+		lat = CLAMP(lat, CENTER_LAT - SPAN_LAT / 2,
+				CENTER_LAT + SPAN_LAT / 2);
+		lon = CLAMP(lon, CENTER_LON - SPAN_LON / 2,
+				CENTER_LON + SPAN_LON / 2);
+
+		start = now_ns();
+		location_geofence_set_update(set, lat, lon, i * 1000LL,
+				on_transition, NULL);
+		times[i] = now_ns() - start;
+		total += times[i];
+	}
+
+	qsort(times, updates, sizeof(gint64), compare_gint64);
+
+	printf("  \"updates\": %d,\n  \"transitions\": %u,\n", updates,
+			transitions);
+	printf("  \"update_ns\": { \"mean\": %.0f, \"p50\": %" G_GINT64_FORMAT
+			", \"p99\": %" G_GINT64_FORMAT
+			", \"max\": %" G_GINT64_FORMAT " }\n}\n",
+			updates ? (double)total / updates : 0.0,
+			updates ? times[updates / 2] : 0,
+			updates ? times[(gint64)updates * 99 / 100] : 0,
+			updates ? times[updates - 1] : 0);
+
+	g_free(times);
+	location_geofence_set_unref(set);
+	g_rand_free(rand);
+	return 0;
+}
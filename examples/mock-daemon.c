@@ -0,0 +1,386 @@
+/*
+ * Copyright (c) 2020 Ivan J. <parazyd@dyne.org>
+ *
+ * This file is part of liblocation
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * A stand-in for location-daemon, for running liblocation clients, tests
+ * and benchmarks without GPS hardware. It claims org.maemo.LocationDaemon
+ * on the system bus, answers "start", "stop" and "set_interval", and
+ * emits the signals liblocation listens to from a scripted scenario.
+ *
+ * Use run-private-bus.sh to run it, and the client, on a private bus.
+ */
+
+#include <math.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <dbus/dbus.h>
+#include <dbus/dbus-glib-lowlevel.h>
+#include <glib.h>
+
+#include <location/location-gps-device.h>
+
+#define LOCATION_DAEMON_SERVICE "org.maemo.LocationDaemon"
+#define LOCATION_DAEMON_PATH    "/org/maemo/LocationDaemon"
+
+#define D2R (M_PI / 180.0)
+
+typedef enum {
+	SCENARIO_STEADY,	/* 3D fix, driving in a circle */
+	SCENARIO_FIX_LOSS,	/* loses the fix 3 s out of every 10 s */
+	SCENARIO_FLAP,		/* alternates between 2D and 3D every epoch */
+	SCENARIO_SKY,		/* steady, with a large, changing sky view */
+} Scenario;
+
+static const gchar *scenario_names[] = {
+	"steady", "fix-loss", "flap", "sky",
+};
+
+/* options */
+static gdouble rate = 0;
+static gint satellites = 12;
+static gint epochs = 0;
+static gchar *scenario_name = NULL;
+static gboolean autostart = FALSE;
+static gdouble latitude = 65.0121;
+static gdouble longitude = 25.4651;
+
+static GOptionEntry entries[] = {
+	{ "rate", 'r', 0, G_OPTION_ARG_DOUBLE, &rate,
+		"Epochs per second (default: as the client asks, else 1)",
+		"HZ" },
+	{ "satellites", 's', 0, G_OPTION_ARG_INT, &satellites,
+		"Satellites in view (default 12, 60 with the sky scenario)",
+		"N" },
+	{ "epochs", 'n', 0, G_OPTION_ARG_INT, &epochs,
+		"Exit after N epochs (default: run forever)", "N" },
+	{ "scenario", 'S', 0, G_OPTION_ARG_STRING, &scenario_name,
+		"steady, fix-loss, flap or sky (default steady)", "NAME" },
+	{ "autostart", 'a', 0, G_OPTION_ARG_NONE, &autostart,
+		"Emit without waiting for a \"start\" call", NULL },
+	{ "latitude", 0, 0, G_OPTION_ARG_DOUBLE, &latitude,
+		"Latitude of the center of the route", "DEG" },
+	{ "longitude", 0, 0, G_OPTION_ARG_DOUBLE, &longitude,
+		"Longitude of the center of the route", "DEG" },
+	{ NULL }
+};
+
+static DBusConnection *bus;
+static GMainLoop *loop;
+static Scenario scenario = SCENARIO_STEADY;
+static guint epoch_id = 0;
+static guint epoch = 0;
+static guint8 last_mode = LOCATION_GPS_DEVICE_MODE_NOT_SEEN;
+
+/* without --rate the interval passed to "set_interval" sets the rate */
+static gboolean follow_interval = FALSE;
+
+/* function declarations */
+static void emit(const char *, const char *, int, ...);
+static void emit_satellites(guint);
+static gboolean emit_epoch(gpointer);
+static void start_emitting(void);
+static void stop_emitting(void);
+static DBusHandlerResult on_message(DBusConnection *, DBusMessage *, void *);
+
+void emit(const char *interface, const char *member, int first_type, ...)
+{
+	DBusMessage *msg;
+	va_list args;
+
+	msg = dbus_message_new_signal(LOCATION_DAEMON_PATH, interface, member);
+
+	va_start(args, first_type);
+	dbus_message_append_args_valist(msg, first_type, args);
+	va_end(args);
+
+	dbus_connection_send(bus, msg, NULL);
+	dbus_message_unref(msg);
+}
+
+void emit_satellites(guint n)
+{
+	DBusMessageIter iter, arr, st;
+	DBusMessage *msg;
+	dbus_int16_t prn;
+	dbus_bool_t in_use;
+	double elevation, azimuth, snr;
+	guint i;
+
+	msg = dbus_message_new_signal(LOCATION_DAEMON_PATH,
+			LOCATION_DAEMON_SERVICE".Satellite", "SatellitesChanged");
+
+	dbus_message_iter_init_append(msg, &iter);
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+			DBUS_STRUCT_BEGIN_CHAR_AS_STRING
+			DBUS_TYPE_INT16_AS_STRING
+			DBUS_TYPE_DOUBLE_AS_STRING
+			DBUS_TYPE_DOUBLE_AS_STRING
+			DBUS_TYPE_DOUBLE_AS_STRING
+			DBUS_TYPE_BOOLEAN_AS_STRING
+			DBUS_STRUCT_END_CHAR_AS_STRING, &arr);
+
+	for (i = 0; i < n; i++) {
+		/* satellites slowly drift across the sky */
+		prn = i + 1;
+		elevation = fmod(i * 37.0 + epoch * 0.1, 90.0);
+		azimuth = fmod(i * 71.0 + epoch * 0.2, 360.0);
+		snr = 20.0 + fmod(i * 13.0 + epoch, 25.0);
+		in_use = elevation > 15.0;
+
+		dbus_message_iter_open_container(&arr, DBUS_TYPE_STRUCT,
+				NULL, &st);
+		dbus_message_iter_append_basic(&st, DBUS_TYPE_INT16, &prn);
+		dbus_message_iter_append_basic(&st, DBUS_TYPE_DOUBLE, &elevation);
+		dbus_message_iter_append_basic(&st, DBUS_TYPE_DOUBLE, &azimuth);
+		dbus_message_iter_append_basic(&st, DBUS_TYPE_DOUBLE, &snr);
+		dbus_message_iter_append_basic(&st, DBUS_TYPE_BOOLEAN, &in_use);
+		dbus_message_iter_close_container(&arr, &st);
+	}
+
+	dbus_message_iter_close_container(&iter, &arr);
+	dbus_connection_send(bus, msg, NULL);
+	dbus_message_unref(msg);
+}
+
+gboolean emit_epoch(gpointer data)
+{
+	struct timespec ts;
+	dbus_int64_t sec, nsec;
+	double lat, lon, alt, speed, track, climb, angle;
+	double ept = 0.01, epv = 8.0, epd = 2.0, eps = 1.0, epc = 0.5,
+		eph = 500.0;
+	guint8 mode = LOCATION_GPS_DEVICE_MODE_3D;
+	guint t = (guint)(epoch / rate);
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	sec = ts.tv_sec;
+	nsec = ts.tv_nsec;
+
+	/* a 1 km circle at 15 m/s */
+	angle = epoch / rate * 15.0 / 1000.0;
+	lat = latitude + 1000.0 * cos(angle) / 111318.8;
+	lon = longitude + 1000.0 * sin(angle)
+		/ (111318.8 * cos(latitude * D2R));
+	alt = 20.0 + 5.0 * sin(angle * 3);
+	speed = 15.0;
+	track = fmod(angle / D2R + 90.0, 360.0);
+	climb = 15.0 * cos(angle * 3) * 3 * 5.0 / 1000.0;
+
+	switch (scenario) {
+	case SCENARIO_FIX_LOSS:
+		if (t % 10 >= 7) {
+			mode = LOCATION_GPS_DEVICE_MODE_NO_FIX;
+			lat = lon = alt = NAN;
+			speed = track = climb = NAN;
+		}
+		break;
+	case SCENARIO_FLAP:
+		if (epoch % 2) {
+			mode = LOCATION_GPS_DEVICE_MODE_2D;
+			alt = climb = NAN;
+		}
+		break;
+	default:
+		break;
+	}
+
+	emit(LOCATION_DAEMON_SERVICE".Time", "TimeChanged",
+			DBUS_TYPE_INT64, &sec,
+			DBUS_TYPE_INT64, &nsec,
+			DBUS_TYPE_INVALID);
+
+	if (mode != last_mode) {
+		emit(LOCATION_DAEMON_SERVICE".Device", "FixStatusChanged",
+				DBUS_TYPE_BYTE, &mode,
+				DBUS_TYPE_INVALID);
+		last_mode = mode;
+	}
+
+	emit(LOCATION_DAEMON_SERVICE".Position", "PositionChanged",
+			DBUS_TYPE_DOUBLE, &lat,
+			DBUS_TYPE_DOUBLE, &lon,
+			DBUS_TYPE_DOUBLE, &alt,
+			DBUS_TYPE_INVALID);
+
+	emit(LOCATION_DAEMON_SERVICE".Course", "CourseChanged",
+			DBUS_TYPE_DOUBLE, &speed,
+			DBUS_TYPE_DOUBLE, &track,
+			DBUS_TYPE_DOUBLE, &climb,
+			DBUS_TYPE_INVALID);
+
+	emit(LOCATION_DAEMON_SERVICE".Accuracy", "AccuracyChanged",
+			DBUS_TYPE_DOUBLE, &ept,
+			DBUS_TYPE_DOUBLE, &epv,
+			DBUS_TYPE_DOUBLE, &epd,
+			DBUS_TYPE_DOUBLE, &eps,
+			DBUS_TYPE_DOUBLE, &epc,
+			DBUS_TYPE_DOUBLE, &eph,
+			DBUS_TYPE_INVALID);
+
+	/* like real receivers, the sky view is only sent once a second */
+	if (scenario == SCENARIO_SKY || epoch % MAX((guint)rate, 1) == 0)
+		emit_satellites(satellites);
+
+	dbus_connection_flush(bus);
+
+	if (++epoch == (guint)epochs) {
+		g_main_loop_quit(loop);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+void start_emitting(void)
+{
+	if (epoch_id)
+		return;
+
+	epoch_id = g_timeout_add(MAX(1000.0 / rate, 1), emit_epoch, NULL);
+}
+
+void stop_emitting(void)
+{
+	if (!epoch_id)
+		return;
+
+	g_source_remove(epoch_id);
+	epoch_id = 0;
+	last_mode = LOCATION_GPS_DEVICE_MODE_NOT_SEEN;
+}
+
+DBusHandlerResult on_message(DBusConnection *conn, DBusMessage *msg,
+		void *data)
+{
+	DBusMessage *reply;
+	dbus_int32_t interval;
+
+	if (dbus_message_is_method_call(msg, LOCATION_DAEMON_SERVICE, "start")) {
+		start_emitting();
+	} else if (dbus_message_is_method_call(msg, LOCATION_DAEMON_SERVICE,
+				"set_interval")) {
+		if (!dbus_message_get_args(msg, NULL, DBUS_TYPE_INT32, &interval,
+					DBUS_TYPE_INVALID) || interval <= 0) {
+			reply = dbus_message_new_error(msg,
+					DBUS_ERROR_INVALID_ARGS,
+					"Expected a positive interval in ms");
+			dbus_connection_send(conn, reply, NULL);
+			dbus_message_unref(reply);
+			return DBUS_HANDLER_RESULT_HANDLED;
+		}
+
+		/* an epoch source running at the old rate is restarted */
+		if (follow_interval && 1000.0 / interval != rate) {
+			rate = 1000.0 / interval;
+			if (epoch_id) {
+				stop_emitting();
+				start_emitting();
+			}
+		}
+	} else if (dbus_message_is_method_call(msg, LOCATION_DAEMON_SERVICE,
+				"stop")) {
+		stop_emitting();
+	} else {
+		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+	}
+
+	if (!dbus_message_get_no_reply(msg)) {
+		reply = dbus_message_new_method_return(msg);
+		dbus_connection_send(conn, reply, NULL);
+		dbus_message_unref(reply);
+	}
+
+	return DBUS_HANDLER_RESULT_HANDLED;
+}
+
+int main(int argc, char **argv)
+{
+	static const DBusObjectPathVTable vtable = { NULL, on_message };
+	GOptionContext *context;
+	GError *err = NULL;
+	DBusError derr;
+	guint i;
+
+	context = g_option_context_new("- location-daemon stand-in");
+	g_option_context_add_main_entries(context, entries, NULL);
+	if (!g_option_context_parse(context, &argc, &argv, &err)) {
+		g_printerr("%s\n", err->message);
+		return 1;
+	}
+	g_option_context_free(context);
+
+	if (scenario_name) {
+		for (i = 0; i < G_N_ELEMENTS(scenario_names); i++)
+			if (!strcmp(scenario_name, scenario_names[i]))
+				break;
+
+		if (i == G_N_ELEMENTS(scenario_names)) {
+			g_printerr("Unknown scenario %s\n", scenario_name);
+			return 1;
+		}
+
+		scenario = i;
+	}
+
+	if (scenario == SCENARIO_SKY && satellites == 12)
+		satellites = 60;
+
+	if (rate == 0) {
+		follow_interval = TRUE;
+		rate = 1.0;
+	}
+
+	if (rate <= 0 || satellites < 0) {
+		g_printerr("Invalid rate or satellite count\n");
+		return 1;
+	}
+
+	dbus_error_init(&derr);
+	bus = dbus_bus_get(DBUS_BUS_SYSTEM, &derr);
+	if (!bus) {
+		g_printerr("%s\n", derr.message);
+		return 1;
+	}
+
+	if (dbus_bus_request_name(bus, LOCATION_DAEMON_SERVICE,
+				DBUS_NAME_FLAG_DO_NOT_QUEUE, &derr)
+			!= DBUS_REQUEST_NAME_REPLY_PRIMARY_OWNER) {
+		g_printerr("Could not own %s%s%s\n", LOCATION_DAEMON_SERVICE,
+				derr.message ? ": " : "",
+				derr.message ? derr.message : "");
+		return 1;
+	}
+
+	loop = g_main_loop_new(NULL, FALSE);
+	dbus_connection_setup_with_g_main(bus, NULL);
+	dbus_connection_register_object_path(bus, LOCATION_DAEMON_PATH,
+			&vtable, NULL);
+
+	if (autostart)
+		start_emitting();
+
+	g_main_loop_run(loop);
+
+	g_main_loop_unref(loop);
+	dbus_connection_unref(bus);
+	return 0;
+}
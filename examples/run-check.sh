@@ -0,0 +1,44 @@
+#!/bin/sh
+#
+# Runs one of the examples as a test from "make check": briefly, and on a
+# private bus when it talks to location-daemon. Those are skipped when
+# there is no dbus-daemon to run the bus with.
+
+prog=$1
+srcdir=${srcdir:-$(dirname "$0")}
+shift
+
+# mock-daemon is built next to the program, not next to this script
+MOCK_DAEMON=$(dirname "$prog")/mock-daemon
+export MOCK_DAEMON
+
+need_bus() {
+	if ! command -v dbus-daemon >/dev/null 2>&1; then
+		echo "$0: no dbus-daemon, skipping $prog" >&2
+		exit 77
+	fi
+}
+
+case $(basename "$prog") in
+bench)
+	need_bus
+	exec "$srcdir/run-private-bus.sh" --no-mock -- \
+		"$prog" --duration 1 --no-ramp "$@"
+	;;
+dispatch-bench)
+	exec "$prog" --iterations 100000 "$@"
+	;;
+scaling)
+	need_bus
+	exec "$srcdir/run-private-bus.sh" --autostart --rate 10 -- \
+		"$prog" --duration 1 "$@"
+	;;
+snapshot-stress)
+	need_bus
+	exec "$srcdir/run-private-bus.sh" --no-mock -- \
+		"$prog" --duration 1 --readers 4 "$@"
+	;;
+*)
+	exec "$prog" "$@"
+	;;
+esac
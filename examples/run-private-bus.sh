@@ -0,0 +1,74 @@
+#!/bin/sh
+#
+# Runs a command on a private D-Bus daemon, standing in for the system bus,
+# with mock-daemon owning org.maemo.LocationDaemon on it. Nothing touches
+# the real system bus or GPS, so this works on build machines.
+#
+#   ./run-private-bus.sh [mock-daemon options] -- command [args]
+#
+# e.g. ./run-private-bus.sh --scenario fix-loss --rate 5 -- ./basic
+#
+# --no-mock leaves org.maemo.LocationDaemon free for the command to own.
+# MOCK_DAEMON names the mock-daemon to run, by default the one next to
+# this script.
+
+mock_daemon=${MOCK_DAEMON:-$(dirname "$0")/mock-daemon}
+mock_args=
+no_mock=
+
+while [ $# -gt 0 ] && [ "$1" != "--" ]; do
+	if [ "$1" = "--no-mock" ]; then
+		no_mock=1
+	else
+		mock_args="$mock_args $1"
+	fi
+	shift
+done
+
+if [ "$1" != "--" ] || [ $# -lt 2 ]; then
+	echo "usage: $0 [mock-daemon options] -- command [args]" >&2
+	exit 2
+fi
+shift
+
+# the session configuration lets any client own any name
+bus_info=$(dbus-daemon --session --fork --print-address=1 --print-pid=1) \
+	|| exit 1
+bus_address=$(echo "$bus_info" | sed -n 1p)
+bus_pid=$(echo "$bus_info" | sed -n 2p)
+
+mock_pid=
+cleanup() {
+	[ -n "$mock_pid" ] && kill "$mock_pid" 2>/dev/null
+	kill "$bus_pid" 2>/dev/null
+}
+trap cleanup EXIT INT TERM
+
+DBUS_SYSTEM_BUS_ADDRESS=$bus_address
+export DBUS_SYSTEM_BUS_ADDRESS
+
+if [ -n "$no_mock" ]; then
+	"$@"
+	exit
+fi
+
+# shellcheck disable=SC2086
+"$mock_daemon" $mock_args &
+mock_pid=$!
+
+# wait for the mock to own its name before starting the client
+tries=0
+until dbus-send --address="$bus_address" --print-reply \
+		--dest=org.freedesktop.DBus /org/freedesktop/DBus \
+		org.freedesktop.DBus.NameHasOwner \
+		string:org.maemo.LocationDaemon 2>/dev/null \
+		| grep -q "boolean true"; do
+	tries=$((tries + 1))
+	if [ $tries -ge 50 ] || ! kill -0 "$mock_pid" 2>/dev/null; then
+		echo "$0: mock-daemon did not start" >&2
+		exit 1
+	fi
+	sleep 0.1
+done
+
+"$@"
@@ -0,0 +1,246 @@
+/*
+ * Copyright (c) 2020 Ivan J. <parazyd@dyne.org>
+ *
+ * This file is part of liblocation
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Measures how the cost of LocationGPSDevice grows with the number of
+ * devices on one GMainContext. For 1, 10, 100 and 1000 devices it reports
+ * the bus connections they opened, the time to construct them, the CPU
+ * time spent per epoch and how far apart the first and the last device
+ * saw each epoch. Runs against mock-daemon on a private bus:
+ *
+ *   ./run-private-bus.sh --autostart --rate 10 -- ./scaling
+ *
+ * Results are printed as JSON on stdout. Exits with 1 if a run saw no
+ * epoch at all.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <dbus/dbus.h>
+#include <glib.h>
+
+#include <location/location-gps-device.h>
+
+typedef struct {
+	guint devices;
+	guint connections;
+	gint64 construct_us;
+	gint64 cpu_ns;
+	guint epochs;
+	guint changed;
+	gint64 spread_max_us;
+	gint64 spread_sum_us;
+} Run;
+
+/* options */
+static gint duration = 5;
+
+static GOptionEntry entries[] = {
+	{ "duration", 'd', 0, G_OPTION_ARG_INT, &duration,
+		"Seconds per run (default 5)", "S" },
+	{ NULL }
+};
+
+static GMainLoop *loop;
+static DBusConnection *query;
+static Run *current;
+
+/* the epoch being delivered, and when its first "changed" ran */
+static double epoch_time;
+static gint64 epoch_first;
+static gint64 epoch_last;
+
+/* function declarations */
+static gint64 thread_cpu_ns(void);
+static guint count_connections(void);
+static void end_epoch(void);
+static void on_changed(LocationGPSDevice *, gpointer);
+static gboolean quit_loop(gpointer);
+static void run(Run *);
+static void print_run(const Run *, gboolean);
+
+gint64 thread_cpu_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* unique names on the bus, that is, connections */
+guint count_connections(void)
+{
+	DBusMessage *msg, *reply;
+	char **names;
+	int n, i;
+	guint count = 0;
+
+	msg = dbus_message_new_method_call(DBUS_SERVICE_DBUS, DBUS_PATH_DBUS,
+			DBUS_INTERFACE_DBUS, "ListNames");
+	reply = dbus_connection_send_with_reply_and_block(query, msg, -1, NULL);
+	dbus_message_unref(msg);
+
+	if (!reply)
+		return 0;
+
+	if (dbus_message_get_args(reply, NULL, DBUS_TYPE_ARRAY,
+				DBUS_TYPE_STRING, &names, &n, DBUS_TYPE_INVALID)) {
+		for (i = 0; i < n; i++)
+			if (names[i][0] == ':')
+				count++;
+		dbus_free_string_array(names);
+	}
+
+	dbus_message_unref(reply);
+	return count;
+}
+
+void end_epoch(void)
+{
+	gint64 spread = epoch_last - epoch_first;
+
+	if (!epoch_first)
+		return;
+
+	current->epochs++;
+	current->spread_sum_us += spread;
+	current->spread_max_us = MAX(current->spread_max_us, spread);
+}
+
+void on_changed(LocationGPSDevice *device, gpointer data)
+{
+	gint64 now = g_get_monotonic_time();
+
+	if (!current)
+		return;
+
+	current->changed++;
+
+	if (device->fix->time != epoch_time) {
+		end_epoch();
+		epoch_time = device->fix->time;
+		epoch_first = now;
+	}
+
+	epoch_last = now;
+}
+
+gboolean quit_loop(gpointer data)
+{
+	g_main_loop_quit(loop);
+	return FALSE;
+}
+
+void run(Run *r)
+{
+	LocationGPSDevice **devices;
+	guint before, i;
+	gint64 start, cpu;
+
+	devices = g_new(LocationGPSDevice *, r->devices);
+	before = count_connections();
+
+	start = g_get_monotonic_time();
+	for (i = 0; i < r->devices; i++) {
+		devices[i] = g_object_new(LOCATION_TYPE_GPS_DEVICE, NULL);
+		g_signal_connect(devices[i], "changed",
+				G_CALLBACK(on_changed), NULL);
+	}
+	r->construct_us = g_get_monotonic_time() - start;
+
+	r->connections = count_connections() - before;
+
+	current = r;
+	epoch_time = 0;
+	epoch_first = epoch_last = 0;
+	cpu = thread_cpu_ns();
+
+	g_timeout_add_seconds(duration, quit_loop, NULL);
+	g_main_loop_run(loop);
+
+	r->cpu_ns = thread_cpu_ns() - cpu;
+	end_epoch();
+	current = NULL;
+
+	for (i = 0; i < r->devices; i++)
+		g_object_unref(devices[i]);
+	g_free(devices);
+}
+
+void print_run(const Run *r, gboolean last)
+{
+	printf("    { \"devices\": %u, \"bus_connections\": %u, "
+			"\"construct_us\": %" G_GINT64_FORMAT ",\n",
+			r->devices, r->connections, r->construct_us);
+	printf("      \"epochs\": %u, \"changed_per_device_epoch\": %.2f,\n",
+			r->epochs, r->epochs
+			? (double)r->changed / r->epochs / r->devices : 0.0);
+	printf("      \"cpu_us_per_epoch\": %.1f, "
+			"\"spread_us\": { \"mean\": %.1f, \"max\": %"
+			G_GINT64_FORMAT " } }%s\n",
+			r->epochs ? r->cpu_ns / 1000.0 / r->epochs : 0.0,
+			r->epochs ? (double)r->spread_sum_us / r->epochs : 0.0,
+			r->spread_max_us, last ? "" : ",");
+}
+
+int main(int argc, char **argv)
+{
+	static const guint counts[] = { 1, 10, 100, 1000 };
+	GOptionContext *context;
+	GError *err = NULL;
+	Run r;
+	guint i;
+	gboolean missed = FALSE;
+
+	context = g_option_context_new("- LocationGPSDevice scaling test");
+	g_option_context_add_main_entries(context, entries, NULL);
+	if (!g_option_context_parse(context, &argc, &argv, &err)) {
+		g_printerr("%s\n", err->message);
+		return 1;
+	}
+	g_option_context_free(context);
+
+	query = dbus_bus_get_private(DBUS_BUS_SYSTEM, NULL);
+	if (!query) {
+		g_printerr("Could not connect to the system bus\n");
+		return 1;
+	}
+
+	loop = g_main_loop_new(NULL, FALSE);
+
+	printf("{\n  \"duration_s\": %d,\n  \"runs\": [\n", duration);
+
+	for (i = 0; i < G_N_ELEMENTS(counts); i++) {
+		memset(&r, 0, sizeof(Run));
+		r.devices = counts[i];
+		run(&r);
+		print_run(&r, i == G_N_ELEMENTS(counts) - 1);
+		if (!r.epochs)
+			missed = TRUE;
+	}
+
+	printf("  ]\n}\n");
+
+	g_main_loop_unref(loop);
+	dbus_connection_close(query);
+	dbus_connection_unref(query);
+	return missed ? 1 : 0;
+}
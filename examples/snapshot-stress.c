@@ -0,0 +1,258 @@
+/*
+ * Copyright (c) 2020 Ivan J. <parazyd@dyne.org>
+ *
+ * This file is part of liblocation
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Stress test for location_gps_device_get_snapshot(). The device runs on
+ * a thread and context of its own and publishes a snapshot for every
+ * PositionChanged sent from the main thread, while 1, 2, 4, ... reader
+ * threads copy snapshots as fast as they can.
+ *
+ * Every position encodes the same counter in its latitude, longitude and
+ * altitude, so a snapshot mixing two writes is caught, as is a sequence
+ * number going backwards. The test fails if either is seen; otherwise it
+ * reports how the read rate scales with the number of readers. Needs a
+ * bus of its own, as it owns org.maemo.LocationDaemon:
+ *
+ *   ./run-private-bus.sh --no-mock -- ./snapshot-stress
+ *
+ * Results are printed as JSON on stdout.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <dbus/dbus.h>
+#include <glib.h>
+
+#include <location/location-gps-device.h>
+
+#define LOCATION_DAEMON_SERVICE "org.maemo.LocationDaemon"
+#define LOCATION_DAEMON_PATH    "/org/maemo/LocationDaemon"
+
+typedef struct {
+	LocationGPSDevice *device;
+	GThread *thread;
+	guint64 reads;
+	guint64 torn;
+	guint64 backwards;
+} Reader;
+
+/* options */
+static gint duration = 3;
+static gint max_readers = 8;
+static gint rate = 1000;
+
+static GOptionEntry entries[] = {
+	{ "duration", 'd', 0, G_OPTION_ARG_INT, &duration,
+		"Seconds per reader count (default 3)", "S" },
+	{ "readers", 'r', 0, G_OPTION_ARG_INT, &max_readers,
+		"Highest number of reader threads (default 8)", "N" },
+	{ "rate", 'R', 0, G_OPTION_ARG_INT, &rate,
+		"Positions sent per second (default 1000)", "HZ" },
+	{ NULL }
+};
+
+static volatile gint stop = 0;
+
+/* function declarations */
+static void position(guint64, double *, double *, double *);
+static gboolean consistent(const LocationGPSDeviceFix *);
+static gpointer reader(gpointer);
+static gpointer device_thread(gpointer);
+static void send_position(DBusConnection *, guint64);
+
+/* the position sent as the n-th write */
+void position(guint64 n, double *latitude, double *longitude,
+		double *altitude)
+{
+	*latitude = 60.0 + (n % 1000000) * 1e-5;
+	*longitude = 20.0 + (n % 1000000) * 1e-5;
+	*altitude = n;
+}
+
+gboolean consistent(const LocationGPSDeviceFix *fix)
+{
+	double latitude, longitude, altitude;
+
+	/* nothing received yet */
+	if (!(fix->fields & LOCATION_GPS_DEVICE_ALTITUDE_SET))
+		return TRUE;
+
+	position(fix->altitude, &latitude, &longitude, &altitude);
+	return fix->latitude == latitude && fix->longitude == longitude;
+}
+
+gpointer reader(gpointer data)
+{
+	Reader *r = data;
+	LocationGPSDeviceSnapshot snapshot;
+	guint64 last = 0;
+
+	while (!g_atomic_int_get(&stop)) {
+		location_gps_device_get_snapshot(r->device, &snapshot);
+		r->reads++;
+
+		if (!consistent(&snapshot.fix))
+			r->torn++;
+		if (snapshot.sequence < last)
+			r->backwards++;
+		last = snapshot.sequence;
+	}
+
+	return NULL;
+}
+
+gpointer device_thread(gpointer data)
+{
+	g_main_loop_run(data);
+	return NULL;
+}
+
+void send_position(DBusConnection *bus, guint64 n)
+{
+	DBusMessage *msg;
+	double latitude, longitude, altitude;
+
+	position(n, &latitude, &longitude, &altitude);
+
+	msg = dbus_message_new_signal(LOCATION_DAEMON_PATH,
+			LOCATION_DAEMON_SERVICE".Position", "PositionChanged");
+	dbus_message_append_args(msg,
+			DBUS_TYPE_DOUBLE, &latitude,
+			DBUS_TYPE_DOUBLE, &longitude,
+			DBUS_TYPE_DOUBLE, &altitude,
+			DBUS_TYPE_INVALID);
+	dbus_connection_send(bus, msg, NULL);
+	dbus_message_unref(msg);
+}
+
+int main(int argc, char **argv)
+{
+	GOptionContext *context;
+	GError *err = NULL;
+	GMainContext *ctx;
+	GMainLoop *loop;
+	GThread *thread;
+	DBusConnection *bus;
+	LocationGPSDevice *device;
+	LocationGPSDeviceSnapshot snapshot;
+	Reader *readers;
+	struct timespec next;
+	guint64 n = 1, reads, torn = 0, backwards = 0, seq;
+	gint64 end, period;
+	gint count, i;
+	gboolean first = TRUE;
+
+	context = g_option_context_new("- LocationGPSDevice snapshot stress test");
+	g_option_context_add_main_entries(context, entries, NULL);
+	if (!g_option_context_parse(context, &argc, &argv, &err)) {
+		g_printerr("%s\n", err->message);
+		return 1;
+	}
+	g_option_context_free(context);
+
+	dbus_threads_init_default();
+
+	bus = dbus_bus_get_private(DBUS_BUS_SYSTEM, NULL);
+	if (!bus || dbus_bus_request_name(bus, LOCATION_DAEMON_SERVICE,
+				DBUS_NAME_FLAG_DO_NOT_QUEUE, NULL)
+			!= DBUS_REQUEST_NAME_REPLY_PRIMARY_OWNER) {
+		g_printerr("Could not own %s, is another daemon running?\n",
+				LOCATION_DAEMON_SERVICE);
+		return 1;
+	}
+
+	ctx = g_main_context_new();
+	loop = g_main_loop_new(ctx, FALSE);
+	device = g_object_new(LOCATION_TYPE_GPS_DEVICE,
+			"maincontext-pointer", ctx, NULL);
+	thread = g_thread_new("device", device_thread, loop);
+
+	readers = g_new0(Reader, max_readers);
+	period = 1000000000LL / MAX(rate, 1);
+
+	printf("{\n  \"rate_hz\": %d,\n  \"duration_s\": %d,\n  \"runs\": [\n",
+			rate, duration);
+
+	for (count = 1; count <= max_readers; count *= 2) {
+		g_atomic_int_set(&stop, 0);
+		location_gps_device_get_snapshot(device, &snapshot);
+		seq = snapshot.sequence;
+
+		for (i = 0; i < count; i++) {
+			memset(&readers[i], 0, sizeof(Reader));
+			readers[i].device = device;
+			readers[i].thread = g_thread_new("reader", reader,
+					&readers[i]);
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &next);
+		end = g_get_monotonic_time() + duration * G_USEC_PER_SEC;
+
+		while (g_get_monotonic_time() < end) {
+			send_position(bus, n++);
+			dbus_connection_flush(bus);
+
+			next.tv_nsec += period;
+			while (next.tv_nsec >= 1000000000) {
+				next.tv_nsec -= 1000000000;
+				next.tv_sec++;
+			}
+			clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next,
+					NULL);
+		}
+
+		g_atomic_int_set(&stop, 1);
+
+		reads = 0;
+		for (i = 0; i < count; i++) {
+			g_thread_join(readers[i].thread);
+			reads += readers[i].reads;
+			torn += readers[i].torn;
+			backwards += readers[i].backwards;
+		}
+
+		location_gps_device_get_snapshot(device, &snapshot);
+		printf("%s    { \"readers\": %d, \"writes\": %" G_GUINT64_FORMAT
+				", \"reads_per_s\": %.0f, "
+				"\"reads_per_s_per_reader\": %.0f }",
+				first ? "" : ",\n", count,
+				snapshot.sequence - seq,
+				(double)reads / duration,
+				(double)reads / duration / count);
+		first = FALSE;
+	}
+
+	printf("\n  ],\n  \"torn\": %" G_GUINT64_FORMAT
+			",\n  \"backwards\": %" G_GUINT64_FORMAT "\n}\n",
+			torn, backwards);
+
+	g_main_loop_quit(loop);
+	g_thread_join(thread);
+	g_object_unref(device);
+	g_main_loop_unref(loop);
+	g_main_context_unref(ctx);
+	g_free(readers);
+
+	dbus_connection_close(bus);
+	dbus_connection_unref(bus);
+
+	return torn || backwards ? 1 : 0;
+}
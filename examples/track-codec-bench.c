@@ -0,0 +1,173 @@
+/*
+ * Copyright (c) 2020 Ivan J. <parazyd@dyne.org>
+ *
+ * This file is part of liblocation
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Measures LocationTrackEncoder and LocationTrackDecoder on a simulated
+ * drive recorded once a second: the encoded size per fix, the encode and
+ * decode speed in megabytes of LocationGPSDeviceFix per second and the
+ * largest position error after the round trip. Results are printed as
+ * JSON on stdout.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <time.h>
+
+#include <glib.h>
+
+#include <location/location-geodesy.h>
+#include <location/location-track-codec.h>
+
+static gint fixes = 1000000;
+static gint rounds = 5;
+static double noise = 1.0;
+static gint seed = 1;
+
+static GOptionEntry entries[] = {
+	{ "fixes", 'f', 0, G_OPTION_ARG_INT, &fixes,
+		"Number of fixes (default 1000000)", "N" },
+	{ "rounds", 'r', 0, G_OPTION_ARG_INT, &rounds,
+		"Times to encode and decode, the fastest counts (default 5)", "N" },
+	{ "noise", 'n', 0, G_OPTION_ARG_DOUBLE, &noise,
+		"Position noise in meters (default 1)", "M" },
+	{ "seed", 0, 0, G_OPTION_ARG_INT, &seed,
+		"Random seed (default 1)", "N" },
+	{ NULL }
+};
+
+/* function declarations */
+static gint64 now_ns(void);
+static void simulate(GRand *, LocationGPSDeviceFix *, gint);
+
+gint64 now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* a drive that speeds up, slows down and turns, starting in Oulu */
+void simulate(GRand *rand, LocationGPSDeviceFix *track, gint n)
+{
+	double lat = 65.0121, lon = 25.4651, alt = 20, speed = 0, heading = 0;
+	double target = 50;
+	gint i;
+
+	for (i = 0; i < n; i++) {
+		if (g_rand_int_range(rand, 0, 60) == 0)
+			target = g_rand_double_range(rand, 0, 100);
+		speed += CLAMP(target - speed, -5, 5);
+		heading = fmod(heading + g_rand_double_range(rand, -5, 5) + 360, 360);
+		alt += g_rand_double_range(rand, -0.3, 0.3);
+
+		location_geodesy_destination(LOCATION_GEODESY_EQUIRECTANGULAR,
+				lat, lon, heading, speed / 3.6, &lat, &lon);
+
+		track[i].mode = LOCATION_GPS_DEVICE_MODE_3D;
+		track[i].fields = LOCATION_GPS_DEVICE_TIME_SET |
+			LOCATION_GPS_DEVICE_LATLONG_SET |
+			LOCATION_GPS_DEVICE_ALTITUDE_SET |
+			LOCATION_GPS_DEVICE_SPEED_SET |
+			LOCATION_GPS_DEVICE_TRACK_SET;
+		track[i].time = 1.6e9 + i;
+		track[i].latitude = lat +
+			g_rand_double_range(rand, -noise, noise) / 111320;
+		track[i].longitude = lon +
+			g_rand_double_range(rand, -noise, noise) / 47000;
+		track[i].altitude = alt;
+		track[i].speed = speed;
+		track[i].track = heading;
+	}
+}
+
+int main(int argc, char **argv)
+{
+	LocationTrackEncoder *enc = NULL;
+	LocationTrackDecoder *dec;
+	LocationGPSDeviceFix *track, fix;
+	GOptionContext *context;
+	GError *err = NULL;
+	GRand *rand;
+	const guint8 *data = NULL;
+	gint64 start, encode_ns = G_MAXINT64, decode_ns = G_MAXINT64;
+	double raw, error = 0;
+	gsize length = 0;
+	gint i, r, decoded = 0;
+
+	context = g_option_context_new("- LocationTrackEncoder benchmark");
+	g_option_context_add_main_entries(context, entries, NULL);
+	if (!g_option_context_parse(context, &argc, &argv, &err)) {
+		g_printerr("%s\n", err->message);
+		return 1;
+	}
+	g_option_context_free(context);
+
+	if (fixes <= 0 || rounds <= 0) {
+		g_printerr("--fixes and --rounds must be positive\n");
+		return 1;
+	}
+
+	rand = g_rand_new_with_seed(seed);
+	track = g_new0(LocationGPSDeviceFix, fixes);
+	simulate(rand, track, fixes);
+
+	for (r = 0; r < rounds; r++) {
+		if (enc)
+			location_track_encoder_free(enc);
+
+		start = now_ns();
+		enc = location_track_encoder_new(NULL, 0);
+		for (i = 0; i < fixes; i++)
+			location_track_encoder_add_fix(enc, &track[i]);
+		encode_ns = MIN(encode_ns, now_ns() - start);
+	}
+
+	data = location_track_encoder_get_data(enc, &length);
+
+	for (r = 0; r < rounds; r++) {
+		start = now_ns();
+		dec = location_track_decoder_new(data, length, NULL);
+		for (decoded = 0; location_track_decoder_next(dec, &fix); decoded++)
+			;
+		decode_ns = MIN(decode_ns, now_ns() - start);
+		location_track_decoder_free(dec);
+	}
+
+	dec = location_track_decoder_new(data, length, NULL);
+	for (i = 0; i < fixes && location_track_decoder_next(dec, &fix); i++) {
+		error = MAX(error, location_geodesy_distance(
+				LOCATION_GEODESY_HAVERSINE, track[i].latitude,
+				track[i].longitude, fix.latitude, fix.longitude));
+	}
+	location_track_decoder_free(dec);
+
+	raw = (double)fixes * sizeof(LocationGPSDeviceFix);
+
+	printf("{\n  \"fixes\": %d,\n  \"decoded\": %d,\n", fixes, decoded);
+	printf("  \"bytes_per_fix\": %.2f,\n", (double)length / fixes);
+	printf("  \"encode_mb_s\": %.0f,\n", raw / encode_ns * 1e3);
+	printf("  \"decode_mb_s\": %.0f,\n", raw / decode_ns * 1e3);
+	printf("  \"max_position_error_m\": %.4f\n}\n", error);
+
+	location_track_encoder_free(enc);
+	g_free(track);
+	g_rand_free(rand);
+	return 0;
+}
@@ -0,0 +1,416 @@
+/*
+ * Copyright (c) 2020 Ivan J. <parazyd@dyne.org>
+ *
+ * This file is part of liblocation
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_AVX2_KERNEL 1
+#endif
+
+#include "location-cell.h"
+#include "location-geodesy.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define MAX_LEVEL LOCATION_CELL_MAX_LEVEL
+
+/* cells per row and per column at the finest level */
+#define GRID_SIZE (1 << MAX_LEVEL)
+
+#define LON_SCALE ((double)GRID_SIZE / 360)
+#define LAT_SCALE ((double)GRID_SIZE / 180)
+
+typedef void (*EncodeKernel)(const double *latitudes,
+		const double *longitudes,
+		gsize n,
+		guint level,
+		LocationCellId *ids);
+
+/* function declarations */
+static guint64 spread(guint64);
+static guint64 compact(guint64);
+static guint64 lsb_for_level(guint);
+static LocationCellId make_id(guint64, guint64, guint);
+static void split_id(LocationCellId, guint64 *, guint64 *, guint *);
+static void encode_scalar(const double *, const double *, gsize, guint,
+		LocationCellId *);
+static EncodeKernel encode_kernel(void);
+
+/* moves the low 32 bits of v to the even bits */
+guint64 spread(guint64 v)
+{
+	v &= 0xffffffff;
+	v = (v | (v << 16)) & 0x0000ffff0000ffffULL;
+	v = (v | (v << 8)) & 0x00ff00ff00ff00ffULL;
+	v = (v | (v << 4)) & 0x0f0f0f0f0f0f0f0fULL;
+	v = (v | (v << 2)) & 0x3333333333333333ULL;
+	v = (v | (v << 1)) & 0x5555555555555555ULL;
+	return v;
+}
+
+/* the reverse of spread() */
+guint64 compact(guint64 v)
+{
+	v &= 0x5555555555555555ULL;
+	v = (v | (v >> 1)) & 0x3333333333333333ULL;
+	v = (v | (v >> 2)) & 0x0f0f0f0f0f0f0f0fULL;
+	v = (v | (v >> 4)) & 0x00ff00ff00ff00ffULL;
+	v = (v | (v >> 8)) & 0x0000ffff0000ffffULL;
+	v = (v | (v >> 16)) & 0x00000000ffffffffULL;
+	return v;
+}
+
+/* the marker bit of cells at level */
+guint64 lsb_for_level(guint level)
+{
+	return 1ULL << (2 * (MAX_LEVEL - level));
+}
+
+/* column x and row y of level */
+LocationCellId make_id(guint64 x, guint64 y, guint level)
+{
+	guint64 morton = spread(x) | (spread(y) << 1);
+
+	return ((morton << 1) | 1) << (2 * (MAX_LEVEL - level));
+}
+
+void split_id(LocationCellId id, guint64 *x, guint64 *y, guint *level)
+{
+	guint l = location_cell_get_level(id);
+	guint64 morton = id >> (2 * (MAX_LEVEL - l) + 1);
+
+	*x = compact(morton);
+	*y = compact(morton >> 1);
+	*level = l;
+}
+
+/*
+ * Positions are quantized at the finest level and the id truncated to the
+ * level asked for, so a cell always contains the cells of its positions at
+ * finer levels. The kernels compute this in the same order with the same
+ * operations, so their results are identical.
+ */
+void encode_scalar(const double *latitudes, const double *longitudes,
+		gsize n, guint level, LocationCellId *ids)
+{
+	guint64 lsb = lsb_for_level(level), x, y, morton;
+	double lat, lon;
+	gsize i;
+
+	for (i = 0; i < n; i++) {
+		lon = longitudes[i] + 180;
+		lon = lon - 360 * floor(lon / 360);
+		lat = latitudes[i] + 90;
+
+		if (isnan(lon) || isnan(lat)) {
+			ids[i] = LOCATION_CELL_INVALID;
+			continue;
+		}
+
+		x = (guint64)MIN(MAX(lon * LON_SCALE, 0), GRID_SIZE - 1);
+		y = (guint64)MIN(MAX(lat * LAT_SCALE, 0), GRID_SIZE - 1);
+
+		morton = spread(x) | (spread(y) << 1);
+		ids[i] = ((morton << 1) & -lsb) | lsb;
+	}
+}
+
+#ifdef HAVE_AVX2_KERNEL
+__attribute__((target("avx2")))
+static __m256i spread_avx2(__m256i v)
+{
+	v = _mm256_and_si256(_mm256_or_si256(v, _mm256_slli_epi64(v, 16)),
+			_mm256_set1_epi64x(0x0000ffff0000ffffLL));
+	v = _mm256_and_si256(_mm256_or_si256(v, _mm256_slli_epi64(v, 8)),
+			_mm256_set1_epi64x(0x00ff00ff00ff00ffLL));
+	v = _mm256_and_si256(_mm256_or_si256(v, _mm256_slli_epi64(v, 4)),
+			_mm256_set1_epi64x(0x0f0f0f0f0f0f0f0fLL));
+	v = _mm256_and_si256(_mm256_or_si256(v, _mm256_slli_epi64(v, 2)),
+			_mm256_set1_epi64x(0x3333333333333333LL));
+	v = _mm256_and_si256(_mm256_or_si256(v, _mm256_slli_epi64(v, 1)),
+			_mm256_set1_epi64x(0x5555555555555555LL));
+	return v;
+}
+
+__attribute__((target("avx2")))
+static void encode_avx2(const double *latitudes, const double *longitudes,
+		gsize n, guint level, LocationCellId *ids)
+{
+	const __m256d d180 = _mm256_set1_pd(180);
+	const __m256d d90 = _mm256_set1_pd(90);
+	const __m256d d360 = _mm256_set1_pd(360);
+	const __m256d zero = _mm256_setzero_pd();
+	const __m256d top = _mm256_set1_pd(GRID_SIZE - 1);
+	const __m256d lon_scale = _mm256_set1_pd(LON_SCALE);
+	const __m256d lat_scale = _mm256_set1_pd(LAT_SCALE);
+	const __m256i lsb = _mm256_set1_epi64x(lsb_for_level(level));
+	const __m256i mask = _mm256_set1_epi64x(-(gint64)lsb_for_level(level));
+	__m256d lat, lon, invalid;
+	__m256i x, y, id;
+	gsize i;
+
+	for (i = 0; i + 4 <= n; i += 4) {
+		lon = _mm256_add_pd(_mm256_loadu_pd(longitudes + i), d180);
+		lon = _mm256_sub_pd(lon, _mm256_mul_pd(d360,
+				_mm256_floor_pd(_mm256_div_pd(lon, d360))));
+		lat = _mm256_add_pd(_mm256_loadu_pd(latitudes + i), d90);
+		invalid = _mm256_cmp_pd(lon, lat, _CMP_UNORD_Q);
+
+		lon = _mm256_min_pd(_mm256_max_pd(_mm256_mul_pd(lon, lon_scale),
+				zero), top);
+		lat = _mm256_min_pd(_mm256_max_pd(_mm256_mul_pd(lat, lat_scale),
+				zero), top);
+
+		/* everything is below 2^30 now, so 32 bit conversions do */
+		x = spread_avx2(_mm256_cvtepu32_epi64(_mm256_cvttpd_epi32(lon)));
+		y = spread_avx2(_mm256_cvtepu32_epi64(_mm256_cvttpd_epi32(lat)));
+
+		id = _mm256_or_si256(x, _mm256_slli_epi64(y, 1));
+		id = _mm256_or_si256(_mm256_and_si256(_mm256_slli_epi64(id, 1),
+				mask), lsb);
+		id = _mm256_andnot_si256(_mm256_castpd_si256(invalid), id);
+
+		_mm256_storeu_si256((__m256i *)(ids + i), id);
+	}
+
+	encode_scalar(latitudes + i, longitudes + i, n - i, level, ids + i);
+}
+#endif
+
+EncodeKernel encode_kernel(void)
+{
+	static gsize kernel = 0;
+
+	if (g_once_init_enter(&kernel)) {
+		EncodeKernel best = encode_scalar;
+
+#ifdef HAVE_AVX2_KERNEL
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2"))
+			best = encode_avx2;
+#endif
+
+		g_once_init_leave(&kernel, (gsize)best);
+	}
+
+	return (EncodeKernel)kernel;
+}
+
+LocationCellId location_cell_from_latlong(double latitude,
+		double longitude,
+		guint level)
+{
+	LocationCellId id;
+
+	g_return_val_if_fail(level <= MAX_LEVEL, LOCATION_CELL_INVALID);
+
+	encode_scalar(&latitude, &longitude, 1, level, &id);
+	return id;
+}
+
+LocationCellId location_cell_from_fix(const LocationGPSDeviceFix *fix,
+		guint level)
+{
+	g_return_val_if_fail(fix != NULL, LOCATION_CELL_INVALID);
+
+	if (!(fix->fields & LOCATION_GPS_DEVICE_LATLONG_SET))
+		return LOCATION_CELL_INVALID;
+
+	return location_cell_from_latlong(fix->latitude, fix->longitude, level);
+}
+
+void location_cell_from_latlong_many(const double *latitudes,
+		const double *longitudes,
+		gsize n,
+		guint level,
+		LocationCellId *ids)
+{
+	g_return_if_fail(level <= MAX_LEVEL);
+	g_return_if_fail(n == 0 || (latitudes && longitudes && ids));
+
+	encode_kernel()(latitudes, longitudes, n, level, ids);
+}
+
+void location_cell_get_bounds(LocationCellId id,
+		double *south,
+		double *west,
+		double *north,
+		double *east)
+{
+	guint64 x, y;
+	guint level;
+	double width, height;
+
+	g_return_if_fail(id != LOCATION_CELL_INVALID);
+
+	split_id(id, &x, &y, &level);
+	width = 360.0 / (1ULL << level);
+	height = 180.0 / (1ULL << level);
+
+	if (south)
+		*south = y * height - 90;
+	if (west)
+		*west = x * width - 180;
+	if (north)
+		*north = (y + 1) * height - 90;
+	if (east)
+		*east = (x + 1) * width - 180;
+}
+
+void location_cell_to_latlong(LocationCellId id,
+		double *latitude,
+		double *longitude)
+{
+	double south, west, north, east;
+
+	g_return_if_fail(latitude != NULL && longitude != NULL);
+
+	location_cell_get_bounds(id, &south, &west, &north, &east);
+	*latitude = (south + north) / 2;
+	*longitude = (west + east) / 2;
+}
+
+guint location_cell_get_level(LocationCellId id)
+{
+	g_return_val_if_fail(id != LOCATION_CELL_INVALID, 0);
+
+	return MAX_LEVEL - __builtin_ctzll(id) / 2;
+}
+
+LocationCellId location_cell_get_parent(LocationCellId id, guint level)
+{
+	guint64 lsb;
+
+	g_return_val_if_fail(level <= location_cell_get_level(id),
+			LOCATION_CELL_INVALID);
+
+	lsb = lsb_for_level(level);
+	return (id & -lsb) | lsb;
+}
+
+gboolean location_cell_contains(LocationCellId id, LocationCellId other)
+{
+	guint64 lsb = id & -id;
+
+	return other >= id - (lsb - 1) && other <= id + (lsb - 1);
+}
+
+guint location_cell_get_neighbors(LocationCellId id,
+		LocationCellId *neighbors)
+{
+	guint64 x, y, size;
+	guint level, n = 0, i;
+	LocationCellId cell;
+	gint dx, dy;
+
+	g_return_val_if_fail(id != LOCATION_CELL_INVALID, 0);
+	g_return_val_if_fail(neighbors != NULL, 0);
+
+	split_id(id, &x, &y, &level);
+	size = 1ULL << level;
+
+	for (dy = -1; dy <= 1; dy++) {
+		if ((dy < 0 && y == 0) || (dy > 0 && y == size - 1))
+			continue;
+
+		for (dx = -1; dx <= 1; dx++) {
+			cell = make_id((x + size + dx) % size, y + dy, level);
+
+			/* with few columns, both ways around reach the same cell */
+			for (i = 0; i < n && neighbors[i] != cell; i++)
+				;
+			if (cell != id && i == n)
+				neighbors[n++] = cell;
+		}
+	}
+
+	return n;
+}
+
+guint location_cell_cover_circle(double latitude,
+		double longitude,
+		double radius,
+		guint level,
+		LocationCellId *cells,
+		guint max_cells)
+{
+	guint64 size, x0, nx, y0, y1, x, y, i;
+	double angle, dlat, dlon, edge, south, west, north, east, lat, lon, reach;
+	LocationCellId cell;
+	guint n = 0;
+
+	g_return_val_if_fail(level <= MAX_LEVEL, 0);
+	g_return_val_if_fail(max_cells == 0 || cells != NULL, 0);
+
+	if (isnan(latitude) || isnan(longitude) || radius < 0)
+		return 0;
+
+	size = 1ULL << level;
+	latitude = CLAMP(latitude, -90, 90);
+	longitude = fmod(longitude + 180, 360);
+	longitude += longitude < 0 ? 180 : -180;
+	angle = radius / LOCATION_GEODESY_EARTH_RADIUS;
+	dlat = angle * 180 / M_PI;
+
+	y0 = (guint64)CLAMP((latitude - dlat + 90) / 180 * size, 0, size - 1);
+	y1 = (guint64)CLAMP((latitude + dlat + 90) / 180 * size, 0, size - 1);
+
+	/* longitude degrees are shortest on the edge closest to a pole */
+	edge = fabs(latitude) + dlat;
+	dlon = edge < 90 ? dlat / cos(edge * M_PI / 180) : 360;
+
+	if (dlon >= 180) {
+		x0 = 0;
+		nx = size;
+	} else {
+		x0 = (guint64)((longitude - dlon + 540) / 360 * size) % size;
+		nx = MIN((guint64)(2 * dlon / 360 * size) + 2, size);
+	}
+
+	for (y = y0; y <= y1; y++) {
+		for (i = 0; i < nx; i++) {
+			x = (x0 + i) % size;
+			cell = make_id(x, y, level);
+
+			/* a cell is within reach if its center is, give or take
+			 * the distance from the center to its farthest corner */
+			location_cell_get_bounds(cell, &south, &west, &north, &east);
+			lat = (south + north) / 2;
+			lon = (west + east) / 2;
+			reach = MAX(
+				location_geodesy_distance(LOCATION_GEODESY_HAVERSINE,
+					lat, lon, south, east),
+				location_geodesy_distance(LOCATION_GEODESY_HAVERSINE,
+					lat, lon, north, east));
+
+			if (location_geodesy_distance(LOCATION_GEODESY_HAVERSINE,
+					latitude, longitude, lat, lon) > radius + reach)
+				continue;
+
+			if (n < max_cells)
+				cells[n] = cell;
+			n++;
+		}
+	}
+
+	return n;
+}
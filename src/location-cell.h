@@ -0,0 +1,192 @@
+/*
+ * Copyright (c) 2020 Ivan J. <parazyd@dyne.org>
+ *
+ * This file is part of liblocation
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __LOCATION_CELL_H__
+#define __LOCATION_CELL_H__
+
+#include <glib.h>
+
+#include "location-gps-device.h"
+
+G_BEGIN_DECLS
+
+/**
+ * LocationCellId:
+ *
+ * A cell of a hierarchical grid over latitude and longitude, as a 64-bit
+ * integer. At level l the globe is split into 2^l columns of longitude
+ * and 2^l rows of latitude, so cells are twice as wide as they are high
+ * in degrees; each cell has four children at the next level.
+ *
+ * The id is the Morton (Z-order) code of the cell followed by a marker
+ * bit, the same layout S2 uses: cells with nearby ids are nearby on the
+ * globe, ids of different levels never collide and the ids of all the
+ * descendants of a cell form one contiguous range around it. Two fixes
+ * are in the same cell of a level when their ids at that level are
+ * equal.
+ */
+typedef guint64 LocationCellId;
+
+/**
+ * LOCATION_CELL_INVALID:
+ *
+ * The id returned for positions that are not a number. It is not a cell.
+ */
+#define LOCATION_CELL_INVALID ((LocationCellId)0)
+
+/**
+ * LOCATION_CELL_MAX_LEVEL:
+ *
+ * The finest level, where cells are about 4 cm by 2 cm on the equator.
+ */
+#define LOCATION_CELL_MAX_LEVEL 30
+
+/**
+ * location_cell_from_latlong:
+ * @latitude: Latitude (degrees).
+ * @longitude: Longitude (degrees), wrapped around if out of range.
+ * @level: Level of the cell, at most #LOCATION_CELL_MAX_LEVEL.
+ *
+ * Returns: The cell containing the position, or #LOCATION_CELL_INVALID.
+ */
+LocationCellId location_cell_from_latlong (double latitude,
+		double longitude,
+		guint level);
+
+/**
+ * location_cell_from_fix:
+ * @fix: A fix.
+ * @level: Level of the cell, at most #LOCATION_CELL_MAX_LEVEL.
+ *
+ * Returns: The cell containing the position of @fix, or
+ * #LOCATION_CELL_INVALID if it has no #LOCATION_GPS_DEVICE_LATLONG_SET.
+ */
+LocationCellId location_cell_from_fix (const LocationGPSDeviceFix *fix,
+		guint level);
+
+/**
+ * location_cell_from_latlong_many:
+ * @latitudes: Latitudes (degrees).
+ * @longitudes: Longitudes (degrees).
+ * @n: Number of positions.
+ * @level: Level of the cells, at most #LOCATION_CELL_MAX_LEVEL.
+ * @ids: (out): @n cell ids.
+ *
+ * Encodes many positions at once, with AVX2 when the processor has it.
+ * The results are the same as from location_cell_from_latlong().
+ */
+void location_cell_from_latlong_many (const double *latitudes,
+		const double *longitudes,
+		gsize n,
+		guint level,
+		LocationCellId *ids);
+
+/**
+ * location_cell_to_latlong:
+ * @id: A cell.
+ * @latitude: (out): Latitude of the center of the cell (degrees).
+ * @longitude: (out): Longitude of the center of the cell (degrees).
+ */
+void location_cell_to_latlong (LocationCellId id,
+		double *latitude,
+		double *longitude);
+
+/**
+ * location_cell_get_bounds:
+ * @id: A cell.
+ * @south: (out) (optional): Southern edge (degrees).
+ * @west: (out) (optional): Western edge (degrees).
+ * @north: (out) (optional): Northern edge (degrees).
+ * @east: (out) (optional): Eastern edge (degrees).
+ */
+void location_cell_get_bounds (LocationCellId id,
+		double *south,
+		double *west,
+		double *north,
+		double *east);
+
+/**
+ * location_cell_get_level:
+ * @id: A cell.
+ *
+ * Returns: The level of @id.
+ */
+guint location_cell_get_level (LocationCellId id);
+
+/**
+ * location_cell_get_parent:
+ * @id: A cell.
+ * @level: A level no finer than the level of @id.
+ *
+ * Returns: The cell at @level containing @id.
+ */
+LocationCellId location_cell_get_parent (LocationCellId id,
+		guint level);
+
+/**
+ * location_cell_contains:
+ * @id: A cell.
+ * @other: Another cell.
+ *
+ * Returns: %TRUE if @other is @id or one of its descendants.
+ */
+gboolean location_cell_contains (LocationCellId id,
+		LocationCellId other);
+
+/**
+ * location_cell_get_neighbors:
+ * @id: A cell.
+ * @neighbors: (out): Room for 8 cells.
+ *
+ * Finds the cells of the same level sharing an edge or a corner with @id,
+ * wrapping around at the 180th meridian. Cells in the first and last row
+ * have no neighbors across the pole.
+ *
+ * Returns: The number of neighbors stored, at most 8.
+ */
+guint location_cell_get_neighbors (LocationCellId id,
+		LocationCellId *neighbors);
+
+/**
+ * location_cell_cover_circle:
+ * @latitude: Latitude of the center (degrees).
+ * @longitude: Longitude of the center (degrees).
+ * @radius: Radius in meters, measured along great circles.
+ * @level: Level of the cells.
+ * @cells: (out): Room for @max_cells cells, or %NULL.
+ * @max_cells: Size of @cells.
+ *
+ * Finds cells of @level that together cover a circle. Every point of the
+ * circle is in one of them, though some may only come close to it. Cells
+ * get narrow towards the poles, so covers there take many more cells. At
+ * most @max_cells are stored, so call again with more room if the return
+ * value is larger.
+ *
+ * Returns: The number of cells in the cover.
+ */
+guint location_cell_cover_circle (double latitude,
+		double longitude,
+		double radius,
+		guint level,
+		LocationCellId *cells,
+		guint max_cells);
+
+G_END_DECLS
+
+#endif
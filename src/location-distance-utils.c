@@ -19,6 +19,14 @@
 
 #include <math.h>
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_KERNELS 1
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define HAVE_NEON_KERNEL 1
+#endif
+
 #include "location-distance-utils.h"
 
 #ifndef M_PI
@@ -27,18 +35,18 @@
 
 // scaling factor from degrees to meters at equator
 // == DEG_TO_RAD * radius of earth
-static float LOCATION_SCALING_FACTOR = 111318.84502145034f;
+static const double LOCATION_SCALING_FACTOR = 111318.84502145034;
 
 #define MAX(a, b) (((a) > (b)) ? (a) : (b))
 
-#define D2R (M_PI / 180.0f)
-// #define R2D (180.0f / M_PI)
+#define D2R (M_PI / 180.0)
+// #define R2D (180.0 / M_PI)
 
 // compensate for shrinking longitude towards poles
 double lng_scale(double lat)
 {
-	double scale = cosf(lat * D2R);
-	return MAX(scale, 0.01f);
+	double scale = cos(lat * D2R);
+	return MAX(scale, 0.01);
 }
 
 /*
@@ -53,6 +61,7 @@ double lng_scale(double lat)
  *
  * https://www.movable-type.co.uk/scripts/latlong.html
  *
+ * Haversine and ellipsoidal distances live in location-geodesy.h now.
  */
 // return distance in meters between two locations
 double location_distance_between(double latitude_s,
@@ -62,5 +71,248 @@ double location_distance_between(double latitude_s,
 {
 	double dlat = (latitude_f - latitude_s);
 	double dlng = (longitude_f - longitude_s) * lng_scale(latitude_s);
-	return sqrtf(dlat * dlat + dlng * dlng) * LOCATION_SCALING_FACTOR;
+	return sqrt(dlat * dlat + dlng * dlng) * LOCATION_SCALING_FACTOR;
+}
+
+/*
+ * Batch kernels.  Every code path evaluates the same expression as
+ * location_distance_between(),
+ *
+ *   sqrt(dlat * dlat + dlng * dlng) * LOCATION_SCALING_FACTOR
+ *
+ * with separate multiplies and adds and a correctly rounded sqrt, so the
+ * vector paths agree with the scalar one bit for bit.  The library is built
+ * with -ffp-contract=off, as a compiler fusing the multiply-adds of one
+ * path and not the other would move results by an ulp.
+ */
+
+// number of distances computed per chunk when looking for the nearest point
+#define NEAREST_CHUNK 256
+
+typedef void (*DistanceKernel)(const LocationDistanceOrigin *origin,
+		const double *latitudes,
+		const double *longitudes,
+		gsize n,
+		double *distances);
+
+/* function declarations */
+static void distance_kernel_scalar(const LocationDistanceOrigin *origin,
+		const double *latitudes,
+		const double *longitudes,
+		gsize n,
+		double *distances);
+static DistanceKernel distance_kernel(void);
+
+void location_distance_origin_init(LocationDistanceOrigin *origin,
+		double latitude,
+		double longitude)
+{
+	origin->latitude = latitude;
+	origin->longitude = longitude;
+	origin->lng_scale = lng_scale(latitude);
+}
+
+double location_distance_from_origin(const LocationDistanceOrigin *origin,
+		double latitude,
+		double longitude)
+{
+	double distance;
+
+	distance_kernel_scalar(origin, &latitude, &longitude, 1, &distance);
+	return distance;
+}
+
+void distance_kernel_scalar(const LocationDistanceOrigin *origin,
+		const double *latitudes,
+		const double *longitudes,
+		gsize n,
+		double *distances)
+{
+	gsize i;
+
+	for (i = 0; i < n; i++) {
+		double dlat = latitudes[i] - origin->latitude;
+		double dlng = (longitudes[i] - origin->longitude) * origin->lng_scale;
+		double sq = dlat * dlat;
+
+		sq = sq + dlng * dlng;
+		distances[i] = sqrt(sq) * LOCATION_SCALING_FACTOR;
+	}
+}
+
+#ifdef HAVE_X86_KERNELS
+__attribute__((target("sse2")))
+static void distance_kernel_sse2(const LocationDistanceOrigin *origin,
+		const double *latitudes,
+		const double *longitudes,
+		gsize n,
+		double *distances)
+{
+	const __m128d lat0 = _mm_set1_pd(origin->latitude);
+	const __m128d lon0 = _mm_set1_pd(origin->longitude);
+	const __m128d scale = _mm_set1_pd(origin->lng_scale);
+	const __m128d meters = _mm_set1_pd(LOCATION_SCALING_FACTOR);
+	gsize i;
+
+	for (i = 0; i + 2 <= n; i += 2) {
+		__m128d dlat = _mm_sub_pd(_mm_loadu_pd(latitudes + i), lat0);
+		__m128d dlng = _mm_mul_pd(_mm_sub_pd(
+				_mm_loadu_pd(longitudes + i), lon0), scale);
+		__m128d sq = _mm_add_pd(_mm_mul_pd(dlat, dlat),
+				_mm_mul_pd(dlng, dlng));
+
+		_mm_storeu_pd(distances + i, _mm_mul_pd(_mm_sqrt_pd(sq), meters));
+	}
+
+	distance_kernel_scalar(origin, latitudes + i, longitudes + i, n - i,
+			distances + i);
+}
+
+__attribute__((target("avx2")))
+static void distance_kernel_avx2(const LocationDistanceOrigin *origin,
+		const double *latitudes,
+		const double *longitudes,
+		gsize n,
+		double *distances)
+{
+	const __m256d lat0 = _mm256_set1_pd(origin->latitude);
+	const __m256d lon0 = _mm256_set1_pd(origin->longitude);
+	const __m256d scale = _mm256_set1_pd(origin->lng_scale);
+	const __m256d meters = _mm256_set1_pd(LOCATION_SCALING_FACTOR);
+	gsize i;
+
+	for (i = 0; i + 4 <= n; i += 4) {
+		__m256d dlat = _mm256_sub_pd(_mm256_loadu_pd(latitudes + i), lat0);
+		__m256d dlng = _mm256_mul_pd(_mm256_sub_pd(
+				_mm256_loadu_pd(longitudes + i), lon0), scale);
+		__m256d sq = _mm256_add_pd(_mm256_mul_pd(dlat, dlat),
+				_mm256_mul_pd(dlng, dlng));
+
+		_mm256_storeu_pd(distances + i,
+				_mm256_mul_pd(_mm256_sqrt_pd(sq), meters));
+	}
+
+	distance_kernel_scalar(origin, latitudes + i, longitudes + i, n - i,
+			distances + i);
+}
+#endif
+
+#ifdef HAVE_NEON_KERNEL
+static void distance_kernel_neon(const LocationDistanceOrigin *origin,
+		const double *latitudes,
+		const double *longitudes,
+		gsize n,
+		double *distances)
+{
+	const float64x2_t lat0 = vdupq_n_f64(origin->latitude);
+	const float64x2_t lon0 = vdupq_n_f64(origin->longitude);
+	const float64x2_t scale = vdupq_n_f64(origin->lng_scale);
+	const float64x2_t meters = vdupq_n_f64(LOCATION_SCALING_FACTOR);
+	gsize i;
+
+	for (i = 0; i + 2 <= n; i += 2) {
+		float64x2_t dlat = vsubq_f64(vld1q_f64(latitudes + i), lat0);
+		float64x2_t dlng = vmulq_f64(vsubq_f64(
+				vld1q_f64(longitudes + i), lon0), scale);
+		float64x2_t sq = vaddq_f64(vmulq_f64(dlat, dlat),
+				vmulq_f64(dlng, dlng));
+
+		vst1q_f64(distances + i, vmulq_f64(vsqrtq_f64(sq), meters));
+	}
+
+	distance_kernel_scalar(origin, latitudes + i, longitudes + i, n - i,
+			distances + i);
+}
+#endif
+
+DistanceKernel distance_kernel(void)
+{
+	static gsize kernel = 0;
+
+	if (g_once_init_enter(&kernel)) {
+		DistanceKernel best = distance_kernel_scalar;
+
+		if (!g_getenv("LOCATION_DISTANCE_SCALAR")) {
+#ifdef HAVE_X86_KERNELS
+			__builtin_cpu_init();
+			if (__builtin_cpu_supports("avx2"))
+				best = distance_kernel_avx2;
+			else if (__builtin_cpu_supports("sse2"))
+				best = distance_kernel_sse2;
+#elif defined(HAVE_NEON_KERNEL)
+			best = distance_kernel_neon;
+#endif
+		}
+
+		g_once_init_leave(&kernel, (gsize)best);
+	}
+
+	return (DistanceKernel)kernel;
+}
+
+void location_distance_between_many(const LocationDistanceOrigin *origin,
+		const double *latitudes,
+		const double *longitudes,
+		gsize n,
+		double *distances)
+{
+	g_return_if_fail(origin != NULL);
+	g_return_if_fail(n == 0 || (latitudes && longitudes && distances));
+
+	distance_kernel()(origin, latitudes, longitudes, n, distances);
+}
+
+void location_distance_matrix(const double *latitudes_a,
+		const double *longitudes_a,
+		gsize n_a,
+		const double *latitudes_b,
+		const double *longitudes_b,
+		gsize n_b,
+		double *distances)
+{
+	DistanceKernel kernel = distance_kernel();
+	LocationDistanceOrigin origin;
+	gsize i;
+
+	g_return_if_fail(n_a == 0 || (latitudes_a && longitudes_a));
+	g_return_if_fail(n_b == 0 || (latitudes_b && longitudes_b));
+	g_return_if_fail(n_a == 0 || n_b == 0 || distances);
+
+	for (i = 0; i < n_a; i++) {
+		location_distance_origin_init(&origin, latitudes_a[i], longitudes_a[i]);
+		kernel(&origin, latitudes_b, longitudes_b, n_b, distances + i * n_b);
+	}
+}
+
+gssize location_distance_nearest(const LocationDistanceOrigin *origin,
+		const double *latitudes,
+		const double *longitudes,
+		gsize n,
+		double *distance)
+{
+	DistanceKernel kernel = distance_kernel();
+	double chunk[NEAREST_CHUNK];
+	double best_distance = INFINITY;
+	gssize best = -1;
+	gsize i, j;
+
+	g_return_val_if_fail(origin != NULL, -1);
+	g_return_val_if_fail(n == 0 || (latitudes && longitudes), -1);
+
+	for (i = 0; i < n; i += NEAREST_CHUNK) {
+		gsize len = MIN(n - i, NEAREST_CHUNK);
+
+		kernel(origin, latitudes + i, longitudes + i, len, chunk);
+		for (j = 0; j < len; j++) {
+			if (chunk[j] < best_distance) {
+				best_distance = chunk[j];
+				best = i + j;
+			}
+		}
+	}
+
+	if (distance)
+		*distance = best_distance;
+
+	return best;
 }
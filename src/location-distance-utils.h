@@ -24,6 +24,22 @@
 
 G_BEGIN_DECLS
 
+/**
+ * LocationDistanceOrigin:
+ * @latitude: origin latitude in degrees
+ * @longitude: origin longitude in degrees
+ * @lng_scale: cached longitude scale for @latitude
+ *
+ * A prepared origin for repeated distance queries. Fill it in with
+ * location_distance_origin_init() so the longitude scale is computed only
+ * once instead of on every call.
+ */
+typedef struct {
+	double latitude;
+	double longitude;
+	double lng_scale;
+} LocationDistanceOrigin;
+
 double lng_scale(double lat);
 
 double location_distance_between (double latitude_s,
@@ -31,6 +47,95 @@ double location_distance_between (double latitude_s,
 		double latitude_f,
 		double longitude_f);
 
+/**
+ * location_distance_origin_init:
+ * @origin: origin to fill in
+ * @latitude: origin latitude in degrees
+ * @longitude: origin longitude in degrees
+ *
+ * Prepares @origin for location_distance_from_origin(),
+ * location_distance_between_many() and location_distance_nearest().
+ */
+void location_distance_origin_init(LocationDistanceOrigin *origin,
+		double latitude,
+		double longitude);
+
+/**
+ * location_distance_from_origin:
+ * @origin: a prepared origin
+ * @latitude: point latitude in degrees
+ * @longitude: point longitude in degrees
+ *
+ * Single point variant of location_distance_between_many().
+ *
+ * Returns: distance in meters from @origin to the point
+ */
+double location_distance_from_origin(const LocationDistanceOrigin *origin,
+		double latitude,
+		double longitude);
+
+/**
+ * location_distance_between_many:
+ * @origin: a prepared origin
+ * @latitudes: @n point latitudes in degrees
+ * @longitudes: @n point longitudes in degrees
+ * @n: number of points
+ * @distances: (out): @n distances in meters
+ *
+ * Computes the distance from @origin to every point using the same
+ * equirectangular approximation as location_distance_between(). The widest
+ * vector unit available (AVX2, SSE2 or NEON) is picked at runtime; setting
+ * LOCATION_DISTANCE_SCALAR in the environment forces the scalar code.
+ *
+ * All code paths return the same results as location_distance_between(),
+ * bit for bit.
+ */
+void location_distance_between_many(const LocationDistanceOrigin *origin,
+		const double *latitudes,
+		const double *longitudes,
+		gsize n,
+		double *distances);
+
+/**
+ * location_distance_matrix:
+ * @latitudes_a: @n_a row latitudes in degrees
+ * @longitudes_a: @n_a row longitudes in degrees
+ * @n_a: number of rows
+ * @latitudes_b: @n_b column latitudes in degrees
+ * @longitudes_b: @n_b column longitudes in degrees
+ * @n_b: number of columns
+ * @distances: (out): @n_a * @n_b distances in meters, row major
+ *
+ * Computes the distance from every point in a to every point in b.
+ * distances[i * n_b + j] holds the distance from a[i] to b[j]. Each row
+ * matches location_distance_between_many() with a[i] as the origin.
+ */
+void location_distance_matrix(const double *latitudes_a,
+		const double *longitudes_a,
+		gsize n_a,
+		const double *latitudes_b,
+		const double *longitudes_b,
+		gsize n_b,
+		double *distances);
+
+/**
+ * location_distance_nearest:
+ * @origin: a prepared origin
+ * @latitudes: @n candidate latitudes in degrees
+ * @longitudes: @n candidate longitudes in degrees
+ * @n: number of candidates
+ * @distance: (out) (optional): distance in meters to the nearest candidate
+ *
+ * Finds the candidate closest to @origin. Ties go to the lowest index.
+ *
+ * Returns: index of the nearest candidate, or -1 if @n is 0
+ */
+gssize location_distance_nearest(const LocationDistanceOrigin *origin,
+		const double *latitudes,
+		const double *longitudes,
+		gsize n,
+		double *distance);
+
 G_END_DECLS
 
 #endif
@@ -0,0 +1,294 @@
+/*
+ * Copyright (c) 2020 Ivan J. <parazyd@dyne.org>
+ *
+ * This file is part of liblocation
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+
+#include "location-distance-utils.h"
+#include "location-geodesy.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define D2R (M_PI / 180.0)
+#define R2D (180.0 / M_PI)
+
+/* equirectangular meters per degree, as in location-distance-utils.c */
+#define METERS_PER_DEGREE 111318.84502145034
+
+/* WGS84 ellipsoid */
+#define WGS84_A 6378137.0
+#define WGS84_F (1 / 298.257223563)
+#define WGS84_B (WGS84_A * (1 - WGS84_F))
+
+#define VINCENTY_EPSILON 1e-12
+#define VINCENTY_ITERATIONS 200
+
+/* function declarations */
+static double wrap360(double deg);
+static double wrap180(double deg);
+static double haversine_distance(double, double, double, double);
+static gboolean vincenty_inverse(double, double, double, double,
+		double *, double *);
+static void vincenty_direct(double, double, double, double,
+		double *, double *);
+
+/* into [0, 360) */
+double wrap360(double deg)
+{
+	deg = fmod(deg, 360);
+	return deg < 0 ? deg + 360 : deg;
+}
+
+/* into [-180, 180) */
+double wrap180(double deg)
+{
+	return wrap360(deg + 180) - 180;
+}
+
+double haversine_distance(double lat1, double lon1, double lat2, double lon2)
+{
+	double sdlat = sin((lat2 - lat1) * D2R / 2);
+	double sdlon = sin((lon2 - lon1) * D2R / 2);
+	double h = sdlat * sdlat +
+		cos(lat1 * D2R) * cos(lat2 * D2R) * sdlon * sdlon;
+
+	return 2 * LOCATION_GEODESY_EARTH_RADIUS * asin(sqrt(MIN(h, 1)));
+}
+
+/*
+ * Vincenty's inverse formula, T. Vincenty, "Direct and Inverse Solutions
+ * of Geodesics on the Ellipsoid with application of nested equations",
+ * Survey Review XXIII, 1975. Fails to converge for some nearly antipodal
+ * points.
+ */
+gboolean vincenty_inverse(double lat1, double lon1, double lat2, double lon2,
+		double *distance, double *bearing)
+{
+	double L = wrap180(lon2 - lon1) * D2R;
+	double U1 = atan((1 - WGS84_F) * tan(lat1 * D2R));
+	double U2 = atan((1 - WGS84_F) * tan(lat2 * D2R));
+	double sinU1 = sin(U1), cosU1 = cos(U1);
+	double sinU2 = sin(U2), cosU2 = cos(U2);
+	double lambda = L, lambda_p;
+	double sin_lambda, cos_lambda, sin_sigma, cos_sigma, sigma;
+	double sin_alpha, cos2_alpha, cos_2sigma_m, C;
+	double u2, A, B, delta_sigma;
+	int i;
+
+	for (i = 0; i < VINCENTY_ITERATIONS; i++) {
+		sin_lambda = sin(lambda);
+		cos_lambda = cos(lambda);
+		sin_sigma = hypot(cosU2 * sin_lambda,
+				cosU1 * sinU2 - sinU1 * cosU2 * cos_lambda);
+		if (sin_sigma == 0) {
+			/* coincident points */
+			*distance = 0;
+			*bearing = 0;
+			return TRUE;
+		}
+
+		cos_sigma = sinU1 * sinU2 + cosU1 * cosU2 * cos_lambda;
+		sigma = atan2(sin_sigma, cos_sigma);
+		sin_alpha = cosU1 * cosU2 * sin_lambda / sin_sigma;
+		cos2_alpha = 1 - sin_alpha * sin_alpha;
+		/* on the equator cos2_alpha is 0 */
+		cos_2sigma_m = cos2_alpha != 0 ?
+			cos_sigma - 2 * sinU1 * sinU2 / cos2_alpha : 0;
+		C = WGS84_F / 16 * cos2_alpha *
+			(4 + WGS84_F * (4 - 3 * cos2_alpha));
+
+		lambda_p = lambda;
+		lambda = L + (1 - C) * WGS84_F * sin_alpha * (sigma +
+			C * sin_sigma * (cos_2sigma_m + C * cos_sigma *
+			(-1 + 2 * cos_2sigma_m * cos_2sigma_m)));
+
+		if (fabs(lambda - lambda_p) < VINCENTY_EPSILON)
+			break;
+	}
+
+	if (i == VINCENTY_ITERATIONS)
+		return FALSE;
+
+	u2 = cos2_alpha * (WGS84_A * WGS84_A - WGS84_B * WGS84_B) /
+		(WGS84_B * WGS84_B);
+	A = 1 + u2 / 16384 * (4096 + u2 * (-768 + u2 * (320 - 175 * u2)));
+	B = u2 / 1024 * (256 + u2 * (-128 + u2 * (74 - 47 * u2)));
+	delta_sigma = B * sin_sigma * (cos_2sigma_m + B / 4 *
+		(cos_sigma * (-1 + 2 * cos_2sigma_m * cos_2sigma_m) -
+		 B / 6 * cos_2sigma_m * (-3 + 4 * sin_sigma * sin_sigma) *
+		 (-3 + 4 * cos_2sigma_m * cos_2sigma_m)));
+
+	*distance = WGS84_B * A * (sigma - delta_sigma);
+	*bearing = wrap360(atan2(cosU2 * sin_lambda,
+			cosU1 * sinU2 - sinU1 * cosU2 * cos_lambda) * R2D);
+	return TRUE;
+}
+
+/* Vincenty's direct formula, from the same paper */
+void vincenty_direct(double lat, double lon, double bearing, double distance,
+		double *latitude_out, double *longitude_out)
+{
+	double alpha1 = bearing * D2R;
+	double sin_alpha1 = sin(alpha1), cos_alpha1 = cos(alpha1);
+	double tanU1 = (1 - WGS84_F) * tan(lat * D2R);
+	double cosU1 = 1 / sqrt(1 + tanU1 * tanU1);
+	double sinU1 = tanU1 * cosU1;
+	double sigma1 = atan2(tanU1, cos_alpha1);
+	double sin_alpha = cosU1 * sin_alpha1;
+	double cos2_alpha = 1 - sin_alpha * sin_alpha;
+	double u2 = cos2_alpha * (WGS84_A * WGS84_A - WGS84_B * WGS84_B) /
+		(WGS84_B * WGS84_B);
+	double A = 1 + u2 / 16384 * (4096 + u2 * (-768 + u2 *
+		(320 - 175 * u2)));
+	double B = u2 / 1024 * (256 + u2 * (-128 + u2 * (74 - 47 * u2)));
+	double sigma = distance / (WGS84_B * A), sigma_p;
+	double sin_sigma, cos_sigma, cos_2sigma_m, delta_sigma;
+	double x, lambda, C, L;
+	int i;
+
+	for (i = 0; i < VINCENTY_ITERATIONS; i++) {
+		cos_2sigma_m = cos(2 * sigma1 + sigma);
+		sin_sigma = sin(sigma);
+		cos_sigma = cos(sigma);
+		delta_sigma = B * sin_sigma * (cos_2sigma_m + B / 4 *
+			(cos_sigma * (-1 + 2 * cos_2sigma_m * cos_2sigma_m) -
+			 B / 6 * cos_2sigma_m * (-3 + 4 * sin_sigma * sin_sigma) *
+			 (-3 + 4 * cos_2sigma_m * cos_2sigma_m)));
+
+		sigma_p = sigma;
+		sigma = distance / (WGS84_B * A) + delta_sigma;
+		if (fabs(sigma - sigma_p) < VINCENTY_EPSILON)
+			break;
+	}
+
+	cos_2sigma_m = cos(2 * sigma1 + sigma);
+	sin_sigma = sin(sigma);
+	cos_sigma = cos(sigma);
+
+	x = sinU1 * sin_sigma - cosU1 * cos_sigma * cos_alpha1;
+	*latitude_out = atan2(sinU1 * cos_sigma + cosU1 * sin_sigma * cos_alpha1,
+			(1 - WGS84_F) * hypot(sin_alpha, x)) * R2D;
+
+	lambda = atan2(sin_sigma * sin_alpha1,
+			cosU1 * cos_sigma - sinU1 * sin_sigma * cos_alpha1);
+	C = WGS84_F / 16 * cos2_alpha * (4 + WGS84_F * (4 - 3 * cos2_alpha));
+	L = lambda - (1 - C) * WGS84_F * sin_alpha * (sigma + C * sin_sigma *
+		(cos_2sigma_m + C * cos_sigma *
+		 (-1 + 2 * cos_2sigma_m * cos_2sigma_m)));
+
+	*longitude_out = wrap180(lon + L * R2D);
+}
+
+double location_geodesy_distance(LocationGeodesyMethod method,
+		double latitude_s,
+		double longitude_s,
+		double latitude_f,
+		double longitude_f)
+{
+	double distance, bearing;
+
+	switch (method) {
+	case LOCATION_GEODESY_EQUIRECTANGULAR:
+		/* the short way around across the 180th meridian */
+		return location_distance_between(latitude_s, longitude_s,
+				latitude_f,
+				longitude_s + wrap180(longitude_f - longitude_s));
+	case LOCATION_GEODESY_VINCENTY:
+		if (vincenty_inverse(latitude_s, longitude_s,
+					latitude_f, longitude_f, &distance, &bearing))
+			return distance;
+		/* fall through */
+	case LOCATION_GEODESY_HAVERSINE:
+		return haversine_distance(latitude_s, longitude_s,
+				latitude_f, longitude_f);
+	}
+
+	g_return_val_if_reached(NAN);
+}
+
+double location_geodesy_bearing(LocationGeodesyMethod method,
+		double latitude_s,
+		double longitude_s,
+		double latitude_f,
+		double longitude_f)
+{
+	double distance, bearing, dlon, y, x;
+
+	switch (method) {
+	case LOCATION_GEODESY_EQUIRECTANGULAR:
+		dlon = wrap180(longitude_f - longitude_s);
+		return wrap360(atan2(dlon * lng_scale(latitude_s),
+					latitude_f - latitude_s) * R2D);
+	case LOCATION_GEODESY_VINCENTY:
+		if (vincenty_inverse(latitude_s, longitude_s,
+					latitude_f, longitude_f, &distance, &bearing))
+			return bearing;
+		/* fall through */
+	case LOCATION_GEODESY_HAVERSINE:
+		dlon = (longitude_f - longitude_s) * D2R;
+		y = sin(dlon) * cos(latitude_f * D2R);
+		x = cos(latitude_s * D2R) * sin(latitude_f * D2R) -
+			sin(latitude_s * D2R) * cos(latitude_f * D2R) * cos(dlon);
+		return wrap360(atan2(y, x) * R2D);
+	}
+
+	g_return_val_if_reached(NAN);
+}
+
+void location_geodesy_destination(LocationGeodesyMethod method,
+		double latitude,
+		double longitude,
+		double bearing,
+		double distance,
+		double *latitude_out,
+		double *longitude_out)
+{
+	double lat, lon, delta, theta;
+
+	g_return_if_fail(latitude_out != NULL && longitude_out != NULL);
+
+	switch (method) {
+	case LOCATION_GEODESY_EQUIRECTANGULAR:
+		theta = bearing * D2R;
+		lat = latitude + distance * cos(theta) / METERS_PER_DEGREE;
+		lon = longitude + distance * sin(theta) /
+			(METERS_PER_DEGREE * lng_scale(latitude));
+		break;
+	case LOCATION_GEODESY_HAVERSINE:
+		delta = distance / LOCATION_GEODESY_EARTH_RADIUS;
+		theta = bearing * D2R;
+		lat = asin(sin(latitude * D2R) * cos(delta) +
+			cos(latitude * D2R) * sin(delta) * cos(theta));
+		lon = longitude * D2R + atan2(
+			sin(theta) * sin(delta) * cos(latitude * D2R),
+			cos(delta) - sin(latitude * D2R) * sin(lat));
+		lat *= R2D;
+		lon *= R2D;
+		break;
+	case LOCATION_GEODESY_VINCENTY:
+		vincenty_direct(latitude, longitude, bearing, distance, &lat, &lon);
+		break;
+	default:
+		g_return_if_reached();
+	}
+
+	*latitude_out = lat;
+	*longitude_out = wrap180(lon);
+}
@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2020 Ivan J. <parazyd@dyne.org>
+ *
+ * This file is part of liblocation
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __LOCATION_GEODESY_H__
+#define __LOCATION_GEODESY_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/**
+ * LOCATION_GEODESY_EARTH_RADIUS:
+ *
+ * Mean radius of the earth in meters, used by the spherical methods.
+ */
+#define LOCATION_GEODESY_EARTH_RADIUS 6371008.8
+
+/**
+ * LocationGeodesyMethod:
+ * @LOCATION_GEODESY_EQUIRECTANGULAR: Flat earth around the starting point,
+ * the same approximation as location_distance_between(), but measured the
+ * short way around across the 180th meridian.
+ * @LOCATION_GEODESY_HAVERSINE: Great circles on a sphere of
+ * #LOCATION_GEODESY_EARTH_RADIUS.
+ * @LOCATION_GEODESY_VINCENTY: Geodesics on the WGS84 ellipsoid, using
+ * Vincenty's iterative formulae.
+ *
+ * How distances, bearings and destinations are computed. Pick the
+ * cheapest method that meets the accuracy budget of the call site; the
+ * methods are listed from cheapest to most expensive, and
+ * examples/geodesy-bench.c times them on the machine at hand. The
+ * relative distance error against #LOCATION_GEODESY_VINCENTY, for start
+ * points between 80 S and 80 N, stays below:
+ *
+ * |[
+ * method           up to 1 km   up to 100 km   up to 10000 km
+ * equirectangular    0.68 %        2 %            over 100 %
+ * haversine          0.57 %        0.57 %         0.57 %
+ * vincenty           reference
+ * ]|
+ *
+ * tests/test-geodesy.c checks these bounds on random pairs.
+ *
+ * The spherical error comes from the flattening of the earth and depends
+ * on latitude and direction rather than distance. The equirectangular
+ * error also grows with distance and towards the poles. Vincenty's
+ * formulae are accurate to within a millimeter on the ellipsoid.
+ */
+typedef enum {
+	LOCATION_GEODESY_EQUIRECTANGULAR,
+	LOCATION_GEODESY_HAVERSINE,
+	LOCATION_GEODESY_VINCENTY,
+} LocationGeodesyMethod;
+
+/**
+ * location_geodesy_distance:
+ * @method: How to compute the distance.
+ * @latitude_s: Start latitude in degrees.
+ * @longitude_s: Start longitude in degrees.
+ * @latitude_f: End latitude in degrees.
+ * @longitude_f: End longitude in degrees.
+ *
+ * #LOCATION_GEODESY_VINCENTY does not converge for some nearly antipodal
+ * points; the #LOCATION_GEODESY_HAVERSINE distance is returned for those.
+ *
+ * Returns: The distance between the points in meters.
+ */
+double location_geodesy_distance (LocationGeodesyMethod method,
+		double latitude_s,
+		double longitude_s,
+		double latitude_f,
+		double longitude_f);
+
+/**
+ * location_geodesy_bearing:
+ * @method: How to compute the bearing.
+ * @latitude_s: Start latitude in degrees.
+ * @longitude_s: Start longitude in degrees.
+ * @latitude_f: End latitude in degrees.
+ * @longitude_f: End longitude in degrees.
+ *
+ * Returns: The initial bearing from the start to the end point, in degrees
+ * clockwise from north in [0, 360).
+ */
+double location_geodesy_bearing (LocationGeodesyMethod method,
+		double latitude_s,
+		double longitude_s,
+		double latitude_f,
+		double longitude_f);
+
+/**
+ * location_geodesy_destination:
+ * @method: How to compute the destination.
+ * @latitude: Start latitude in degrees.
+ * @longitude: Start longitude in degrees.
+ * @bearing: Initial bearing in degrees clockwise from north.
+ * @distance: Distance to travel in meters.
+ * @latitude_out: (out): Destination latitude in degrees.
+ * @longitude_out: (out): Destination longitude in degrees, in
+ * [-180, 180).
+ *
+ * Finds the point reached by travelling @distance meters from the start
+ * point along @bearing.
+ */
+void location_geodesy_destination (LocationGeodesyMethod method,
+		double latitude,
+		double longitude,
+		double bearing,
+		double distance,
+		double *latitude_out,
+		double *longitude_out);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,433 @@
+/*
+ * Copyright (c) 2020 Ivan J. <parazyd@dyne.org>
+ *
+ * This file is part of liblocation
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+
+#include "location-distance-utils.h"
+#include "location-geodesy.h"
+#include "location-geofence.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+/* meters per degree of latitude */
+#define METERS_PER_DEGREE 111318.84502145034
+
+/* the same on the sphere circles are measured on */
+#define SPHERE_METERS_PER_DEGREE (LOCATION_GEODESY_EARTH_RADIUS * M_PI / 180)
+
+/*
+ * The index is a grid of GRID_DEG by GRID_DEG degree cells, about 1 km
+ * high, each listing the fences overlapping it. Fences covering more than
+ * MAX_CELLS cells are kept in a list of their own and looked at for every
+ * position instead.
+ */
+#define GRID_DEG 0.01
+#define GRID_X 36000
+#define GRID_Y 18000
+#define MAX_CELLS 4096
+
+typedef enum {
+	FENCE_CIRCLE,
+	FENCE_RECTANGLE,
+} FenceShape;
+
+typedef struct {
+	FenceShape shape;
+	gboolean removed;
+	gboolean large;
+
+	/* circle: latitude, longitude, radius; rectangle: s, w, n, e */
+	double a, b, c, d;
+
+	/* covered cells; x1 may be past GRID_X when wrapping around */
+	guint x0, x1, y0, y1;
+
+	gboolean inside;
+	gboolean dwelt;
+	gint64 entered;
+	guint stamp;
+} Fence;
+
+/* a transition found by an update, reported once the update is done */
+typedef struct {
+	guint id;
+	LocationGeofenceTransition transition;
+} Event;
+
+struct _LocationGeofenceSet {
+	gint ref_count;
+	double hysteresis;
+	guint dwell_ms;
+
+	/* of Fence; the fence with id n is at n - 1 */
+	GArray *fences;
+	/* cell key -> GArray of fence indices */
+	GHashTable *cells;
+	/* fence indices */
+	GArray *large;
+	GArray *inside;
+
+	/* marks the fences already looked at during an update */
+	guint stamp;
+};
+
+/* function declarations */
+static guint cell_y(double);
+static guint cell_x(double);
+static gpointer cell_key(guint, guint);
+static double wrap360(double);
+static double depth(const Fence *, double, double, double);
+static void index_fence(LocationGeofenceSet *, guint);
+static void unindex_fence(LocationGeofenceSet *, guint);
+static void remove_value(GArray *, guint);
+static guint add_fence(LocationGeofenceSet *, Fence *);
+static void add_event(GArray **, guint, LocationGeofenceTransition);
+static void check_enter(LocationGeofenceSet *, guint, double, double,
+		gint64, GArray **);
+
+guint cell_y(double latitude)
+{
+	return CLAMP(floor((latitude + 90) / GRID_DEG), 0, GRID_Y - 1);
+}
+
+guint cell_x(double longitude)
+{
+	return (guint)floor(wrap360(longitude + 180) / GRID_DEG) % GRID_X;
+}
+
+gpointer cell_key(guint x, guint y)
+{
+	return GUINT_TO_POINTER(y * GRID_X + (x % GRID_X) + 1);
+}
+
+/* into [0, 360) */
+double wrap360(double deg)
+{
+	deg = fmod(deg, 360);
+	return deg < 0 ? deg + 360 : deg;
+}
+
+/*
+ * How far inside the fence the position is, in meters. Negative values
+ * are distances outside of it. Positions more than margin outside of a
+ * circle may get a cheaper estimate, which is still below -margin.
+ */
+double depth(const Fence *f, double lat, double lon, double margin)
+{
+	double dlon, width, dx, dy, scale;
+
+	if (f->shape == FENCE_CIRCLE) {
+		/* a great circle is never shorter than its latitude span */
+		dy = fabs(lat - f->a) * SPHERE_METERS_PER_DEGREE;
+		if (f->c - dy < -margin)
+			return f->c - dy;
+
+		return f->c - location_geodesy_distance(LOCATION_GEODESY_HAVERSINE,
+				f->a, f->b, lat, lon);
+	}
+
+	scale = METERS_PER_DEGREE * lng_scale(lat);
+
+	dlon = wrap360(lon - f->b);
+	width = wrap360(f->d - f->b);
+	if (dlon <= width)
+		dx = MIN(dlon, width - dlon) * scale;
+	else
+		dx = -MIN(dlon - width, 360 - dlon) * scale;
+
+	dy = MIN(lat - f->a, f->c - lat) * METERS_PER_DEGREE;
+
+	if (dx >= 0 && dy >= 0)
+		return MIN(dx, dy);
+
+	return -hypot(MIN(dx, 0), MIN(dy, 0));
+}
+
+void index_fence(LocationGeofenceSet *set, guint i)
+{
+	Fence *f = &g_array_index(set->fences, Fence, i);
+	GArray *cell;
+	guint x, y;
+
+	if ((guint64)(f->x1 - f->x0 + 1) * (f->y1 - f->y0 + 1) > MAX_CELLS) {
+		f->large = TRUE;
+		g_array_append_val(set->large, i);
+		return;
+	}
+
+	for (y = f->y0; y <= f->y1; y++) {
+		for (x = f->x0; x <= f->x1; x++) {
+			cell = g_hash_table_lookup(set->cells, cell_key(x, y));
+			if (!cell) {
+				cell = g_array_new(FALSE, FALSE, sizeof(guint));
+				g_hash_table_insert(set->cells, cell_key(x, y), cell);
+			}
+			g_array_append_val(cell, i);
+		}
+	}
+}
+
+void unindex_fence(LocationGeofenceSet *set, guint i)
+{
+	Fence *f = &g_array_index(set->fences, Fence, i);
+	GArray *cell;
+	guint x, y;
+
+	if (f->large) {
+		remove_value(set->large, i);
+		return;
+	}
+
+	for (y = f->y0; y <= f->y1; y++) {
+		for (x = f->x0; x <= f->x1; x++) {
+			cell = g_hash_table_lookup(set->cells, cell_key(x, y));
+			if (!cell)
+				continue;
+			remove_value(cell, i);
+			if (!cell->len)
+				g_hash_table_remove(set->cells, cell_key(x, y));
+		}
+	}
+}
+
+void remove_value(GArray *array, guint value)
+{
+	guint i;
+
+	for (i = 0; i < array->len; i++) {
+		if (g_array_index(array, guint, i) == value) {
+			g_array_remove_index_fast(array, i);
+			return;
+		}
+	}
+}
+
+guint add_fence(LocationGeofenceSet *set, Fence *f)
+{
+	g_array_append_val(set->fences, *f);
+	index_fence(set, set->fences->len - 1);
+	return set->fences->len;
+}
+
+LocationGeofenceSet *location_geofence_set_new(double hysteresis,
+		guint dwell_ms)
+{
+	LocationGeofenceSet *set = g_new0(LocationGeofenceSet, 1);
+
+	set->ref_count = 1;
+	set->hysteresis = MAX(hysteresis, 0);
+	set->dwell_ms = dwell_ms;
+	set->fences = g_array_new(FALSE, FALSE, sizeof(Fence));
+	set->cells = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+			NULL, (GDestroyNotify)g_array_unref);
+	set->large = g_array_new(FALSE, FALSE, sizeof(guint));
+	set->inside = g_array_new(FALSE, FALSE, sizeof(guint));
+	return set;
+}
+
+LocationGeofenceSet *location_geofence_set_ref(LocationGeofenceSet *set)
+{
+	g_atomic_int_inc(&set->ref_count);
+	return set;
+}
+
+void location_geofence_set_unref(LocationGeofenceSet *set)
+{
+	if (!g_atomic_int_dec_and_test(&set->ref_count))
+		return;
+
+	g_array_free(set->fences, TRUE);
+	g_hash_table_destroy(set->cells);
+	g_array_free(set->large, TRUE);
+	g_array_free(set->inside, TRUE);
+	g_free(set);
+}
+
+guint location_geofence_set_add_circle(LocationGeofenceSet *set,
+		double latitude, double longitude, double radius)
+{
+	Fence f = { FENCE_CIRCLE };
+	double dlat, dlon, edge;
+
+	f.a = latitude;
+	f.b = longitude;
+	f.c = MAX(radius, 0);
+
+	dlat = f.c / SPHERE_METERS_PER_DEGREE;
+	f.y0 = cell_y(latitude - dlat);
+	f.y1 = cell_y(latitude + dlat);
+
+	/* longitude degrees are shortest on the edge closest to a pole */
+	edge = MIN(fabs(latitude) + dlat, 90);
+	dlon = f.c / (SPHERE_METERS_PER_DEGREE * cos(edge * M_PI / 180));
+
+	if (dlon >= 180 || fabs(latitude) + dlat >= 90) {
+		/* wide enough to go all the way around, or over a pole */
+		f.x0 = 0;
+		f.x1 = GRID_X - 1;
+	} else {
+		f.x0 = cell_x(longitude - dlon);
+		f.x1 = f.x0 + (guint)(2 * dlon / GRID_DEG) + 1;
+		f.x1 = MIN(f.x1, f.x0 + GRID_X - 1);
+	}
+
+	return add_fence(set, &f);
+}
+
+guint location_geofence_set_add_rectangle(LocationGeofenceSet *set,
+		double south, double west, double north, double east)
+{
+	Fence f = { FENCE_RECTANGLE };
+
+	f.a = MIN(south, north);
+	f.b = west;
+	f.c = MAX(south, north);
+	f.d = east;
+
+	f.y0 = cell_y(f.a);
+	f.y1 = cell_y(f.c);
+	f.x0 = cell_x(west);
+	f.x1 = f.x0 + (guint)(wrap360(east - west) / GRID_DEG) + 1;
+	f.x1 = MIN(f.x1, f.x0 + GRID_X - 1);
+
+	return add_fence(set, &f);
+}
+
+gboolean location_geofence_set_remove(LocationGeofenceSet *set, guint id)
+{
+	Fence *f;
+
+	if (!id || id > set->fences->len)
+		return FALSE;
+
+	f = &g_array_index(set->fences, Fence, id - 1);
+	if (f->removed)
+		return FALSE;
+
+	unindex_fence(set, id - 1);
+	if (f->inside)
+		remove_value(set->inside, id - 1);
+
+	f->removed = TRUE;
+	f->inside = FALSE;
+	return TRUE;
+}
+
+/* most updates report nothing, so the array is only made when needed */
+void add_event(GArray **events, guint id,
+		LocationGeofenceTransition transition)
+{
+	Event e = { id, transition };
+
+	if (!*events)
+		*events = g_array_new(FALSE, FALSE, sizeof(Event));
+
+	g_array_append_val(*events, e);
+}
+
+void check_enter(LocationGeofenceSet *set, guint i, double lat, double lon,
+		gint64 time_ms, GArray **events)
+{
+	Fence *f = &g_array_index(set->fences, Fence, i);
+
+	if (f->stamp == set->stamp)
+		return;
+
+	f->stamp = set->stamp;
+
+	if (depth(f, lat, lon, set->hysteresis) < set->hysteresis)
+		return;
+
+	f->inside = TRUE;
+	f->dwelt = FALSE;
+	f->entered = time_ms;
+	g_array_append_val(set->inside, i);
+
+	add_event(events, i + 1, LOCATION_GEOFENCE_ENTER);
+}
+
+guint location_geofence_set_update(LocationGeofenceSet *set,
+		double latitude, double longitude, gint64 time_ms,
+		LocationGeofenceFunc func, gpointer user_data)
+{
+	GArray *cell, *events = NULL;
+	Event *e;
+	Fence *f;
+	guint i, n = 0, inside;
+
+	set->stamp++;
+
+	/* the fences we were in can only be left or dwelt in */
+	for (i = set->inside->len; i-- > 0;) {
+		inside = g_array_index(set->inside, guint, i);
+		f = &g_array_index(set->fences, Fence, inside);
+		f->stamp = set->stamp;
+
+		if (depth(f, latitude, longitude, set->hysteresis) <
+				-set->hysteresis) {
+			f->inside = FALSE;
+			g_array_remove_index_fast(set->inside, i);
+			add_event(&events, inside + 1, LOCATION_GEOFENCE_EXIT);
+		} else if (set->dwell_ms && !f->dwelt
+				&& time_ms - f->entered >= set->dwell_ms) {
+			f->dwelt = TRUE;
+			add_event(&events, inside + 1, LOCATION_GEOFENCE_DWELL);
+		}
+	}
+
+	cell = g_hash_table_lookup(set->cells,
+			cell_key(cell_x(longitude), cell_y(latitude)));
+
+	for (i = 0; cell && i < cell->len; i++)
+		check_enter(set, g_array_index(cell, guint, i),
+				latitude, longitude, time_ms, &events);
+
+	for (i = 0; i < set->large->len; i++)
+		check_enter(set, g_array_index(set->large, guint, i),
+				latitude, longitude, time_ms, &events);
+
+	if (!events)
+		return 0;
+
+	/*
+	 * The set is consistent again, so func may add and remove fences;
+	 * the ones removed by an earlier call are not reported any more.
+	 */
+	for (i = 0; i < events->len; i++) {
+		e = &g_array_index(events, Event, i);
+		if (g_array_index(set->fences, Fence, e->id - 1).removed)
+			continue;
+
+		func(e->id, e->transition, user_data);
+		n++;
+	}
+
+	g_array_free(events, TRUE);
+	return n;
+}
+
+gboolean location_geofence_set_is_inside(LocationGeofenceSet *set, guint id)
+{
+	if (!id || id > set->fences->len)
+		return FALSE;
+
+	return g_array_index(set->fences, Fence, id - 1).inside;
+}
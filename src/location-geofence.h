@@ -0,0 +1,160 @@
+/*
+ * Copyright (c) 2020 Ivan J. <parazyd@dyne.org>
+ *
+ * This file is part of liblocation
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __LOCATION_GEOFENCE_H__
+#define __LOCATION_GEOFENCE_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/**
+ * LocationGeofenceTransition:
+ * @LOCATION_GEOFENCE_ENTER: The position moved into the fence.
+ * @LOCATION_GEOFENCE_EXIT: The position moved out of the fence.
+ * @LOCATION_GEOFENCE_DWELL: The position has stayed inside the fence for
+ * the dwell time of the set.
+ *
+ * The transitions reported for a fence.
+ */
+typedef enum {
+	LOCATION_GEOFENCE_ENTER = 1,
+	LOCATION_GEOFENCE_EXIT = 2,
+	LOCATION_GEOFENCE_DWELL = 4,
+} LocationGeofenceTransition;
+
+/**
+ * LocationGeofenceSet:
+ *
+ * A set of circular and rectangular fences, indexed by a grid so that
+ * checking a position only looks at the fences near it and the ones it
+ * was inside of.
+ */
+typedef struct _LocationGeofenceSet LocationGeofenceSet;
+
+/**
+ * LocationGeofenceFunc:
+ * @id: The fence, as returned when it was added.
+ * @transition: What happened.
+ * @user_data: The data passed to location_geofence_set_update().
+ *
+ * Callback for location_geofence_set_update().
+ */
+typedef void (*LocationGeofenceFunc) (guint id,
+		LocationGeofenceTransition transition,
+		gpointer user_data);
+
+/**
+ * location_geofence_set_new:
+ * @hysteresis: Margin in meters. A position has to be this far inside a
+ * fence to enter it and this far outside to exit it, so that noise on a
+ * fence boundary does not produce a stream of transitions.
+ * @dwell_ms: Time in milliseconds inside a fence before
+ * #LOCATION_GEOFENCE_DWELL is reported, 0 to never report it.
+ *
+ * Returns: A new, empty set with a reference count of 1.
+ */
+LocationGeofenceSet *location_geofence_set_new (double hysteresis,
+		guint dwell_ms);
+
+LocationGeofenceSet *location_geofence_set_ref (LocationGeofenceSet *set);
+void location_geofence_set_unref (LocationGeofenceSet *set);
+
+/**
+ * location_geofence_set_add_circle:
+ * @set: The set.
+ * @latitude: Latitude of the center (degrees).
+ * @longitude: Longitude of the center (degrees).
+ * @radius: Radius in meters, measured along great circles.
+ *
+ * Returns: The id of the new fence, never 0.
+ */
+guint location_geofence_set_add_circle (LocationGeofenceSet *set,
+		double latitude,
+		double longitude,
+		double radius);
+
+/**
+ * location_geofence_set_add_rectangle:
+ * @set: The set.
+ * @south: Southern edge (degrees).
+ * @west: Western edge (degrees). May be greater than @east for a fence
+ * crossing the 180th meridian.
+ * @north: Northern edge (degrees).
+ * @east: Eastern edge (degrees).
+ *
+ * Returns: The id of the new fence, never 0.
+ */
+guint location_geofence_set_add_rectangle (LocationGeofenceSet *set,
+		double south,
+		double west,
+		double north,
+		double east);
+
+/**
+ * location_geofence_set_remove:
+ * @set: The set.
+ * @id: The fence to remove.
+ *
+ * Removes a fence. No transition is reported for it, even if the last
+ * position was inside.
+ *
+ * Returns: %TRUE if the fence was in the set.
+ */
+gboolean location_geofence_set_remove (LocationGeofenceSet *set, guint id);
+
+/**
+ * location_geofence_set_update:
+ * @set: The set.
+ * @latitude: The current latitude (degrees).
+ * @longitude: The current longitude (degrees).
+ * @time_ms: The current time in milliseconds, on any monotonic clock.
+ * @func: Called for every transition.
+ * @user_data: Data passed to @func.
+ *
+ * Checks a new position against the fences and reports what changed
+ * since the previous one. Only the fences in the grid cell of the
+ * position, the ones it was inside of and very large fences are looked
+ * at, so the cost does not grow with the size of the set.
+ *
+ * @func is called once the set has been updated, so it may add and remove
+ * fences, its own included.
+ *
+ * Returns: The number of transitions reported.
+ */
+guint location_geofence_set_update (LocationGeofenceSet *set,
+		double latitude,
+		double longitude,
+		gint64 time_ms,
+		LocationGeofenceFunc func,
+		gpointer user_data);
+
+/**
+ * location_geofence_set_is_inside:
+ * @set: The set.
+ * @id: The fence.
+ *
+ * Returns: Whether the last position given to the set was inside @id.
+ */
+gboolean location_geofence_set_is_inside (LocationGeofenceSet *set,
+		guint id);
+
+G_END_DECLS
+
+#endif
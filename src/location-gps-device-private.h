@@ -0,0 +1,122 @@
+/*
+ * Copyright (c) 2020 Ivan J. <parazyd@dyne.org>
+ *
+ * This file is part of liblocation
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __LOCATION_GPS_DEVICE_PRIVATE_H__
+#define __LOCATION_GPS_DEVICE_PRIVATE_H__
+
+#include <glib.h>
+
+#include "location-gps-device.h"
+
+G_BEGIN_DECLS
+
+/*
+ * Internal to liblocation, not installed. Lets the trace recorder and
+ * player get at the signal stream and the timing of a device.
+ */
+
+/*
+ * A location-daemon signal, decoded once on the shared connection and then
+ * applied to every device.
+ */
+typedef enum {
+	DAEMON_SIGNAL_TIME,
+	DAEMON_SIGNAL_POSITION,
+	DAEMON_SIGNAL_COURSE,
+	DAEMON_SIGNAL_ACCURACY,
+	DAEMON_SIGNAL_FIX_STATUS,
+	DAEMON_SIGNAL_SATELLITES,
+} DaemonSignalType;
+
+typedef struct {
+	DaemonSignalType type;
+	union {
+		double time;
+		struct {
+			double latitude;
+			double longitude;
+			double altitude;
+		} position;
+		struct {
+			double speed;
+			double track;
+			double climb;
+		} course;
+		struct {
+			double ept;
+			double epv;
+			double epd;
+			double eps;
+			double epc;
+			double eph;
+		} accuracy;
+		guint8 mode;
+		/* of LocationGPSDeviceSatellite, owned by whoever decoded it */
+		GArray *satellites;
+	};
+} DaemonSignal;
+
+/*
+ * Called for every signal received from location-daemon, on the thread of
+ * the connection it came in on, before it is applied to the devices.
+ */
+typedef void (*DaemonSignalTap) (const DaemonSignal *sig, gpointer user_data);
+
+void location_gps_device_add_tap (DaemonSignalTap func, gpointer user_data);
+void location_gps_device_remove_tap (DaemonSignalTap func, gpointer user_data);
+
+/* feeds @sig to @device as if it came from location-daemon */
+void location_gps_device_apply_signal (LocationGPSDevice *device,
+		const DaemonSignal *sig);
+
+/* the context the device runs on, never NULL */
+GMainContext *location_gps_device_get_context (LocationGPSDevice *device);
+
+/*
+ * A clock that only moves when told to. A device given one takes its time
+ * from it and puts its timeouts on it instead of its main context, which
+ * makes its behaviour independent of how fast the signals are fed.
+ */
+typedef struct {
+	gint64 now;		/* microseconds, never 0 */
+	GArray *timers;
+	guint last_id;
+} LocationVirtualClock;
+
+LocationVirtualClock *location_virtual_clock_new (gint64 now);
+void location_virtual_clock_free (LocationVirtualClock *clock);
+guint location_virtual_clock_add (LocationVirtualClock *clock,
+		guint ms,
+		GSourceFunc func,
+		gpointer data);
+void location_virtual_clock_remove (LocationVirtualClock *clock, guint id);
+gint64 location_virtual_clock_next_due (LocationVirtualClock *clock);
+void location_virtual_clock_advance (LocationVirtualClock *clock,
+		gint64 to);
+
+/*
+ * NULL goes back to the real clock. Fails, leaving the clock alone, while
+ * the device has timeouts pending on the current one.
+ */
+gboolean location_gps_device_set_clock (LocationGPSDevice *device,
+		LocationVirtualClock *clock);
+
+G_END_DECLS
+
+#endif
@@ -17,15 +17,33 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <fcntl.h>
 #include <math.h>
 #include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <time.h>
+#include <unistd.h>
 
 #include <dbus/dbus-glib-lowlevel.h>
 #include <gconf/gconf-client.h>
 #include <glib.h>
 
 #include "location-gps-device.h"
+#include "location-gps-device-private.h"
+#include "location-geofence.h"
+#include "location-kalman.h"
+
+#define LOCATION_DAEMON_SERVICE "org.maemo.LocationDaemon"
+
+/*
+ * All the interfaces we listen to are only ever emitted by location-daemon,
+ * so a single rule bound to its bus name covers them. The bus daemon
+ * resolves the well-known name to its current owner when routing.
+ */
+#define LOCATION_DAEMON_MATCH \
+	"type='signal',sender='"LOCATION_DAEMON_SERVICE"'"
 
 #define GC_LK       "/system/nokia/location/lastknown"
 #define GC_LK_TIME  GC_LK"/time"
@@ -36,41 +54,280 @@
 #define GC_LK_SPD   GC_LK"/speed"
 #define GC_LK_CLB   GC_LK"/climb"
 
+/* minimum time (s) between two periodic last known checkpoints */
+#define LASTKNOWN_CHECKPOINT 30
+
+/* last known cache, relative to the user runtime directory */
+#define LASTKNOWN_FILE    "liblocation-lastknown"
+#define LASTKNOWN_MAGIC   0x464b4c4c /* "LLKF" */
+#define LASTKNOWN_VERSION 1
+
 #define TSTONS(ts) ((double)((ts).tv_sec + ((ts).tv_nsec / 1e9)))
 
+/*
+ * location-daemon sends the signals making up one epoch back to back, so
+ * updates arriving within this window (ms) are folded into one "changed".
+ * Receivers running faster than 25 Hz get a window of half their epoch
+ * period instead, so consecutive epochs are never merged.
+ */
+#define EPOCH_WINDOW 20
+
+/* satellite records are allocated this many at a time */
+#define SATELLITE_SLAB 16
+
+/* upper bound of the "history-length" property */
+#define HISTORY_MAX 65536
+
+/*
+ * Units. location-daemon passes on what gpsd reports: speed, eps, climb
+ * and epc in m/s, epv in m, and eph already in cm. The fix gives speed
+ * and eps in km/h, so set_course() and set_accuracy() convert those two;
+ * everything else is stored as received. The filter works in m and m/s.
+ */
+#define CM_PER_M   100.0
+#define KMH_PER_MS 3.6
+
+/* devices a signal is dispatched to without allocating the list */
+#define DISPATCH_LOCAL 16
+
+typedef enum {
+	HISTORY_LENGTH = 1,
+	MAINCONTEXT,
+	SMOOTHING,
+	LAST_PROP
+} DeviceClassProperty;
+
 enum {
 	DEVICE_CHANGED,
 	DEVICE_CONNECTED,
 	DEVICE_DISCONNECTED,
+	DEVICE_CHANGED_FIELDS,
+	DEVICE_GEOFENCE,
 	LAST_SIGNAL
 };
 
 static guint signals[LAST_SIGNAL] = {};
+static GParamSpec *obj_properties[LAST_PROP] = {};
+
+/*
+ * One system bus connection is shared by all the devices in the process
+ * running on the same GMainContext. Its filter parses every location-daemon
+ * signal once, on that context, and fans the result out to the registered
+ * devices.
+ */
+typedef struct {
+	GMainContext *ctx;
+	DBusConnection *bus;
+	GPtrArray *devices;
+	GArray *satellites;
+} SharedBus;
+
+/* GMainContext -> SharedBus, guarded by the shared_buses lock */
+static GHashTable *shared_buses = NULL;
+G_LOCK_DEFINE_STATIC(shared_buses);
+
+typedef struct {
+	DaemonSignalTap func;
+	gpointer user_data;
+} Tap;
+
+/* of Tap, guarded by the taps lock; n_taps lets the fast path skip it */
+static GArray *taps = NULL;
+static gint n_taps = 0;
+G_LOCK_DEFINE_STATIC(taps);
+
+/*
+ * On-disk layout of the last known cache. The file is replaced atomically
+ * on every write, so a reader mapping it always sees a complete record.
+ * Bump LASTKNOWN_VERSION on any layout change; readers ignore other
+ * versions and fall back to GConf.
+ */
+typedef struct {
+	guint32 magic;
+	guint32 version;
+	guint32 fields;
+	guint32 reserved;
+	double time;
+	double latitude;
+	double longitude;
+	double altitude;
+	double track;
+	double speed;
+	double climb;
+} LastKnownRecord;
+
+/*
+ * Last known fix, shared by all devices and guarded by the lastknown lock.
+ * The thread storing a checkpoint writes the runtime cache itself, as that
+ * is one small file and needs no main loop. The GConf commit happens from
+ * a low priority source on the default main context, as GConf must not be
+ * used from several threads.
+ */
+static LocationGPSDeviceFix lastknown_fix;
+static guint64 lastknown_seq = 0;
+static guint lastknown_id = 0;
+static gint64 lastknown_written = 0;
+G_LOCK_DEFINE_STATIC(lastknown);
+
+/* the checkpoint last written to the cache, guarded by lastknown_cache */
+static guint64 lastknown_cached = 0;
+G_LOCK_DEFINE_STATIC(lastknown_cache);
+
+typedef dbus_bool_t (*DaemonSignalParser)(SharedBus *, DBusMessage *, DaemonSignal *);
+
+typedef struct {
+	const char *interface;
+	const char *member;
+	DaemonSignalType type;
+	DaemonSignalParser parse;
+} DaemonSignalHandler;
+
+/*
+ * Every location-daemon interface carries exactly one signal we care
+ * about, so the dispatch table is keyed on the interface alone and the
+ * member is checked after the lookup.
+ */
+static GHashTable *signal_handlers = NULL;
 
 struct _LocationGPSDevicePrivate
 {
-	DBusConnection *bus;
+	GMainContext *ctx;
+	SharedBus *shared;
 	struct timespec t;
 	gint interval;
-	gboolean sig_pending;
+	guint epoch_id;
+	guint changed_id;
+	gint64 last_changed;
+
+	/* replaces the monotonic clock and the main context when set */
+	LocationVirtualClock *clock;
+
+	/*
+	 * LOCATION_GPS_DEVICE_CHANGED_* bits collected since the last
+	 * "changed", and the ones delivered with the emission in progress.
+	 */
+	guint changed_pending;
+	guint changed_fields;
+
+	/* what the updates of the current epoch changed */
+	guint epoch_fields;
+
+	/* start of the latest epoch and running mean of the period (us) */
+	gint64 epoch_start;
+	gint64 epoch_period;
+
+	/*
+	 * Fixes waiting to be handed to batch_func, which gets them once
+	 * batch_max have been collected or batch_ms after the first one.
+	 */
+	LocationGPSDeviceFix *batch;
+	guint batch_len;
+	guint batch_max;
+	guint batch_ms;
+	guint batch_id;
+	LocationGPSDeviceBatchFunc batch_func;
+	gpointer batch_data;
+	GDestroyNotify batch_notify;
+
+	/* checked against the position at the end of each epoch */
+	LocationGeofenceSet *geofences;
+
+	/*
+	 * Filters the fix at the end of each epoch when smoothing is on.
+	 * The fix then carries the filter's sigmas, so the ones received
+	 * from location-daemon are kept here as its input.
+	 */
+	gboolean smoothing;
+	LocationKalman kalman;
+	double raw_eph;
+	double raw_epv;
+
+	/*
+	 * device->satellites points at sat_view while there is satellite
+	 * data. Its records come from slabs of SATELLITE_SLAB entries which
+	 * are reused in place by every update and only added to when a
+	 * bigger sky view comes in.
+	 */
+	GPtrArray *sat_view;
+	GPtrArray *sat_slabs;
+
+	/*
+	 * Ring of the last history_len epochs, allocated once at
+	 * construction. The epoch with sequence number n lives in slot
+	 * (n - 1) % history_len; sequence is the number of the latest one.
+	 */
+	LocationGPSDeviceFix *history;
+	guint history_len;
+	guint64 sequence;
+
+	/*
+	 * Copy of the public state as of the latest epoch, published under
+	 * a seqlock: snapshot_seq is odd while the copy is being written.
+	 * Writers come from the epoch path, from reset_last_known() and
+	 * from init, possibly on different threads, and are serialised by
+	 * snapshot_lock. Readers never take it.
+	 */
+	GMutex snapshot_lock;
+	gint snapshot_seq;
+	LocationGPSDeviceSnapshot snapshot;
 };
 
 G_DEFINE_TYPE_WITH_PRIVATE(LocationGPSDevice, location_gps_device, G_TYPE_OBJECT);
 
 /* function declarations */
 static int gconf_get_float(GConfClient *, double *, const gchar *);
-static GPtrArray *free_satellites(LocationGPSDevice *);
+static void clear_satellites(LocationGPSDevice *);
+static LocationGPSDeviceSatellite *get_satellite_record(LocationGPSDevicePrivate *, guint);
 static int signal_changed(LocationGPSDevice *);
-static void add_g_timeout_interval(LocationGPSDevice *);
-static dbus_bool_t set_fix_status(LocationGPSDevice *, DBusMessage *);
-static dbus_bool_t set_time(LocationGPSDevice *, DBusMessage *);
-static dbus_bool_t set_position(LocationGPSDevice *, DBusMessage *);
-static dbus_bool_t set_accuracy(LocationGPSDevice *, DBusMessage *);
-static dbus_bool_t set_course(LocationGPSDevice *, DBusMessage *);
-static dbus_bool_t set_satellites(LocationGPSDevice *, DBusMessage *);
-static int on_locationdaemon_signal(int, DBusMessage *, gpointer);
+static int epoch_complete(LocationGPSDevice *);
+static void schedule_changed(LocationGPSDevice *);
+static guint epoch_window(LocationGPSDevicePrivate *);
+static void mark_changed(LocationGPSDevice *, guint);
+static gboolean same_value(double, double);
+static gboolean same_satellite(const LocationGPSDeviceSatellite *,
+		const LocationGPSDeviceSatellite *);
+static guint add_timeout(LocationGPSDevice *, guint, GSourceFunc);
+static void remove_timeout(LocationGPSDevice *, guint);
+static void batch_append(LocationGPSDevice *);
+static int batch_timeout(LocationGPSDevice *);
+static void clear_batch(LocationGPSDevice *);
+static void signal_geofence(guint, LocationGeofenceTransition, gpointer);
+static gint64 device_now(LocationGPSDevicePrivate *);
+static void run_taps(const DaemonSignal *);
+static void history_append(LocationGPSDevice *);
+static void publish_snapshot(LocationGPSDevice *);
+static void smooth_fix(LocationGPSDevice *);
+static double fix_time(const LocationGPSDeviceFix *);
+static gchar *lastknown_path(void);
+static gboolean load_lastknown_cache(LocationGPSDeviceFix *);
+static gboolean load_lastknown_gconf(LocationGPSDeviceFix *);
+static void store_lastknown_cache(const LocationGPSDeviceFix *);
+static void store_lastknown_gconf(const LocationGPSDeviceFix *);
+static void cache_lastknown(const LocationGPSDeviceFix *, guint64);
+static gboolean write_lastknown(gpointer);
+static void checkpoint_lastknown(const LocationGPSDeviceFix *, gboolean);
+static void set_fix_status(LocationGPSDevice *, const DaemonSignal *);
+static void set_time(LocationGPSDevice *, const DaemonSignal *);
+static void set_position(LocationGPSDevice *, const DaemonSignal *);
+static void set_accuracy(LocationGPSDevice *, const DaemonSignal *);
+static void set_course(LocationGPSDevice *, const DaemonSignal *);
+static void set_satellites(LocationGPSDevice *, const DaemonSignal *);
+static void apply_signal(LocationGPSDevice *, const DaemonSignal *);
+static dbus_bool_t parse_time(SharedBus *, DBusMessage *, DaemonSignal *);
+static dbus_bool_t parse_position(SharedBus *, DBusMessage *, DaemonSignal *);
+static dbus_bool_t parse_course(SharedBus *, DBusMessage *, DaemonSignal *);
+static dbus_bool_t parse_accuracy(SharedBus *, DBusMessage *, DaemonSignal *);
+static dbus_bool_t parse_fix_status(SharedBus *, DBusMessage *, DaemonSignal *);
+static dbus_bool_t parse_satellites(SharedBus *, DBusMessage *, DaemonSignal *);
+static const DaemonSignalHandler *lookup_signal_handler(DBusMessage *);
+static DBusHandlerResult on_locationdaemon_signal(DBusConnection *, DBusMessage *, void *);
+static void shared_bus_add_device(LocationGPSDevice *);
+static void shared_bus_remove_device(LocationGPSDevice *);
 static void location_gps_device_finalize(GObject *);
+static void location_gps_device_constructed(GObject *);
 static void location_gps_device_dispose(GObject *);
+static void location_gps_device_set_property(GObject *, guint, const GValue *, GParamSpec *);
+static void location_gps_device_get_property(GObject *, guint, GValue *, GParamSpec *);
 static void location_gps_device_class_init(LocationGPSDeviceClass *);
 static void location_gps_device_init(LocationGPSDevice *);
 
@@ -92,377 +349,1454 @@ int gconf_get_float(GConfClient *client, double *dest, const gchar *key)
 	return ret;
 }
 
-GPtrArray *free_satellites(LocationGPSDevice *device)
+void clear_satellites(LocationGPSDevice *device)
+{
+	device->satellites = NULL;
+	device->satellites_in_view = 0;
+	device->satellites_in_use = 0;
+}
+
+LocationGPSDeviceSatellite *get_satellite_record(LocationGPSDevicePrivate *p,
+		guint i)
+{
+	LocationGPSDeviceSatellite *slab;
+
+	while (i / SATELLITE_SLAB >= p->sat_slabs->len)
+		g_ptr_array_add(p->sat_slabs,
+				g_new(LocationGPSDeviceSatellite, SATELLITE_SLAB));
+
+	slab = g_ptr_array_index(p->sat_slabs, i / SATELLITE_SLAB);
+	return &slab[i % SATELLITE_SLAB];
+}
+
+dbus_bool_t parse_time(SharedBus *shared, DBusMessage *msg, DaemonSignal *sig)
+{
+	struct timespec t;
+
+	if (!dbus_message_get_args(msg, NULL,
+			DBUS_TYPE_INT64, &t.tv_sec,
+			DBUS_TYPE_INT64, &t.tv_nsec,
+			DBUS_TYPE_INVALID))
+		return FALSE;
+
+	sig->time = TSTONS(t);
+	return TRUE;
+}
+
+dbus_bool_t parse_position(SharedBus *shared, DBusMessage *msg,
+		DaemonSignal *sig)
+{
+	return dbus_message_get_args(msg, NULL,
+			DBUS_TYPE_DOUBLE, &sig->position.latitude,
+			DBUS_TYPE_DOUBLE, &sig->position.longitude,
+			DBUS_TYPE_DOUBLE, &sig->position.altitude,
+			DBUS_TYPE_INVALID);
+}
+
+dbus_bool_t parse_course(SharedBus *shared, DBusMessage *msg, DaemonSignal *sig)
+{
+	return dbus_message_get_args(msg, NULL,
+			DBUS_TYPE_DOUBLE, &sig->course.speed,
+			DBUS_TYPE_DOUBLE, &sig->course.track,
+			DBUS_TYPE_DOUBLE, &sig->course.climb,
+			DBUS_TYPE_INVALID);
+}
+
+dbus_bool_t parse_accuracy(SharedBus *shared, DBusMessage *msg,
+		DaemonSignal *sig)
+{
+	return dbus_message_get_args(msg, NULL,
+			DBUS_TYPE_DOUBLE, &sig->accuracy.ept,
+			DBUS_TYPE_DOUBLE, &sig->accuracy.epv,
+			DBUS_TYPE_DOUBLE, &sig->accuracy.epd,
+			DBUS_TYPE_DOUBLE, &sig->accuracy.eps,
+			DBUS_TYPE_DOUBLE, &sig->accuracy.epc,
+			DBUS_TYPE_DOUBLE, &sig->accuracy.eph,
+			DBUS_TYPE_INVALID);
+}
+
+dbus_bool_t parse_fix_status(SharedBus *shared, DBusMessage *msg,
+		DaemonSignal *sig)
+{
+	return dbus_message_get_args(msg, NULL,
+			DBUS_TYPE_BYTE, &sig->mode,
+			DBUS_TYPE_INVALID);
+}
+
+dbus_bool_t parse_satellites(SharedBus *shared, DBusMessage *msg,
+		DaemonSignal *sig)
+{
+	GArray *sats = shared->satellites;
+	LocationGPSDeviceSatellite *sat;
+	DBusMessageIter iter, arr, st;
+
+	g_array_set_size(sats, 0);
+	sig->satellites = sats;
+
+	dbus_message_iter_init(msg, &iter);
+
+	if (dbus_message_iter_get_arg_type(&iter) != DBUS_TYPE_ARRAY)
+		return FALSE;
+
+	dbus_message_iter_recurse(&iter, &arr);
+
+	while (dbus_message_iter_get_arg_type(&arr) != DBUS_TYPE_INVALID) {
+		g_array_set_size(sats, sats->len + 1);
+		sat = &g_array_index(sats, LocationGPSDeviceSatellite, sats->len - 1);
+
+		dbus_message_iter_recurse(&arr, &st);
+
+		dbus_message_iter_get_basic(&st, &sat->prn);
+		dbus_message_iter_next(&st);
+
+		dbus_message_iter_get_basic(&st, &sat->elevation);
+		dbus_message_iter_next(&st);
+
+		dbus_message_iter_get_basic(&st, &sat->azimuth);
+		dbus_message_iter_next(&st);
+
+		dbus_message_iter_get_basic(&st, &sat->signal_strength);
+		dbus_message_iter_next(&st);
+
+		dbus_message_iter_get_basic(&st, &sat->in_use);
+		dbus_message_iter_next(&st);
+
+		dbus_message_iter_next(&arr);
+	}
+
+	return TRUE;
+}
+
+const DaemonSignalHandler *lookup_signal_handler(DBusMessage *msg)
+{
+	static const DaemonSignalHandler handlers[] = {
+		{ "org.maemo.LocationDaemon.Time", "TimeChanged",
+			DAEMON_SIGNAL_TIME, parse_time },
+		{ "org.maemo.LocationDaemon.Position", "PositionChanged",
+			DAEMON_SIGNAL_POSITION, parse_position },
+		{ "org.maemo.LocationDaemon.Course", "CourseChanged",
+			DAEMON_SIGNAL_COURSE, parse_course },
+		{ "org.maemo.LocationDaemon.Accuracy", "AccuracyChanged",
+			DAEMON_SIGNAL_ACCURACY, parse_accuracy },
+		{ "org.maemo.LocationDaemon.Device", "FixStatusChanged",
+			DAEMON_SIGNAL_FIX_STATUS, parse_fix_status },
+		{ "org.maemo.LocationDaemon.Satellite", "SatellitesChanged",
+			DAEMON_SIGNAL_SATELLITES, parse_satellites },
+	};
+	const DaemonSignalHandler *handler;
+	const char *interface, *member;
+	guint i;
+
+	if (g_once_init_enter(&signal_handlers)) {
+		GHashTable *table = g_hash_table_new(g_str_hash, g_str_equal);
+
+		for (i = 0; i < G_N_ELEMENTS(handlers); i++)
+			g_hash_table_insert(table, (gpointer)handlers[i].interface,
+					(gpointer)&handlers[i]);
+
+		g_once_init_leave(&signal_handlers, table);
+	}
+
+	if (dbus_message_get_type(msg) != DBUS_MESSAGE_TYPE_SIGNAL)
+		return NULL;
+
+	interface = dbus_message_get_interface(msg);
+	member = dbus_message_get_member(msg);
+	if (!interface || !member)
+		return NULL;
+
+	handler = g_hash_table_lookup(signal_handlers, interface);
+	if (!handler || strcmp(member, handler->member))
+		return NULL;
+
+	return handler;
+}
+
+void set_satellites(LocationGPSDevice *device, const DaemonSignal *sig)
+{
+	LocationGPSDevicePrivate *p;
+	LocationGPSDeviceSatellite *sat, *new;
+	guint i, old_len;
+	gboolean changed;
+
+	p = location_gps_device_get_instance_private(device);
+
+	/* the slabs still hold the previous view while it is overwritten */
+	old_len = device->satellites ? p->sat_view->len : 0;
+	changed = sig->satellites->len != old_len;
+
+	clear_satellites(device);
+	g_ptr_array_set_size(p->sat_view, 0);
+
+	for (i = 0; i < sig->satellites->len; i++) {
+		sat = get_satellite_record(p, i);
+		new = &g_array_index(sig->satellites, LocationGPSDeviceSatellite, i);
+		if (!changed && !same_satellite(sat, new))
+			changed = TRUE;
+		*sat = *new;
+
+		g_ptr_array_add(p->sat_view, sat);
+		++device->satellites_in_view;
+		if (sat->in_use)
+			++device->satellites_in_use;
+	}
+
+	device->satellites = p->sat_view;
+
+	mark_changed(device, changed ? LOCATION_GPS_DEVICE_CHANGED_SATELLITES : 0);
+}
+
+/* like ==, but NaN (not known) equals NaN */
+gboolean same_value(double a, double b)
+{
+	return a == b || (isnan(a) && isnan(b));
+}
+
+gboolean same_satellite(const LocationGPSDeviceSatellite *a,
+		const LocationGPSDeviceSatellite *b)
+{
+	return a->prn == b->prn
+		&& a->elevation == b->elevation
+		&& a->azimuth == b->azimuth
+		&& a->signal_strength == b->signal_strength
+		&& !a->in_use == !b->in_use;
+}
+
+void set_time(LocationGPSDevice *device, const DaemonSignal *sig)
+{
+	LocationGPSDeviceFix *fix = device->fix;
+	guint changed = 0;
+
+	if (!(fix->fields & LOCATION_GPS_DEVICE_TIME_SET) || fix->time != sig->time)
+		changed = LOCATION_GPS_DEVICE_CHANGED_TIME;
+
+	fix->time = sig->time;
+	fix->fields |= LOCATION_GPS_DEVICE_TIME_SET;
+
+	mark_changed(device, changed);
+}
+
+void set_course(LocationGPSDevice *device, const DaemonSignal *sig)
+{
+	LocationGPSDeviceFix *fix = device->fix;
+	double speed = sig->course.speed;
+	double track = sig->course.track;
+	double climb = sig->course.climb;
+	guint32 fields = fix->fields;
+	guint changed = 0;
+
+	/* gpsd and location-daemon give us m/s, but we will give km/h */
+	speed *= KMH_PER_MS;
+
+	if (isfinite(speed)) {
+		if (!(fields & LOCATION_GPS_DEVICE_SPEED_SET) || fix->speed != speed)
+			changed = LOCATION_GPS_DEVICE_CHANGED_COURSE;
+		fix->fields |= LOCATION_GPS_DEVICE_SPEED_SET;
+		fix->speed = speed;
+	}
+
+	if (isfinite(track)) {
+		if (!(fields & LOCATION_GPS_DEVICE_TRACK_SET) || fix->track != track)
+			changed = LOCATION_GPS_DEVICE_CHANGED_COURSE;
+		fix->fields |= LOCATION_GPS_DEVICE_TRACK_SET;
+		fix->track = track;
+	}
+
+	if (isfinite(climb)) {
+		if (!(fields & LOCATION_GPS_DEVICE_CLIMB_SET) || fix->climb != climb)
+			changed = LOCATION_GPS_DEVICE_CHANGED_COURSE;
+		fix->fields |= LOCATION_GPS_DEVICE_CLIMB_SET;
+		fix->climb = climb;
+	}
+
+	mark_changed(device, changed);
+}
+
+void set_fix_status(LocationGPSDevice *device, const DaemonSignal *sig)
+{
+	guint changed = 0;
+
+	if (device->fix->mode != sig->mode)
+		changed = LOCATION_GPS_DEVICE_CHANGED_MODE;
+
+	device->fix->mode = sig->mode;
+	mark_changed(device, changed);
+}
+
+void set_position(LocationGPSDevice *device, const DaemonSignal *sig)
+{
+	LocationGPSDeviceFix *fix = device->fix;
+	double latitude = sig->position.latitude;
+	double longitude = sig->position.longitude;
+	double altitude = sig->position.altitude;
+	LocationGPSDeviceMode mode;
+	guint32 fields = fix->fields;
+	guint changed = 0;
+
+	if (isfinite(latitude) && isfinite(longitude)) {
+		if (!(fields & LOCATION_GPS_DEVICE_LATLONG_SET)
+				|| fix->latitude != latitude
+				|| fix->longitude != longitude)
+			changed |= LOCATION_GPS_DEVICE_CHANGED_POSITION;
+		fix->latitude = latitude;
+		fix->longitude = longitude;
+		fix->fields |= LOCATION_GPS_DEVICE_LATLONG_SET;
+	} else {
+		if (fields & LOCATION_GPS_DEVICE_LATLONG_SET)
+			changed |= LOCATION_GPS_DEVICE_CHANGED_POSITION;
+		fix->fields &= ~LOCATION_GPS_DEVICE_LATLONG_SET;
+	}
+
+	if (isfinite(altitude)) {
+		if (!(fields & LOCATION_GPS_DEVICE_ALTITUDE_SET)
+				|| fix->altitude != altitude)
+			changed |= LOCATION_GPS_DEVICE_CHANGED_ALTITUDE;
+		fix->altitude = altitude;
+		fix->fields |= LOCATION_GPS_DEVICE_ALTITUDE_SET;
+	} else {
+		if (fields & LOCATION_GPS_DEVICE_ALTITUDE_SET)
+			changed |= LOCATION_GPS_DEVICE_CHANGED_ALTITUDE;
+		fix->fields &= ~LOCATION_GPS_DEVICE_ALTITUDE_SET;
+	}
+
+	if (isfinite(latitude) && isfinite(longitude) && isfinite(altitude))
+		mode = LOCATION_GPS_DEVICE_MODE_3D;
+	else if (isfinite(latitude) && isfinite(longitude))
+		mode = LOCATION_GPS_DEVICE_MODE_2D;
+	else
+		mode = LOCATION_GPS_DEVICE_MODE_NO_FIX;
+
+	if (fix->mode != mode)
+		changed |= LOCATION_GPS_DEVICE_CHANGED_MODE;
+	fix->mode = mode;
+
+	mark_changed(device, changed);
+}
+
+void set_accuracy(LocationGPSDevice *device, const DaemonSignal *sig)
+{
+	LocationGPSDevicePrivate *p;
+	LocationGPSDeviceFix *fix = device->fix;
+	LocationGPSDeviceFix old = *fix;
+
+	p = location_gps_device_get_instance_private(device);
+
+	if (isfinite(sig->accuracy.ept))
+		fix->ept = sig->accuracy.ept;
+
+	if (isfinite(sig->accuracy.epv))
+		fix->epv = p->raw_epv = sig->accuracy.epv;
+
+	if (isfinite(sig->accuracy.epd))
+		fix->epd = sig->accuracy.epd;
+
+	if (isfinite(sig->accuracy.eps))
+		fix->eps = sig->accuracy.eps * KMH_PER_MS;
+
+	if (isfinite(sig->accuracy.epc))
+		fix->epc = sig->accuracy.epc;
+
+	if (isfinite(sig->accuracy.eph))
+		fix->eph = p->raw_eph = sig->accuracy.eph;
+
+	if (!same_value(fix->ept, old.ept) || !same_value(fix->epv, old.epv)
+			|| !same_value(fix->epd, old.epd)
+			|| !same_value(fix->eps, old.eps)
+			|| !same_value(fix->epc, old.epc)
+			|| !same_value(fix->eph, old.eph))
+		mark_changed(device, LOCATION_GPS_DEVICE_CHANGED_ACCURACY);
+	else
+		mark_changed(device, 0);
+}
+
+gchar *lastknown_path(void)
+{
+	return g_build_filename(g_get_user_runtime_dir(), LASTKNOWN_FILE, NULL);
+}
+
+gboolean load_lastknown_cache(LocationGPSDeviceFix *fix)
+{
+	const LastKnownRecord *rec;
+	struct stat st;
+	gchar *path;
+	void *map;
+	int fd;
+
+	path = lastknown_path();
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	g_free(path);
+
+	if (fd < 0)
+		return FALSE;
+
+	if (fstat(fd, &st) || st.st_size < (off_t)sizeof(LastKnownRecord)) {
+		close(fd);
+		return FALSE;
+	}
+
+	map = mmap(NULL, sizeof(LastKnownRecord), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (map == MAP_FAILED)
+		return FALSE;
+
+	rec = map;
+	if (rec->magic != LASTKNOWN_MAGIC || rec->version != LASTKNOWN_VERSION) {
+		munmap(map, sizeof(LastKnownRecord));
+		return FALSE;
+	}
+
+	fix->fields |= rec->fields & (LOCATION_GPS_DEVICE_TIME_SET
+			| LOCATION_GPS_DEVICE_LATLONG_SET
+			| LOCATION_GPS_DEVICE_ALTITUDE_SET
+			| LOCATION_GPS_DEVICE_TRACK_SET
+			| LOCATION_GPS_DEVICE_SPEED_SET
+			| LOCATION_GPS_DEVICE_CLIMB_SET);
+	fix->time = rec->time;
+	fix->latitude = rec->latitude;
+	fix->longitude = rec->longitude;
+	fix->altitude = rec->altitude;
+	fix->track = rec->track;
+	fix->speed = rec->speed;
+	fix->climb = rec->climb;
+
+	munmap(map, sizeof(LastKnownRecord));
+	return TRUE;
+}
+
+gboolean load_lastknown_gconf(LocationGPSDeviceFix *fix)
+{
+	GConfClient *client;
+
+	client = gconf_client_get_default();
+	if (!client)
+		return FALSE;
+
+	if (gconf_get_float(client, &fix->time, GC_LK_TIME))
+		fix->fields |= LOCATION_GPS_DEVICE_TIME_SET;
+	else
+		fix->time = LOCATION_GPS_DEVICE_NAN;
+
+	if (gconf_get_float(client, &fix->latitude, GC_LK_LAT)
+			&& gconf_get_float(client, &fix->longitude, GC_LK_LON)) {
+		fix->fields |= LOCATION_GPS_DEVICE_LATLONG_SET;
+	} else {
+		fix->latitude = LOCATION_GPS_DEVICE_NAN;
+		fix->longitude = LOCATION_GPS_DEVICE_NAN;
+	}
+
+	if (gconf_get_float(client, &fix->altitude, GC_LK_ALT))
+		fix->fields |= LOCATION_GPS_DEVICE_ALTITUDE_SET;
+	else
+		fix->altitude = LOCATION_GPS_DEVICE_NAN;
+
+	if (gconf_get_float(client, &fix->track, GC_LK_TRK))
+		fix->fields |= LOCATION_GPS_DEVICE_TRACK_SET;
+	else
+		fix->track = LOCATION_GPS_DEVICE_NAN;
+
+	if (gconf_get_float(client, &fix->speed, GC_LK_SPD))
+		fix->fields |= LOCATION_GPS_DEVICE_SPEED_SET;
+	else
+		fix->speed = LOCATION_GPS_DEVICE_NAN;
+
+	if (gconf_get_float(client, &fix->climb, GC_LK_CLB))
+		fix->fields |= LOCATION_GPS_DEVICE_CLIMB_SET;
+	else
+		fix->climb = LOCATION_GPS_DEVICE_NAN;
+
+	g_object_unref(client);
+	return TRUE;
+}
+
+void store_lastknown_cache(const LocationGPSDeviceFix *fix)
+{
+	LastKnownRecord rec;
+	GError *err = NULL;
+	gchar *path;
+
+	memset(&rec, 0, sizeof(rec));
+	rec.magic = LASTKNOWN_MAGIC;
+	rec.version = LASTKNOWN_VERSION;
+	rec.fields = fix->fields;
+	rec.time = fix->time;
+	rec.latitude = fix->latitude;
+	rec.longitude = fix->longitude;
+	rec.altitude = fix->altitude;
+	rec.track = fix->track;
+	rec.speed = fix->speed;
+	rec.climb = fix->climb;
+
+	/* g_get_user_runtime_dir() may fall back to a directory not yet there */
+	g_mkdir_with_parents(g_get_user_runtime_dir(), 0700);
+
+	/* writes a temporary file and renames it over the old one */
+	path = lastknown_path();
+	if (!g_file_set_contents(path, (const gchar *)&rec, sizeof(rec), &err)) {
+		g_warning("%s: %s", G_STRFUNC, err->message);
+		g_error_free(err);
+	}
+
+	g_free(path);
+}
+
+void store_lastknown_gconf(const LocationGPSDeviceFix *f)
+{
+	const LocationGPSDeviceFix fix = *f;
+	GConfChangeSet *cs;
+	GConfClient *client;
+	GError *err = NULL;
+
+	cs = gconf_change_set_new();
+
+	if (fix.fields & LOCATION_GPS_DEVICE_TIME_SET)
+		gconf_change_set_set_float(cs, GC_LK_TIME, fix.time);
+	else
+		gconf_change_set_unset(cs, GC_LK_TIME);
+
+	if (fix.fields & LOCATION_GPS_DEVICE_LATLONG_SET) {
+		gconf_change_set_set_float(cs, GC_LK_LAT, fix.latitude);
+		gconf_change_set_set_float(cs, GC_LK_LON, fix.longitude);
+	} else {
+		gconf_change_set_unset(cs, GC_LK_LAT);
+		gconf_change_set_unset(cs, GC_LK_LON);
+	}
+
+	if (fix.fields & LOCATION_GPS_DEVICE_ALTITUDE_SET)
+		gconf_change_set_set_float(cs, GC_LK_ALT, fix.altitude);
+	else
+		gconf_change_set_unset(cs, GC_LK_ALT);
+
+	if (fix.fields & LOCATION_GPS_DEVICE_TRACK_SET)
+		gconf_change_set_set_float(cs, GC_LK_TRK, fix.track);
+	else
+		gconf_change_set_unset(cs, GC_LK_TRK);
+
+	if (fix.fields & LOCATION_GPS_DEVICE_SPEED_SET)
+		gconf_change_set_set_float(cs, GC_LK_SPD, fix.speed);
+	else
+		gconf_change_set_unset(cs, GC_LK_SPD);
+
+	if (fix.fields & LOCATION_GPS_DEVICE_CLIMB_SET)
+		gconf_change_set_set_float(cs, GC_LK_CLB, fix.climb);
+	else
+		gconf_change_set_unset(cs, GC_LK_CLB);
+
+	client = gconf_client_get_default();
+	if (!gconf_client_commit_change_set(client, cs, FALSE, &err)) {
+		g_warning("%s: %s", G_STRFUNC, err->message);
+		g_error_free(err);
+	}
+
+	g_object_unref(client);
+	gconf_change_set_unref(cs);
+}
+
+/*
+ * Write checkpoint @seq to the cache. Devices on different threads may
+ * race here, so an older checkpoint never replaces a newer one.
+ */
+void cache_lastknown(const LocationGPSDeviceFix *fix, guint64 seq)
+{
+	G_LOCK(lastknown_cache);
+
+	if (seq > lastknown_cached) {
+		store_lastknown_cache(fix);
+		lastknown_cached = seq;
+	}
+
+	G_UNLOCK(lastknown_cache);
+}
+
+/* the runtime directory does not survive a reboot, GConf does */
+gboolean write_lastknown(gpointer unused)
+{
+	LocationGPSDeviceFix fix;
+
+	G_LOCK(lastknown);
+	fix = lastknown_fix;
+	lastknown_id = 0;
+	G_UNLOCK(lastknown);
+
+	store_lastknown_gconf(&fix);
+	return FALSE;
+}
+
+/*
+ * Store @fix as the last known fix. Periodic checkpoints are stored at
+ * most every LASTKNOWN_CHECKPOINT seconds, with @now right away. Each one
+ * is written to the runtime cache before returning, from the calling
+ * thread, and committed to GConf once the default main loop is idle;
+ * whatever is newest by then goes to GConf, so bursts are folded into one.
+ * A process not running the default main loop still keeps the cache.
+ */
+void checkpoint_lastknown(const LocationGPSDeviceFix *fix, gboolean now)
+{
+	LocationGPSDeviceFix copy;
+	GSource *source;
+	gint64 time;
+	guint64 seq;
+
+	time = g_get_monotonic_time();
+
+	G_LOCK(lastknown);
+
+	lastknown_fix = *fix;
+	seq = ++lastknown_seq;
+
+	if (!now && lastknown_written &&
+			time - lastknown_written < LASTKNOWN_CHECKPOINT * G_USEC_PER_SEC) {
+		G_UNLOCK(lastknown);
+		return;
+	}
+
+	lastknown_written = time;
+	copy = *fix;
+
+	if (!lastknown_id) {
+		source = g_idle_source_new();
+		g_source_set_priority(source, G_PRIORITY_LOW);
+		g_source_set_callback(source, write_lastknown, NULL, NULL);
+		lastknown_id = g_source_attach(source, NULL);
+		g_source_unref(source);
+	}
+
+	G_UNLOCK(lastknown);
+
+	cache_lastknown(&copy, seq);
+}
+
+int signal_changed(LocationGPSDevice *device)
+{
+	LocationGPSDevicePrivate *p;
+	p = location_gps_device_get_instance_private(device);
+
+	p->changed_id = 0;
+	p->last_changed = device_now(p);
+	p->changed_fields = p->changed_pending;
+	p->changed_pending = 0;
+
+	g_signal_emit(device, signals[DEVICE_CHANGED], 0);
+	if (p->changed_fields)
+		g_signal_emit(device, signals[DEVICE_CHANGED_FIELDS], 0,
+				p->changed_fields);
+
+	p->changed_fields = 0;
+	g_object_unref(device);
+	return 0;
+}
+
+void history_append(LocationGPSDevice *device)
+{
+	LocationGPSDevicePrivate *p;
+	p = location_gps_device_get_instance_private(device);
+
+	p->sequence++;
+
+	if (p->history_len)
+		p->history[(p->sequence - 1) % p->history_len] = *device->fix;
+}
+
+void publish_snapshot(LocationGPSDevice *device)
+{
+	LocationGPSDevicePrivate *p;
+	p = location_gps_device_get_instance_private(device);
+
+	g_mutex_lock(&p->snapshot_lock);
+
+	/* both increments are full barriers */
+	g_atomic_int_inc(&p->snapshot_seq);
+
+	p->snapshot.sequence = p->sequence;
+	p->snapshot.online = device->online;
+	p->snapshot.status = device->status;
+	p->snapshot.fix = *device->fix;
+	p->snapshot.satellites_in_view = device->satellites_in_view;
+	p->snapshot.satellites_in_use = device->satellites_in_use;
+
+	g_atomic_int_inc(&p->snapshot_seq);
+
+	g_mutex_unlock(&p->snapshot_lock);
+}
+
+double fix_time(const LocationGPSDeviceFix *fix)
+{
+	if (fix->fields & LOCATION_GPS_DEVICE_TIME_SET)
+		return fix->time;
+
+	return g_get_real_time() / (double)G_USEC_PER_SEC;
+}
+
+/*
+ * Feeds what this epoch measured to the filter and replaces the fix with
+ * its estimate. Fields the epoch did not update hold the previous
+ * estimate, so only the fresh ones are used as measurements.
+ */
+void smooth_fix(LocationGPSDevice *device)
+{
+	LocationGPSDevicePrivate *p;
+	LocationGPSDeviceFix *fix = device->fix;
+	LocationKalmanMeasurement m;
+	LocationKalmanEstimate est;
+	guint fresh;
+
+	p = location_gps_device_get_instance_private(device);
+	fresh = p->epoch_fields;
+
+	if (!(fresh & (LOCATION_GPS_DEVICE_CHANGED_POSITION
+				| LOCATION_GPS_DEVICE_CHANGED_ALTITUDE
+				| LOCATION_GPS_DEVICE_CHANGED_COURSE)))
+		return;
+
+	m.t = fix_time(fix);
+	m.latitude = m.longitude = m.altitude = LOCATION_GPS_DEVICE_NAN;
+	m.speed = m.track = m.climb = LOCATION_GPS_DEVICE_NAN;
+
+	if ((fresh & LOCATION_GPS_DEVICE_CHANGED_POSITION)
+			&& (fix->fields & LOCATION_GPS_DEVICE_LATLONG_SET)) {
+		m.latitude = fix->latitude;
+		m.longitude = fix->longitude;
+	}
+
+	if ((fresh & LOCATION_GPS_DEVICE_CHANGED_ALTITUDE)
+			&& (fix->fields & LOCATION_GPS_DEVICE_ALTITUDE_SET))
+		m.altitude = fix->altitude;
+
+	if (fresh & LOCATION_GPS_DEVICE_CHANGED_COURSE) {
+		if ((fix->fields & LOCATION_GPS_DEVICE_SPEED_SET)
+				&& (fix->fields & LOCATION_GPS_DEVICE_TRACK_SET)) {
+			m.speed = fix->speed / KMH_PER_MS;
+			m.track = fix->track;
+		}
+		if (fix->fields & LOCATION_GPS_DEVICE_CLIMB_SET)
+			m.climb = fix->climb;
+	}
+
+	m.pos_sigma = p->raw_eph / CM_PER_M;
+	m.alt_sigma = p->raw_epv;
+	m.speed_sigma = fix->eps / KMH_PER_MS;
+	m.climb_sigma = fix->epc;
+
+	location_kalman_update(&p->kalman, &m);
+
+	if (!location_kalman_predict(&p->kalman, m.t, &est))
+		return;
+
+	if (fix->fields & LOCATION_GPS_DEVICE_LATLONG_SET) {
+		fix->latitude = est.latitude;
+		fix->longitude = est.longitude;
+		fix->eph = est.pos_sigma * CM_PER_M;
+	}
+
+	if (fix->fields & LOCATION_GPS_DEVICE_ALTITUDE_SET
+			&& isfinite(est.altitude)) {
+		fix->altitude = est.altitude;
+		fix->epv = est.alt_sigma;
+	}
+
+	if ((fix->fields & LOCATION_GPS_DEVICE_SPEED_SET)
+			&& (fix->fields & LOCATION_GPS_DEVICE_TRACK_SET)) {
+		fix->speed = est.speed * KMH_PER_MS;
+		fix->track = est.track;
+	}
+
+	if (fix->fields & LOCATION_GPS_DEVICE_CLIMB_SET && isfinite(est.climb))
+		fix->climb = est.climb;
+}
+
+/*
+ * Called once the updates of an epoch have settled. "changed" is emitted
+ * right away unless the last emission was less than device->interval ago,
+ * in which case it is deferred until the interval has passed. Anything
+ * arriving in the meantime is delivered with that deferred emission.
+ */
+int epoch_complete(LocationGPSDevice *device)
+{
+	LocationGPSDevicePrivate *p;
+	gint64 delay = 0;
+
+	p = location_gps_device_get_instance_private(device);
+	p->epoch_id = 0;
+
+	if (p->smoothing) {
+		smooth_fix(device);
+		/* the estimate replaces what was delivered update by update */
+		if (device->interval == LOCATION_GPS_DEVICE_INTERVAL_IMMEDIATE)
+			p->changed_pending |= p->epoch_fields;
+	}
+	p->epoch_fields = 0;
+
+	history_append(device);
+	publish_snapshot(device);
+	checkpoint_lastknown(device->fix, FALSE);
+
+	if (p->batch_func)
+		batch_append(device);
+
+	if (p->geofences && (device->fix->fields & LOCATION_GPS_DEVICE_LATLONG_SET))
+		location_geofence_set_update(p->geofences, device->fix->latitude,
+				device->fix->longitude, device_now(p) / 1000,
+				signal_geofence, device);
+
+	/* immediate updates have been delivered as they came in */
+	if (p->changed_id || (!p->changed_pending && device->interval
+				== LOCATION_GPS_DEVICE_INTERVAL_IMMEDIATE)) {
+		g_object_unref(device);
+		return 0;
+	}
+
+	if (device->interval > 0 && p->last_changed)
+		delay = (p->last_changed + device->interval * 1000LL
+				- device_now(p)) / 1000;
+
+	if (delay <= 0)
+		return signal_changed(device);
+
+	/* the reference taken in schedule_changed() moves to this source */
+	p->changed_id = add_timeout(device, delay, (GSourceFunc)signal_changed);
+	return 0;
+}
+
+void schedule_changed(LocationGPSDevice *device)
+{
+	LocationGPSDevicePrivate *p;
+	p = location_gps_device_get_instance_private(device);
+
+	/*
+	 * Immediate updates are emitted on their own, but the end of the
+	 * epoch is still waited for to record it in the history, batch and
+	 * snapshot.
+	 */
+	if (device->interval == LOCATION_GPS_DEVICE_INTERVAL_IMMEDIATE
+			&& !p->changed_id) {
+		g_object_ref(device);
+		p->changed_id = add_timeout(device, 0,
+				(GSourceFunc)signal_changed);
+	}
+
+	if (p->epoch_id)
+		return;
+
+	g_object_ref(device);
+	p->epoch_id = add_timeout(device, epoch_window(p),
+			(GSourceFunc)epoch_complete);
+}
+
+/* called as an epoch starts; tracks the receiver rate to size the window */
+guint epoch_window(LocationGPSDevicePrivate *p)
+{
+	gint64 now = device_now(p);
+	gint64 period = now - p->epoch_start;
+
+	/* gaps of a second or more are pauses, not the epoch rate */
+	if (p->epoch_start && period < G_USEC_PER_SEC)
+		p->epoch_period = p->epoch_period
+			? (7 * p->epoch_period + period) / 8 : period;
+
+	p->epoch_start = now;
+
+	if (!p->epoch_period)
+		return EPOCH_WINDOW;
+
+	return CLAMP(p->epoch_period / 2000, 1, EPOCH_WINDOW);
+}
+
+/* records what an update changed and starts or joins the current epoch */
+void mark_changed(LocationGPSDevice *device, guint fields)
+{
+	LocationGPSDevicePrivate *p;
+	p = location_gps_device_get_instance_private(device);
+
+	p->changed_pending |= fields;
+	p->epoch_fields |= fields;
+	schedule_changed(device);
+}
+
+/* like g_timeout_add(), but on the context of the device; 0 ms means idle */
+guint add_timeout(LocationGPSDevice *device, guint ms, GSourceFunc func)
+{
+	LocationGPSDevicePrivate *p;
+	GSource *source;
+	guint id;
+
+	p = location_gps_device_get_instance_private(device);
+
+	if (p->clock)
+		return location_virtual_clock_add(p->clock, ms, func, device);
+
+	source = ms ? g_timeout_source_new(ms) : g_idle_source_new();
+	g_source_set_callback(source, func, device, NULL);
+	id = g_source_attach(source, p->ctx);
+	g_source_unref(source);
+
+	return id;
+}
+
+void remove_timeout(LocationGPSDevice *device, guint id)
+{
+	LocationGPSDevicePrivate *p;
+	GSource *source;
+
+	p = location_gps_device_get_instance_private(device);
+
+	if (p->clock) {
+		location_virtual_clock_remove(p->clock, id);
+		return;
+	}
+
+	source = g_main_context_find_source_by_id(
+			location_gps_device_get_context(device), id);
+	if (source)
+		g_source_destroy(source);
+}
+
+gint64 device_now(LocationGPSDevicePrivate *p)
+{
+	return p->clock ? p->clock->now : g_get_monotonic_time();
+}
+
+void apply_signal(LocationGPSDevice *device, const DaemonSignal *sig)
+{
+	switch (sig->type) {
+	case DAEMON_SIGNAL_TIME:
+		set_time(device, sig);
+		break;
+	case DAEMON_SIGNAL_POSITION:
+		set_position(device, sig);
+		break;
+	case DAEMON_SIGNAL_COURSE:
+		set_course(device, sig);
+		break;
+	case DAEMON_SIGNAL_ACCURACY:
+		set_accuracy(device, sig);
+		break;
+	case DAEMON_SIGNAL_FIX_STATUS:
+		set_fix_status(device, sig);
+		break;
+	case DAEMON_SIGNAL_SATELLITES:
+		set_satellites(device, sig);
+		break;
+	}
+}
+
+DBusHandlerResult on_locationdaemon_signal(DBusConnection *bus,
+		DBusMessage *msg, void *data)
+{
+	SharedBus *shared = data;
+	const DaemonSignalHandler *handler;
+	LocationGPSDevice *local[DISPATCH_LOCAL], **devices;
+	DaemonSignal sig;
+	guint i, n;
+
+	handler = lookup_signal_handler(msg);
+	if (!handler)
+		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+	sig.type = handler->type;
+	if (!handler->parse(shared, msg, &sig)) {
+		g_warning("%s: malformed %s signal", G_STRFUNC, handler->member);
+		return DBUS_HANDLER_RESULT_HANDLED;
+	}
+
+	if (g_atomic_int_get(&n_taps))
+		run_taps(&sig);
+
+	/*
+	 * The handlers of the devices may create or drop devices, so the
+	 * list is copied and referenced under the lock and the signal
+	 * applied without it.
+	 */
+	G_LOCK(shared_buses);
+
+	n = shared->devices->len;
+	devices = n <= DISPATCH_LOCAL ? local : g_new(LocationGPSDevice *, n);
+	for (i = 0; i < n; i++)
+		devices[i] = g_object_ref(g_ptr_array_index(shared->devices, i));
+
+	G_UNLOCK(shared_buses);
+
+	for (i = 0; i < n; i++) {
+		apply_signal(devices[i], &sig);
+		g_object_unref(devices[i]);
+	}
+
+	if (devices != local)
+		g_free(devices);
+
+	return DBUS_HANDLER_RESULT_HANDLED;
+}
+
+void run_taps(const DaemonSignal *sig)
+{
+	Tap *tap;
+	guint i;
+
+	G_LOCK(taps);
+
+	for (i = 0; taps && i < taps->len; i++) {
+		tap = &g_array_index(taps, Tap, i);
+		tap->func(sig, tap->user_data);
+	}
+
+	G_UNLOCK(taps);
+}
+
+void location_gps_device_add_tap(DaemonSignalTap func, gpointer user_data)
+{
+	Tap tap = { func, user_data };
+
+	G_LOCK(taps);
+
+	if (!taps)
+		taps = g_array_new(FALSE, FALSE, sizeof(Tap));
+
+	g_array_append_val(taps, tap);
+	g_atomic_int_set(&n_taps, taps->len);
+
+	G_UNLOCK(taps);
+}
+
+void location_gps_device_remove_tap(DaemonSignalTap func, gpointer user_data)
+{
+	Tap *tap;
+	guint i;
+
+	G_LOCK(taps);
+
+	for (i = 0; taps && i < taps->len; i++) {
+		tap = &g_array_index(taps, Tap, i);
+		if (tap->func == func && tap->user_data == user_data) {
+			g_array_remove_index(taps, i);
+			break;
+		}
+	}
+
+	if (taps)
+		g_atomic_int_set(&n_taps, taps->len);
+
+	G_UNLOCK(taps);
+}
+
+void location_gps_device_apply_signal(LocationGPSDevice *device,
+		const DaemonSignal *sig)
+{
+	g_assert(LOCATION_IS_GPS_DEVICE(device));
+	apply_signal(device, sig);
+}
+
+GMainContext *location_gps_device_get_context(LocationGPSDevice *device)
 {
-	GPtrArray *result;
-
-	result = device->satellites;
-	if (result) {
-		g_ptr_array_foreach(result, (GFunc)&g_free, NULL);
-		g_ptr_array_free(device->satellites, TRUE);
-		device->satellites = NULL;
-	}
+	LocationGPSDevicePrivate *p;
 
-	device->satellites_in_view = 0;
-	device->satellites_in_use = 0;
+	g_assert(LOCATION_IS_GPS_DEVICE(device));
+	p = location_gps_device_get_instance_private(device);
 
-	return result;
+	return p->ctx ? p->ctx : g_main_context_default();
 }
 
-dbus_bool_t set_satellites(LocationGPSDevice *device, DBusMessage *msg)
+gboolean location_gps_device_set_clock(LocationGPSDevice *device,
+		LocationVirtualClock *clock)
 {
-	g_debug(G_STRFUNC);
-	GPtrArray *satarray;
-	DBusMessageIter iter, arr, st;
-	int t;
-
-	free_satellites(device);
-	satarray = g_ptr_array_new();
-	device->satellites = satarray;
+	LocationGPSDevicePrivate *p;
 
-	dbus_message_iter_init(msg, &iter);
+	g_assert(LOCATION_IS_GPS_DEVICE(device));
+	p = location_gps_device_get_instance_private(device);
 
-	if ((t = dbus_message_iter_get_arg_type(&iter)) != DBUS_TYPE_ARRAY)
+	if (p->epoch_id || p->changed_id || p->batch_id)
 		return FALSE;
 
-	dbus_message_iter_recurse(&iter, &arr);
+	p->clock = clock;
+	p->last_changed = 0;
+	p->epoch_start = 0;
+	p->epoch_period = 0;
+	return TRUE;
+}
 
-	while ((t = dbus_message_iter_get_arg_type(&arr)) != DBUS_TYPE_INVALID) {
-		LocationGPSDeviceSatellite *sat = g_malloc(
-			sizeof(LocationGPSDeviceSatellite));
+void shared_bus_add_device(LocationGPSDevice *device)
+{
+	static gsize threads_init = 0;
+	LocationGPSDevicePrivate *p;
+	DBusConnection *bus = NULL;
+	GMainContext *ctx;
+	SharedBus *shared;
 
-		dbus_message_iter_recurse(&arr, &st);
+	p = location_gps_device_get_instance_private(device);
+	ctx = p->ctx ? p->ctx : g_main_context_default();
 
-		dbus_message_iter_get_basic(&st, &sat->prn);
-		dbus_message_iter_next(&st);
+	/* devices on different contexts use libdbus from several threads */
+	if (g_once_init_enter(&threads_init)) {
+		dbus_threads_init_default();
+		g_once_init_leave(&threads_init, 1);
+	}
 
-		dbus_message_iter_get_basic(&st, &sat->elevation);
-		dbus_message_iter_next(&st);
+	G_LOCK(shared_buses);
+
+	if (!shared_buses)
+		shared_buses = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+	shared = g_hash_table_lookup(shared_buses, ctx);
+	if (!shared) {
+		/*
+		 * Connecting blocks on the bus daemon, so it is done without
+		 * the lock. Another device on this context may have set up
+		 * the connection meanwhile, in which case ours is dropped.
+		 */
+		G_UNLOCK(shared_buses);
+		bus = dbus_bus_get_private(DBUS_BUS_SYSTEM, NULL);
+		if (!bus) {
+			g_warning("%s: could not connect to the system bus",
+					G_STRFUNC);
+			return;
+		}
+		G_LOCK(shared_buses);
 
-		dbus_message_iter_get_basic(&st, &sat->azimuth);
-		dbus_message_iter_next(&st);
+		shared = g_hash_table_lookup(shared_buses, ctx);
+	}
 
-		dbus_message_iter_get_basic(&st, &sat->signal_strength);
-		dbus_message_iter_next(&st);
+	if (!shared) {
+		shared = g_new0(SharedBus, 1);
+		shared->ctx = g_main_context_ref(ctx);
+		shared->bus = bus;
+		shared->devices = g_ptr_array_new();
+		shared->satellites = g_array_new(FALSE, FALSE,
+				sizeof(LocationGPSDeviceSatellite));
+
+		dbus_connection_setup_with_g_main(bus, ctx);
+		/*
+		 * Without an error argument libdbus only queues the AddMatch
+		 * call and never waits for the reply, so this does not block.
+		 */
+		dbus_bus_add_match(bus, LOCATION_DAEMON_MATCH, NULL);
+		dbus_connection_add_filter(bus, on_locationdaemon_signal,
+				shared, NULL);
+
+		g_hash_table_insert(shared_buses, ctx, shared);
+		bus = NULL;
+	}
 
-		dbus_message_iter_get_basic(&st, &sat->in_use);
-		dbus_message_iter_next(&st);
+	g_ptr_array_add(shared->devices, device);
+	p->shared = shared;
 
-		g_ptr_array_add(device->satellites, sat);
-		++device->satellites_in_view;
-		if (sat->in_use)
-			++device->satellites_in_use;
+	G_UNLOCK(shared_buses);
 
-		dbus_message_iter_next(&arr);
+	if (bus) {
+		dbus_connection_close(bus);
+		dbus_connection_unref(bus);
 	}
-
-	return TRUE;
 }
 
-dbus_bool_t set_time(LocationGPSDevice *device, DBusMessage *msg)
+void shared_bus_remove_device(LocationGPSDevice *device)
 {
-	dbus_bool_t result;
-	LocationGPSDeviceFix *fix;
-	struct timespec t;
+	LocationGPSDevicePrivate *p;
+	SharedBus *shared;
+
+	p = location_gps_device_get_instance_private(device);
 
-	result = dbus_message_get_args(msg, NULL,
-		DBUS_TYPE_INT64, &t.tv_sec,
-		DBUS_TYPE_INT64, &t.tv_nsec,
-		DBUS_TYPE_INVALID);
+	G_LOCK(shared_buses);
 
-	if (result) {
-		fix = device->fix;
-		fix->time = TSTONS(t);
-		fix->fields |= LOCATION_GPS_DEVICE_TIME_SET;
+	shared = p->shared;
+	if (!shared) {
+		G_UNLOCK(shared_buses);
+		return;
+	}
+
+	g_ptr_array_remove_fast(shared->devices, device);
+	p->shared = NULL;
+
+	if (shared->devices->len == 0) {
+		g_hash_table_remove(shared_buses, shared->ctx);
+
+		/* no error argument: the request is queued, not waited for */
+		dbus_bus_remove_match(shared->bus, LOCATION_DAEMON_MATCH, NULL);
+		dbus_connection_remove_filter(shared->bus,
+				on_locationdaemon_signal, shared);
+		dbus_connection_close(shared->bus);
+		dbus_connection_unref(shared->bus);
+		g_main_context_unref(shared->ctx);
+		g_ptr_array_free(shared->devices, TRUE);
+		g_array_free(shared->satellites, TRUE);
+		g_free(shared);
 	}
 
-	return result;
+	G_UNLOCK(shared_buses);
 }
 
-dbus_bool_t set_course(LocationGPSDevice *device, DBusMessage *msg)
+void location_gps_device_reset_last_known(LocationGPSDevice *device)
 {
-	dbus_bool_t result;
-	LocationGPSDeviceFix *fix;
-	double speed, track, climb;
+	LocationGPSDevicePrivate *p;
+	LocationGPSDeviceFix *fix = device->fix;
 
-	result = dbus_message_get_args(msg, NULL,
-		DBUS_TYPE_DOUBLE, &speed,
-		DBUS_TYPE_DOUBLE, &track,
-		DBUS_TYPE_DOUBLE, &climb,
-		DBUS_TYPE_INVALID);
+	g_assert(LOCATION_IS_GPS_DEVICE(device));
+	p = location_gps_device_get_instance_private(device);
 
-	if (result) {
-		fix = device->fix;
+	device->status = LOCATION_GPS_DEVICE_STATUS_NO_FIX;
 
-		if (isfinite(speed)) {
-			fix->fields |= LOCATION_GPS_DEVICE_SPEED_SET;
-			/* gpsd and location-daemon give us m/s, but we will give km/h */
-			fix->speed = speed * 3.6;
-		}
+	fix->mode = LOCATION_GPS_DEVICE_MODE_NOT_SEEN;
+	fix->fields = LOCATION_GPS_DEVICE_NONE_SET;
+	fix->dip = LOCATION_GPS_DEVICE_NAN;
+	fix->time = LOCATION_GPS_DEVICE_NAN;
+	fix->ept = LOCATION_GPS_DEVICE_NAN;
+	fix->latitude = LOCATION_GPS_DEVICE_NAN;
+	fix->longitude = LOCATION_GPS_DEVICE_NAN;
+	fix->eph = LOCATION_GPS_DEVICE_NAN;
+	fix->altitude = LOCATION_GPS_DEVICE_NAN;
+	fix->epv = LOCATION_GPS_DEVICE_NAN;
+	fix->track = LOCATION_GPS_DEVICE_NAN;
+	fix->epd = LOCATION_GPS_DEVICE_NAN;
+	fix->speed = LOCATION_GPS_DEVICE_NAN;
+	fix->eps = LOCATION_GPS_DEVICE_NAN;
+	fix->climb = LOCATION_GPS_DEVICE_NAN;
+	fix->epc = LOCATION_GPS_DEVICE_NAN;
+	fix->pitch = LOCATION_GPS_DEVICE_NAN;
+	fix->roll = LOCATION_GPS_DEVICE_NAN;
 
-		if (isfinite(track)) {
-			fix->fields |= LOCATION_GPS_DEVICE_TRACK_SET;
-			fix->track = track;
-		}
+	clear_satellites(device);
+	location_kalman_reset(&p->kalman);
+	p->raw_eph = LOCATION_GPS_DEVICE_NAN;
+	p->raw_epv = LOCATION_GPS_DEVICE_NAN;
+	checkpoint_lastknown(fix, TRUE);
+	publish_snapshot(device);
 
-		if (isfinite(climb)) {
-			fix->fields |= LOCATION_GPS_DEVICE_CLIMB_SET;
-			fix->climb = climb;
-		}
+	p->changed_fields = LOCATION_GPS_DEVICE_CHANGED_ALL;
+	g_signal_emit(device, signals[DEVICE_CHANGED], 0);
+	g_signal_emit(device, signals[DEVICE_CHANGED_FIELDS], 0,
+			p->changed_fields);
+	p->changed_fields = 0;
+}
 
-		add_g_timeout_interval(device);
-	}
+guint64 location_gps_device_get_sequence(LocationGPSDevice *device)
+{
+	LocationGPSDevicePrivate *p;
+
+	g_assert(LOCATION_IS_GPS_DEVICE(device));
+	p = location_gps_device_get_instance_private(device);
 
-	return result;
+	return p->sequence;
 }
 
-dbus_bool_t set_fix_status(LocationGPSDevice *device, DBusMessage *msg)
+gboolean location_gps_device_predict(LocationGPSDevice *device, double t,
+		LocationGPSDeviceFix *fix)
 {
-	dbus_bool_t result;
-	LocationGPSDeviceFix *fix;
-	uint8_t mode;
+	LocationGPSDevicePrivate *p;
+	LocationKalmanEstimate est;
+	double dt;
 
-	result = dbus_message_get_args(msg, NULL,
-		DBUS_TYPE_BYTE, &mode,
-		DBUS_TYPE_INVALID);
+	g_assert(LOCATION_IS_GPS_DEVICE(device));
+	p = location_gps_device_get_instance_private(device);
 
-	if (result) {
-		fix = device->fix;
-		fix->mode = mode;
-		add_g_timeout_interval(device);
-	}
+	*fix = *device->fix;
 
-	return result;
-}
+	if (!isfinite(t) || t <= 0)
+		t = g_get_real_time() / (double)G_USEC_PER_SEC;
 
-dbus_bool_t set_position(LocationGPSDevice *device, DBusMessage *msg)
-{
-	dbus_bool_t result;
-	LocationGPSDeviceFix *fix;
-	double latitude, longitude, altitude;
-
-	result = dbus_message_get_args(msg, NULL,
-		DBUS_TYPE_DOUBLE, &latitude,
-		DBUS_TYPE_DOUBLE, &longitude,
-		DBUS_TYPE_DOUBLE, &altitude,
-		DBUS_TYPE_INVALID);
-
-	if (result) {
-		fix = device->fix;
-
-		if (isfinite(latitude) && isfinite(longitude)) {
-			fix->latitude = latitude;
-			fix->longitude = longitude;
-			fix->fields |= LOCATION_GPS_DEVICE_LATLONG_SET;
-		} else {
-			fix->fields &= LOCATION_GPS_DEVICE_LATLONG_SET;
-		}
+	if (p->smoothing && location_kalman_predict(&p->kalman, t, &est)
+			&& (fix->fields & LOCATION_GPS_DEVICE_LATLONG_SET)) {
+		fix->latitude = est.latitude;
+		fix->longitude = est.longitude;
+		fix->eph = est.pos_sigma * CM_PER_M;
 
-		if (isfinite(altitude)) {
-			fix->altitude = altitude;
-			fix->fields |= LOCATION_GPS_DEVICE_ALTITUDE_SET;
-		} else {
-			fix->fields &= LOCATION_GPS_DEVICE_ALTITUDE_SET;
+		if (fix->fields & LOCATION_GPS_DEVICE_ALTITUDE_SET
+				&& isfinite(est.altitude)) {
+			fix->altitude = est.altitude;
+			fix->epv = est.alt_sigma;
 		}
 
-		if (isfinite(latitude) && isfinite(longitude) && isfinite(altitude))
-			fix->mode = LOCATION_GPS_DEVICE_MODE_3D;
-		else if (isfinite(latitude) && isfinite(longitude))
-			fix->mode = LOCATION_GPS_DEVICE_MODE_2D;
-		else
-			fix->mode = LOCATION_GPS_DEVICE_MODE_NO_FIX;
+		fix->time = t;
+		fix->fields |= LOCATION_GPS_DEVICE_TIME_SET;
+		return TRUE;
+	}
 
-		add_g_timeout_interval(device);
+	/* no filter state, move the last fix along its course */
+	if ((fix->fields & LOCATION_GPS_DEVICE_LATLONG_SET)
+			&& (fix->fields & LOCATION_GPS_DEVICE_TIME_SET)
+			&& (fix->fields & LOCATION_GPS_DEVICE_SPEED_SET)
+			&& (fix->fields & LOCATION_GPS_DEVICE_TRACK_SET)) {
+		dt = t - fix->time;
+		location_kalman_extrapolate(fix->latitude, fix->longitude,
+				fix->speed / KMH_PER_MS, fix->track, dt,
+				&fix->latitude, &fix->longitude);
+
+		if ((fix->fields & LOCATION_GPS_DEVICE_ALTITUDE_SET)
+				&& (fix->fields & LOCATION_GPS_DEVICE_CLIMB_SET))
+			fix->altitude += fix->climb * CLAMP(dt, 0, 30);
+
+		fix->time = t;
+		return TRUE;
 	}
 
-	return result;
+	return FALSE;
 }
 
-dbus_bool_t set_accuracy(LocationGPSDevice *device, DBusMessage *msg)
+void batch_append(LocationGPSDevice *device)
 {
-	dbus_bool_t result;
-	LocationGPSDeviceFix *fix;
-	double ept, epv, epd, eps, epc, eph;
-
-	result = dbus_message_get_args(msg, NULL,
-		DBUS_TYPE_DOUBLE, &ept,
-		DBUS_TYPE_DOUBLE, &epv,
-		DBUS_TYPE_DOUBLE, &epd,
-		DBUS_TYPE_DOUBLE, &eps,
-		DBUS_TYPE_DOUBLE, &epc,
-		DBUS_TYPE_DOUBLE, &eph,
-		DBUS_TYPE_INVALID);
+	LocationGPSDevicePrivate *p;
+	p = location_gps_device_get_instance_private(device);
 
-	if (result) {
-		fix = device->fix;
+	p->batch[p->batch_len++] = *device->fix;
 
-		if (isfinite(ept))
-			fix->ept = ept;
+	if (p->batch_len == p->batch_max)
+		location_gps_device_flush_batch(device);
+	else if (p->batch_len == 1 && p->batch_ms)
+		p->batch_id = add_timeout(device, p->batch_ms,
+				(GSourceFunc)batch_timeout);
+}
 
-		if (isfinite(epv))
-			fix->epv = epv;
+int batch_timeout(LocationGPSDevice *device)
+{
+	LocationGPSDevicePrivate *p;
+	p = location_gps_device_get_instance_private(device);
 
-		if (isfinite(epd))
-			fix->epd = epd;
+	p->batch_id = 0;
+	location_gps_device_flush_batch(device);
+	return 0;
+}
 
-		if (isfinite(eps))
-			fix->eps = eps;
+/* hands over what is pending and drops the callback */
+void clear_batch(LocationGPSDevice *device)
+{
+	LocationGPSDevicePrivate *p;
+	p = location_gps_device_get_instance_private(device);
 
-		if (isfinite(epc))
-			fix->epc = epc;
+	if (!p->batch_func)
+		return;
 
-		if (isfinite(eph))
-			fix->eph = eph;
+	location_gps_device_flush_batch(device);
 
-		add_g_timeout_interval(device);
-	}
+	if (p->batch_notify)
+		p->batch_notify(p->batch_data);
 
-	return result;
+	g_free(p->batch);
+	p->batch = NULL;
+	p->batch_max = 0;
+	p->batch_func = NULL;
+	p->batch_data = NULL;
+	p->batch_notify = NULL;
 }
 
-void store_lastknown_in_gconf(LocationGPSDevice *device)
+void location_gps_device_set_batch(LocationGPSDevice *device,
+		guint max_fixes, guint max_ms, LocationGPSDeviceBatchFunc func,
+		gpointer user_data, GDestroyNotify notify)
 {
-	LocationGPSDeviceFix *fix = device->fix;
-	GConfClient *client = gconf_client_get_default();
-
-	if (fix->fields & LOCATION_GPS_DEVICE_TIME_SET)
-		gconf_client_set_float(client, GC_LK_TIME, fix->time, NULL);
-	else
-		gconf_client_unset(client, GC_LK_TIME, NULL);
-
-	if (fix->fields & LOCATION_GPS_DEVICE_LATLONG_SET) {
-		gconf_client_set_float(client, GC_LK_LAT, fix->latitude, NULL);
-		gconf_client_set_float(client, GC_LK_LON, fix->longitude, NULL);
-	} else {
-		gconf_client_unset(client, GC_LK_LAT, NULL);
-		gconf_client_unset(client, GC_LK_LON, NULL);
-	}
+	LocationGPSDevicePrivate *p;
 
-	if (fix->fields & LOCATION_GPS_DEVICE_ALTITUDE_SET)
-		gconf_client_set_float(client, GC_LK_ALT, fix->altitude, NULL);
-	else
-		gconf_client_unset(client, GC_LK_ALT, NULL);
+	g_assert(LOCATION_IS_GPS_DEVICE(device));
+	p = location_gps_device_get_instance_private(device);
 
-	if (fix->fields & LOCATION_GPS_DEVICE_TRACK_SET)
-		gconf_client_set_float(client, GC_LK_TRK, fix->track, NULL);
-	else
-		gconf_client_unset(client, GC_LK_TRK, NULL);
+	clear_batch(device);
 
-	if (fix->fields & LOCATION_GPS_DEVICE_SPEED_SET)
-		gconf_client_set_float(client, GC_LK_SPD, fix->speed, NULL);
-	else
-		gconf_client_unset(client, GC_LK_SPD, NULL);
+	if (!func)
+		return;
 
-	if (fix->fields & LOCATION_GPS_DEVICE_CLIMB_SET)
-		gconf_client_set_float(client, GC_LK_CLB, fix->climb, NULL);
-	else
-		gconf_client_unset(client, GC_LK_CLB, NULL);
+	g_return_if_fail(max_fixes > 0);
 
-	g_object_unref(client);
+	p->batch = g_new(LocationGPSDeviceFix, max_fixes);
+	p->batch_len = 0;
+	p->batch_max = max_fixes;
+	p->batch_ms = max_ms;
+	p->batch_func = func;
+	p->batch_data = user_data;
+	p->batch_notify = notify;
 }
 
-int signal_changed(LocationGPSDevice *device)
+void location_gps_device_flush_batch(LocationGPSDevice *device)
 {
 	LocationGPSDevicePrivate *p;
+	guint len;
+
+	g_assert(LOCATION_IS_GPS_DEVICE(device));
 	p = location_gps_device_get_instance_private(device);
 
-	p->sig_pending = FALSE;
-	g_signal_emit(device, signals[DEVICE_CHANGED], 0);
-	g_object_unref(device);
-	return 0;
+	if (p->batch_id) {
+		remove_timeout(device, p->batch_id);
+		p->batch_id = 0;
+	}
+
+	if (!p->batch_len)
+		return;
+
+	/* reset first, so flushing from within the callback does nothing */
+	len = p->batch_len;
+	p->batch_len = 0;
+	p->batch_func(device, p->batch, len, p->batch_data);
+}
+
+void signal_geofence(guint id, LocationGeofenceTransition transition,
+		gpointer data)
+{
+	g_signal_emit(data, signals[DEVICE_GEOFENCE], 0, id, transition);
 }
 
-void add_g_timeout_interval(LocationGPSDevice *device)
+void location_gps_device_set_geofences(LocationGPSDevice *device,
+		LocationGeofenceSet *set)
 {
 	LocationGPSDevicePrivate *p;
+
+	g_assert(LOCATION_IS_GPS_DEVICE(device));
 	p = location_gps_device_get_instance_private(device);
 
-	if (!p->sig_pending) {
-		g_object_ref(device);
-		g_timeout_add(300, (GSourceFunc)signal_changed, device);
-		p->sig_pending = TRUE;
-	}
+	if (set)
+		location_geofence_set_ref(set);
+	if (p->geofences)
+		location_geofence_set_unref(p->geofences);
+
+	p->geofences = set;
 }
 
-int on_locationdaemon_signal(int unused, DBusMessage *msg, gpointer obj)
+guint location_gps_device_get_changed_fields(LocationGPSDevice *device)
 {
-	LocationGPSDevice *device;
+	LocationGPSDevicePrivate *p;
 
-	g_assert(LOCATION_IS_GPS_DEVICE(obj));
-	device = LOCATION_GPS_DEVICE(obj);
+	g_assert(LOCATION_IS_GPS_DEVICE(device));
+	p = location_gps_device_get_instance_private(device);
 
-	if (dbus_message_is_signal(msg, "org.maemo.LocationDaemon.Time",
-			"TimeChanged")) {
-		set_time(device, msg);
-		return 1;
-	}
+	return p->changed_fields;
+}
 
-	if (dbus_message_is_signal(msg, "org.maemo.LocationDaemon.Course",
-			"CourseChanged")) {
-		set_course(device, msg);
-		return 1;
-	}
+guint location_gps_device_history_foreach(LocationGPSDevice *device,
+		guint64 since, LocationGPSDeviceHistoryFunc func, gpointer user_data)
+{
+	LocationGPSDevicePrivate *p;
+	guint64 seq, first;
+	guint count = 0;
 
-	if (dbus_message_is_signal(msg, "org.maemo.LocationDaemon.Device",
-			"FixStatusChanged")) {
-		set_fix_status(device, msg);
-		return 1;
-	}
+	g_assert(LOCATION_IS_GPS_DEVICE(device));
+	p = location_gps_device_get_instance_private(device);
 
-	if (dbus_message_is_signal(msg, "org.maemo.LocationDaemon.Accuracy",
-			"AccuracyChanged")) {
-		set_accuracy(device, msg);
-		return 1;
-	}
+	if (!p->history_len || p->sequence <= since)
+		return 0;
 
-	if (dbus_message_is_signal(msg, "org.maemo.LocationDaemon.Position",
-			"PositionChanged")) {
-		set_position(device, msg);
-		return 1;
-	}
+	first = p->sequence > p->history_len ? p->sequence - p->history_len + 1 : 1;
+	if (since >= first)
+		first = since + 1;
 
-	if (dbus_message_is_signal(msg, "org.maemo.LocationDaemon.Satellite",
-			"SatellitesChanged")) {
-		set_satellites(device, msg);
-		return 1;
+	for (seq = first; seq <= p->sequence; seq++) {
+		count++;
+		if (!func(device, &p->history[(seq - 1) % p->history_len], seq,
+					user_data))
+			break;
 	}
 
-	return 1;
+	return count;
 }
 
-void location_gps_device_reset_last_known(LocationGPSDevice *device)
+void location_gps_device_get_snapshot(LocationGPSDevice *device,
+		LocationGPSDeviceSnapshot *snapshot)
 {
-	LocationGPSDeviceFix *fix = device->fix;
-	GConfClient *client;
+	LocationGPSDevicePrivate *p;
+	gint seq;
 
 	g_assert(LOCATION_IS_GPS_DEVICE(device));
-	client = gconf_client_get_default();
+	p = location_gps_device_get_instance_private(device);
 
-	device->status = LOCATION_GPS_DEVICE_STATUS_NO_FIX;
+	do {
+		while ((seq = g_atomic_int_get(&p->snapshot_seq)) & 1)
+			;
 
-	fix->mode = LOCATION_GPS_DEVICE_MODE_NOT_SEEN;
-	fix->fields = LOCATION_GPS_DEVICE_NONE_SET;
-	fix->dip = LOCATION_GPS_DEVICE_NAN;
-	fix->time = LOCATION_GPS_DEVICE_NAN;
-	fix->ept = LOCATION_GPS_DEVICE_NAN;
-	fix->latitude = LOCATION_GPS_DEVICE_NAN;
-	fix->longitude = LOCATION_GPS_DEVICE_NAN;
-	fix->eph = LOCATION_GPS_DEVICE_NAN;
-	fix->altitude = LOCATION_GPS_DEVICE_NAN;
-	fix->epv = LOCATION_GPS_DEVICE_NAN;
-	fix->track = LOCATION_GPS_DEVICE_NAN;
-	fix->epd = LOCATION_GPS_DEVICE_NAN;
-	fix->speed = LOCATION_GPS_DEVICE_NAN;
-	fix->eps = LOCATION_GPS_DEVICE_NAN;
-	fix->climb = LOCATION_GPS_DEVICE_NAN;
-	fix->epc = LOCATION_GPS_DEVICE_NAN;
-	fix->pitch = LOCATION_GPS_DEVICE_NAN;
-	fix->roll = LOCATION_GPS_DEVICE_NAN;
+		*snapshot = p->snapshot;
 
-	free_satellites(device);
-	gconf_client_recursive_unset(client, GC_LK, 0, NULL);
-	g_signal_emit(device, signals[DEVICE_CHANGED], 0);
-	g_object_unref(client);
+		/* keep the copy above from being moved past the recheck */
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	} while (seq != g_atomic_int_get(&p->snapshot_seq));
 }
 
 void location_gps_device_start(LocationGPSDevice *device)
@@ -479,50 +1813,104 @@ void location_gps_device_stop(LocationGPSDevice *device)
 
 void location_gps_device_finalize(GObject *object)
 {
-	free_satellites(LOCATION_GPS_DEVICE(object));
-	store_lastknown_in_gconf(LOCATION_GPS_DEVICE(object));
+	LocationGPSDevicePrivate *p;
+	p = location_gps_device_get_instance_private(LOCATION_GPS_DEVICE(object));
+
+	clear_satellites(LOCATION_GPS_DEVICE(object));
+	g_ptr_array_free(p->sat_view, TRUE);
+	g_ptr_array_foreach(p->sat_slabs, (GFunc)g_free, NULL);
+	g_ptr_array_free(p->sat_slabs, TRUE);
+	g_free(p->history);
+	g_mutex_clear(&p->snapshot_lock);
+
+	if (p->ctx)
+		g_main_context_unref(p->ctx);
+
+	/*
+	 * The last reference may be dropped on any thread: the cache is
+	 * written right here, GConf is left to the default main context.
+	 */
+	checkpoint_lastknown(LOCATION_GPS_DEVICE(object)->fix, TRUE);
+}
+
+void location_gps_device_constructed(GObject *object)
+{
+	/* construct properties are set now, among them the main context */
+	shared_bus_add_device(LOCATION_GPS_DEVICE(object));
+
+	G_OBJECT_CLASS(location_gps_device_parent_class)->constructed(object);
 }
 
 void location_gps_device_dispose(GObject *object)
+{
+	/* first, so the bus filter stops picking the device up */
+	shared_bus_remove_device(LOCATION_GPS_DEVICE(object));
+	clear_batch(LOCATION_GPS_DEVICE(object));
+	location_gps_device_set_geofences(LOCATION_GPS_DEVICE(object), NULL);
+	g_signal_emit(LOCATION_GPS_DEVICE(object), signals[DEVICE_DISCONNECTED], 0);
+}
+
+void location_gps_device_set_property(GObject *object,
+		guint property_id, const GValue *value, GParamSpec *pspec)
 {
 	LocationGPSDevicePrivate *p;
+	const gchar *list, *klass_type, *parent_type;
+
+	g_assert(LOCATION_IS_GPS_DEVICE(object));
 	p = location_gps_device_get_instance_private(LOCATION_GPS_DEVICE(object));
 
-	if (p->bus) {
-		dbus_bus_remove_match(p->bus,
-			"type='signal',interface='org.maemo.LocationDaemon.Device'",
-			NULL);
-		dbus_bus_remove_match(p->bus,
-			"type='signal',interface='org.maemo.LocationDaemon.Position'",
-			NULL);
-		dbus_bus_remove_match(p->bus,
-			"type='signal',interface='org.maemo.LocationDaemon.Course'",
-			NULL);
-		dbus_bus_remove_match(p->bus,
-			"type='signal',interface='org.maemo.LocationDaemon.Satellite'",
-			NULL);
-		dbus_bus_remove_match(p->bus,
-			"type='signal',interface='org.maemo.LocationDaemon.Accuracy'",
-			NULL);
-		dbus_bus_remove_match(p->bus,
-			"type='signal',interface='org.maemo.LocationDaemon.Time'",
-			NULL);
-		/* liblas & co. */
-		dbus_bus_remove_match(p->bus,
-			"type='signal',interface='com.nokia.Location.Cell'",
-			NULL);
-		dbus_bus_remove_match(p->bus,
-			"type='signal',interface='com.nokia.Location.Uncertainty",
-			NULL);
-		dbus_connection_remove_filter(p->bus,
-			(DBusHandleMessageFunction)on_locationdaemon_signal,
-			LOCATION_GPS_DEVICE(object));
-		dbus_connection_close(p->bus);
-		dbus_connection_unref(p->bus);
-		p->bus = NULL;
+	switch ((DeviceClassProperty)property_id) {
+	case HISTORY_LENGTH:
+		/* construct-only, so this is only ever set once */
+		p->history_len = g_value_get_uint(value);
+		if (p->history_len)
+			p->history = g_new(LocationGPSDeviceFix, p->history_len);
+		break;
+	case MAINCONTEXT:
+		p->ctx = g_value_get_pointer(value);
+		if (p->ctx)
+			g_main_context_ref(p->ctx);
+		break;
+	case SMOOTHING:
+		/* construct-only, the filter is only used on the device's thread */
+		p->smoothing = g_value_get_boolean(value);
+		break;
+	default:
+		list = pspec->name;
+		klass_type = g_type_name(pspec->g_type_instance.g_class->g_type);
+		parent_type = g_type_name(object->g_type_instance.g_class->g_type);
+		g_warning("invalid property id %u for \"%s\" of type `%s' in `%s'",
+				property_id, list, klass_type, parent_type);
+		break;
 	}
+}
 
-	g_signal_emit(LOCATION_GPS_DEVICE(object), signals[DEVICE_DISCONNECTED], 0);
+void location_gps_device_get_property(GObject *object,
+		guint property_id, GValue *value, GParamSpec *pspec)
+{
+	LocationGPSDevicePrivate *p;
+	const gchar *list, *klass_type, *parent_type;
+
+	g_assert(LOCATION_IS_GPS_DEVICE(object));
+	p = location_gps_device_get_instance_private(LOCATION_GPS_DEVICE(object));
+
+	switch ((DeviceClassProperty)property_id) {
+	case HISTORY_LENGTH:
+		g_value_set_uint(value, p->history_len);
+		break;
+	case MAINCONTEXT:
+		break;
+	case SMOOTHING:
+		g_value_set_boolean(value, p->smoothing);
+		break;
+	default:
+		list = pspec->name;
+		klass_type = g_type_name(pspec->g_type_instance.g_class->g_type);
+		parent_type = g_type_name(object->g_type_instance.g_class->g_type);
+		g_warning("invalid property id %u for \"%s\" of type `%s' in `%s'",
+				property_id, list, klass_type, parent_type);
+		break;
+	}
 }
 
 void location_gps_device_class_init(LocationGPSDeviceClass *klass)
@@ -531,6 +1919,9 @@ void location_gps_device_class_init(LocationGPSDeviceClass *klass)
 
 	object_class->finalize = location_gps_device_finalize;
 	object_class->dispose = location_gps_device_dispose;
+	object_class->constructed = location_gps_device_constructed;
+	object_class->set_property = location_gps_device_set_property;
+	object_class->get_property = location_gps_device_get_property;
 
 	signals[DEVICE_CHANGED] = g_signal_new("changed",
 			G_TYPE_FROM_CLASS(klass),
@@ -552,50 +1943,51 @@ void location_gps_device_class_init(LocationGPSDeviceClass *klass)
 			G_STRUCT_OFFSET(LocationGPSDeviceClass, disconnected),
 			0, NULL, g_cclosure_marshal_VOID__VOID,
 			G_TYPE_NONE, 0);
+
+	signals[DEVICE_CHANGED_FIELDS] = g_signal_new("changed-fields",
+			G_TYPE_FROM_CLASS(klass),
+			G_SIGNAL_NO_RECURSE|G_SIGNAL_RUN_FIRST,
+			0, NULL, NULL, g_cclosure_marshal_VOID__UINT,
+			G_TYPE_NONE, 1, G_TYPE_UINT);
+
+	signals[DEVICE_GEOFENCE] = g_signal_new("geofence",
+			G_TYPE_FROM_CLASS(klass),
+			G_SIGNAL_RUN_FIRST,
+			0, NULL, NULL, NULL,
+			G_TYPE_NONE, 2, G_TYPE_UINT, G_TYPE_UINT);
+
+	obj_properties[HISTORY_LENGTH] = g_param_spec_uint("history-length",
+			"History length",
+			"The number of recent fixes the device keeps.",
+			0, HISTORY_MAX, 0,
+			G_PARAM_WRITABLE|G_PARAM_READABLE|G_PARAM_CONSTRUCT_ONLY);
+
+	obj_properties[MAINCONTEXT] = g_param_spec_pointer("maincontext-pointer",
+			"The pointer to the GMainContext instance",
+			"Set the main context the device receives updates on.",
+			G_PARAM_WRITABLE|G_PARAM_CONSTRUCT_ONLY);
+
+	obj_properties[SMOOTHING] = g_param_spec_boolean("smoothing",
+			"Smoothing",
+			"Whether fixes are smoothed with a Kalman filter.",
+			FALSE,
+			G_PARAM_WRITABLE|G_PARAM_READABLE|G_PARAM_CONSTRUCT_ONLY);
+
+	g_object_class_install_properties(object_class, LAST_PROP,
+			obj_properties);
 }
 
 void location_gps_device_init(LocationGPSDevice *device)
 {
 	LocationGPSDevicePrivate *p;
 	LocationGPSDeviceFix *fix;
-	GConfClient *client;
 
 	p = location_gps_device_get_instance_private(device);
-
-	p->bus = dbus_bus_get_private(DBUS_BUS_SYSTEM, NULL);
-	dbus_connection_setup_with_g_main(p->bus, NULL);
-
-	if (p->bus) {
-		dbus_bus_add_match(p->bus,
-			"type='signal',interface='org.maemo.LocationDaemon.Device'",
-			NULL);
-		dbus_bus_add_match(p->bus,
-			"type='signal',interface='org.maemo.LocationDaemon.Position'",
-			NULL);
-		dbus_bus_add_match(p->bus,
-			"type='signal',interface='org.maemo.LocationDaemon.Course'",
-			NULL);
-		dbus_bus_add_match(p->bus,
-			"type='signal',interface='org.maemo.LocationDaemon.Satellite'",
-			NULL);
-		dbus_bus_add_match(p->bus,
-			"type='signal',interface='org.maemo.LocationDaemon.Accuracy'",
-			NULL);
-		dbus_bus_add_match(p->bus,
-			"type='signal',interface='org.maemo.LocationDaemon.Time'",
-			NULL);
-		/* liblas & co. */
-		dbus_bus_add_match(p->bus,
-			"type='signal',interface='com.nokia.Location.Cell'",
-			NULL);
-		dbus_bus_add_match(p->bus,
-			"type='signal',interface='com.nokia.Location.Uncertainty",
-			NULL);
-		dbus_connection_add_filter(p->bus,
-			(DBusHandleMessageFunction)on_locationdaemon_signal,
-			device,
-			NULL);
-	}
+	p->sat_view = g_ptr_array_sized_new(SATELLITE_SLAB);
+	p->sat_slabs = g_ptr_array_new();
+	p->raw_eph = LOCATION_GPS_DEVICE_NAN;
+	p->raw_epv = LOCATION_GPS_DEVICE_NAN;
+	g_mutex_init(&p->snapshot_lock);
 
 	g_signal_emit(device, signals[DEVICE_CONNECTED], 0);
 
@@ -615,43 +2007,22 @@ void location_gps_device_init(LocationGPSDevice *device)
 	fix->pitch = LOCATION_GPS_DEVICE_NAN;
 	fix->roll = LOCATION_GPS_DEVICE_NAN;
 	fix->dip = LOCATION_GPS_DEVICE_NAN;
+	fix->time = LOCATION_GPS_DEVICE_NAN;
+	fix->latitude = LOCATION_GPS_DEVICE_NAN;
+	fix->longitude = LOCATION_GPS_DEVICE_NAN;
+	fix->altitude = LOCATION_GPS_DEVICE_NAN;
+	fix->track = LOCATION_GPS_DEVICE_NAN;
+	fix->speed = LOCATION_GPS_DEVICE_NAN;
+	fix->climb = LOCATION_GPS_DEVICE_NAN;
 
-	client = gconf_client_get_default();
-
-	if (gconf_get_float(client, &fix->time, GC_LK_TIME))
-		fix->fields |= LOCATION_GPS_DEVICE_TIME_SET;
-	else
-		fix->time = LOCATION_GPS_DEVICE_NAN;
-
-	if (gconf_get_float(client, &fix->latitude, GC_LK_LAT)
-			&& gconf_get_float(client, &fix->longitude, GC_LK_LON)) {
-		fix->fields |= LOCATION_GPS_DEVICE_LATLONG_SET;
-	} else {
-		fix->latitude = LOCATION_GPS_DEVICE_NAN;
-		fix->longitude = LOCATION_GPS_DEVICE_NAN;
-	}
-
-	if (gconf_get_float(client, &fix->altitude, GC_LK_ALT))
-		fix->fields |= LOCATION_GPS_DEVICE_ALTITUDE_SET;
-	else
-		fix->altitude = LOCATION_GPS_DEVICE_NAN;
-
-	if (gconf_get_float(client, &fix->track, GC_LK_TRK))
-		fix->fields |= LOCATION_GPS_DEVICE_TRACK_SET;
-	else
-		fix->track = LOCATION_GPS_DEVICE_NAN;
-
-	if (gconf_get_float(client, &fix->speed, GC_LK_SPD))
-		fix->fields |= LOCATION_GPS_DEVICE_SPEED_SET;
-	else
-		fix->speed = LOCATION_GPS_DEVICE_NAN;
-
-	if (gconf_get_float(client, &fix->climb, GC_LK_CLB))
-		fix->fields |= LOCATION_GPS_DEVICE_CLIMB_SET;
-	else
-		fix->climb = LOCATION_GPS_DEVICE_NAN;
+	/*
+	 * The runtime cache is a single mapped read; GConf is only consulted
+	 * after a reboot or on first use, and then seeds the cache.
+	 */
+	if (!load_lastknown_cache(fix) && load_lastknown_gconf(fix))
+		store_lastknown_cache(fix);
 
-	g_object_unref(client);
+	publish_snapshot(device);
 
 	/*
 	if (dbus_bus_name_has_owner(p->bus, "com.nokia.Location", NULL)) {
@@ -23,6 +23,8 @@
 #include <dbus/dbus.h>
 #include <glib-object.h>
 
+#include "location-geofence.h"
+
 G_BEGIN_DECLS
 
 /**
@@ -264,11 +266,106 @@ typedef struct {
 	double dip;
 } LocationGPSDeviceFix;
 
+/**
+ * LOCATION_GPS_DEVICE_INTERVAL_IMMEDIATE:
+ *
+ * A value for the interval field of #LocationGPSDevice. The "changed"
+ * signal is emitted as soon as the main loop goes idle after an update,
+ * without waiting for the rest of the epoch. Meant for latency critical
+ * clients which can cope with more than one emission per epoch. The
+ * history, batches, snapshot and geofences still see each epoch once,
+ * when it is complete.
+ */
+#define LOCATION_GPS_DEVICE_INTERVAL_IMMEDIATE (-1)
+
+/**
+ * LOCATION_GPS_DEVICE_CHANGED_POSITION:
+ *
+ * The latitude and longitude, or whether they are known, changed.
+ */
+#define LOCATION_GPS_DEVICE_CHANGED_POSITION (1 << 0)
+
+/**
+ * LOCATION_GPS_DEVICE_CHANGED_ALTITUDE:
+ *
+ * The altitude, or whether it is known, changed.
+ */
+#define LOCATION_GPS_DEVICE_CHANGED_ALTITUDE (1 << 1)
+
+/**
+ * LOCATION_GPS_DEVICE_CHANGED_COURSE:
+ *
+ * The speed, track or climb changed.
+ */
+#define LOCATION_GPS_DEVICE_CHANGED_COURSE (1 << 2)
+
+/**
+ * LOCATION_GPS_DEVICE_CHANGED_ACCURACY:
+ *
+ * One of the uncertainty fields (ept, eph, epv, epd, eps, epc) changed.
+ */
+#define LOCATION_GPS_DEVICE_CHANGED_ACCURACY (1 << 3)
+
+/**
+ * LOCATION_GPS_DEVICE_CHANGED_TIME:
+ *
+ * The timestamp of the fix changed.
+ */
+#define LOCATION_GPS_DEVICE_CHANGED_TIME (1 << 4)
+
+/**
+ * LOCATION_GPS_DEVICE_CHANGED_MODE:
+ *
+ * The mode of the fix changed.
+ */
+#define LOCATION_GPS_DEVICE_CHANGED_MODE (1 << 5)
+
+/**
+ * LOCATION_GPS_DEVICE_CHANGED_SATELLITES:
+ *
+ * The satellites in view, or any of their details, changed.
+ */
+#define LOCATION_GPS_DEVICE_CHANGED_SATELLITES (1 << 6)
+
+/**
+ * LOCATION_GPS_DEVICE_CHANGED_ALL:
+ *
+ * All of the LOCATION_GPS_DEVICE_CHANGED_* bits.
+ */
+#define LOCATION_GPS_DEVICE_CHANGED_ALL ((1 << 7) - 1)
+
+/**
+ * LocationGPSDeviceSnapshot:
+ * @sequence: The sequence number of the epoch, see
+ * location_gps_device_get_sequence().
+ * @online: Whether there is a connection to positioning hardware.
+ * @status: The status of the device.
+ * @fix: A copy of the location fix.
+ * @satellites_in_view: Number of satellites the GPS device can see.
+ * @satellites_in_use: Number of satellites the GPS used in calculating @fix.
+ *
+ * A consistent copy of the device state as of one epoch, filled in by
+ * location_gps_device_get_snapshot().
+ */
+typedef struct {
+	guint64 sequence;
+	gboolean online;
+	LocationGPSDeviceStatus status;
+	LocationGPSDeviceFix fix;
+	int satellites_in_view;
+	int satellites_in_use;
+} LocationGPSDeviceSnapshot;
+
 typedef struct _LocationGPSDevicePrivate LocationGPSDevicePrivate;
 
 /**
  * LocationGPSDevice:
  * @online: Whether there is a connection to positioning hardware.
+ * @interval: Minimum time in milliseconds between "changed" emissions,
+ * any value works, e.g. 40 for every epoch of a 25 Hz receiver.
+ * 0 emits once per epoch as soon as it has been received, and
+ * #LOCATION_GPS_DEVICE_INTERVAL_IMMEDIATE emits without waiting for the
+ * epoch to complete.
  * @status: The status of the device.
  * @fix: The location fix.
  * @satellites_in_view: Number of satellites the GPS device can see.
@@ -278,6 +375,16 @@ typedef struct _LocationGPSDevicePrivate LocationGPSDevicePrivate;
  *
  * If the GPS has not yet obtained a fix from the device, then @fix will hold
  * the last known location.
+ *
+ * Updates are received and "changed" is emitted on the GMainContext given
+ * by the construct-only "maincontext-pointer" property, or on the default
+ * context if it is not set. The fields above must only be read from the
+ * thread running that context.
+ *
+ * When the construct-only "smoothing" property is set, @fix holds the
+ * estimate of a constant velocity Kalman filter fed by the raw updates
+ * rather than the raw values themselves, with its uncertainties in the
+ * same units; see also location_gps_device_predict().
  */
 typedef struct _LocationGPSDevice {
 	GObject parent;
@@ -304,10 +411,173 @@ typedef struct _LocationGPSDeviceClass {
 	void (* disconnected) (LocationGPSDevice *device);
 } LocationGPSDeviceClass;
 
+/**
+ * LocationGPSDeviceHistoryFunc:
+ * @device: The device the history belongs to.
+ * @fix: A fix from the history. It points into the history itself and
+ * is only valid for the duration of the call.
+ * @sequence: The sequence number of @fix.
+ * @user_data: The data passed to location_gps_device_history_foreach().
+ *
+ * Callback for location_gps_device_history_foreach().
+ *
+ * Returns: %TRUE to continue with the next fix, %FALSE to stop.
+ */
+typedef gboolean (*LocationGPSDeviceHistoryFunc) (LocationGPSDevice *device,
+		const LocationGPSDeviceFix *fix,
+		guint64 sequence,
+		gpointer user_data);
+
+/**
+ * LocationGPSDeviceBatchFunc:
+ * @device: The device the fixes come from.
+ * @fixes: The fixes of consecutive epochs, oldest first. The array belongs
+ * to the device and is only valid for the duration of the call.
+ * @n_fixes: The number of fixes in @fixes.
+ * @user_data: The data passed to location_gps_device_set_batch().
+ *
+ * Callback for location_gps_device_set_batch().
+ */
+typedef void (*LocationGPSDeviceBatchFunc) (LocationGPSDevice *device,
+		const LocationGPSDeviceFix *fixes,
+		guint n_fixes,
+		gpointer user_data);
+
 GType location_gps_device_get_type (void);
 
 void location_gps_device_reset_last_known (LocationGPSDevice *device);
 
+/**
+ * location_gps_device_get_sequence:
+ * @device: The device.
+ *
+ * Every epoch received by the device is given a sequence number, counting
+ * up from 1. 0 means no epoch has been received yet.
+ *
+ * Returns: The sequence number of the latest epoch.
+ */
+guint64 location_gps_device_get_sequence (LocationGPSDevice *device);
+
+/**
+ * location_gps_device_get_changed_fields:
+ * @device: The device.
+ *
+ * Tells what changed since the previous "changed" emission, so handlers
+ * can skip work they do not need, e.g. a map when only the satellites
+ * moved. Only meaningful from within a "changed" handler; 0 otherwise.
+ * The same mask is also passed to handlers of the "changed-fields"
+ * signal, which follows "changed" whenever the mask is not empty.
+ *
+ * Returns: A mask of LOCATION_GPS_DEVICE_CHANGED_* bits.
+ */
+guint location_gps_device_get_changed_fields (LocationGPSDevice *device);
+
+/**
+ * location_gps_device_predict:
+ * @device: The device.
+ * @t: The time to predict the fix for, in the time base of the fix time
+ * field (seconds since the epoch). 0 means now.
+ * @fix: Where to store the prediction.
+ *
+ * Extrapolates the latest fix to @t, so that e.g. a moving map can be
+ * drawn at its own frame rate between epochs. With the "smoothing"
+ * property set the state of the device's Kalman filter is used, otherwise
+ * the last fix is moved along its track at its speed. Predictions are
+ * limited to 30 seconds past the latest fix.
+ *
+ * Must be called from the thread the device receives updates on.
+ *
+ * Returns: %TRUE if @fix was extrapolated, %FALSE if there was not
+ * enough data, in which case @fix is a copy of the latest fix.
+ */
+gboolean location_gps_device_predict (LocationGPSDevice *device,
+		double t,
+		LocationGPSDeviceFix *fix);
+
+/**
+ * location_gps_device_set_batch:
+ * @device: The device.
+ * @max_fixes: Deliver once this many fixes have been collected.
+ * @max_ms: Deliver at the latest this many milliseconds after the first
+ * fix of a batch was collected, 0 for no limit.
+ * @func: The function to deliver the fixes to, %NULL to stop batching.
+ * @user_data: Data passed to @func.
+ * @notify: Called with @user_data when batching stops, or %NULL.
+ *
+ * Collects the fix of every epoch and hands them to @func in one call,
+ * for consumers such as loggers which need all fixes but not right away.
+ * Unlike "changed", which may fold several epochs into one emission,
+ * every epoch ends up in a batch. The storage for @max_fixes fixes is
+ * allocated here, so collecting never allocates.
+ *
+ * Replacing the batch callback, or disposing of @device, first delivers
+ * the fixes still pending. @func is called on the thread the device
+ * receives updates on.
+ */
+void location_gps_device_set_batch (LocationGPSDevice *device,
+		guint max_fixes,
+		guint max_ms,
+		LocationGPSDeviceBatchFunc func,
+		gpointer user_data,
+		GDestroyNotify notify);
+
+/**
+ * location_gps_device_flush_batch:
+ * @device: The device.
+ *
+ * Delivers the fixes collected so far right away, if there are any.
+ */
+void location_gps_device_flush_batch (LocationGPSDevice *device);
+
+/**
+ * location_gps_device_set_geofences:
+ * @device: The device.
+ * @set: The fences to watch, or %NULL to stop.
+ *
+ * Checks the position of every completed epoch against @set and emits
+ * "geofence" with the fence id and the #LocationGeofenceTransition for
+ * every transition. The device keeps a reference to @set. Fences may be
+ * added to and removed from @set later, from the thread the device
+ * receives updates on.
+ */
+void location_gps_device_set_geofences (LocationGPSDevice *device,
+		LocationGeofenceSet *set);
+
+/**
+ * location_gps_device_history_foreach:
+ * @device: The device.
+ * @since: Only visit fixes with a sequence number greater than this,
+ * 0 for the whole history.
+ * @func: The function to call for each fix, oldest first.
+ * @user_data: Data passed to @func.
+ *
+ * Walks the fixes of the latest epochs without copying them. The history
+ * is only kept when the device is created with a non-zero
+ * "history-length", which sets the number of epochs held. Its memory is
+ * allocated at construction, so recording a fix never allocates.
+ *
+ * Must be called from the thread the device receives updates on.
+ *
+ * Returns: The number of fixes passed to @func.
+ */
+guint location_gps_device_history_foreach (LocationGPSDevice *device,
+		guint64 since,
+		LocationGPSDeviceHistoryFunc func,
+		gpointer user_data);
+
+/**
+ * location_gps_device_get_snapshot:
+ * @device: The device.
+ * @snapshot: Where to store the copy.
+ *
+ * Copies the state of @device as of the latest completed epoch. Unlike the
+ * public fields, which change one at a time as updates arrive, the copy
+ * never mixes values from different epochs. It is taken without locking
+ * and may be called from any thread, at any rate.
+ */
+void location_gps_device_get_snapshot (LocationGPSDevice *device,
+		LocationGPSDeviceSnapshot *snapshot);
+
 /**
  * location_gps_device_start:
  * @device: the device to start.
@@ -144,14 +144,28 @@ void gpsd_shutdown(LocationGPSDControl *control)
 int gpsd_start(LocationGPSDControl *control)
 {
 	LocationGPSDControlPrivate *p;
+	gint interval;
+
 	p = location_gpsd_control_get_instance_private(control);
 	if (p->gpsd_running)
 		return 0;
 
+	interval = p->interval > 0 ? p->interval : LOCATION_INTERVAL_DEFAULT;
+
 	if (!p->location_daemon_proxy) {
 		p->location_daemon_proxy = dbus_g_proxy_new_for_name(p->dbus,
 			LOCATION_DAEMON_SERVICE, LOCATION_DAEMON_PATH,
 			LOCATION_DAEMON_SERVICE);
+		/*
+		 * "start" takes no arguments. The fix interval in ms goes in a
+		 * call of its own, ahead of it so that the receiver starts at
+		 * that rate. A daemon without set_interval answers it with an
+		 * UnknownMethod error, which is dropped, and starts at its own.
+		 */
+		dbus_g_proxy_call_no_reply(p->location_daemon_proxy,
+			"set_interval",
+			G_TYPE_INT, interval,
+			G_TYPE_INVALID);
 		dbus_g_proxy_call_no_reply(p->location_daemon_proxy, "start",
 			G_TYPE_INVALID);
 		g_object_unref(p->location_daemon_proxy);
@@ -574,8 +588,6 @@ lab96:
 lab22:
 	g_assert(LOCATION_IS_GPSD_CONTROL(control));
 
-	// interval = p->interval
-
 	if ((unsigned int)(method - 1) <= 2 || !g_strcmp0(p->device, "las")) {
 		/* TODO: What? */
 		if (!gpsd_start(control))
@@ -954,6 +966,8 @@ void location_gpsd_control_class_set_property(GObject *object,
 		break;
 	case INTERVAL:
 		p->interval = g_value_get_int(value);
+		if (p->interval > 0 && p->interval < LOCATION_INTERVAL_MIN)
+			p->interval = LOCATION_INTERVAL_MIN;
 		break;
 	case MAINCONTEXT:
 		p->ctx = g_value_get_pointer(value);
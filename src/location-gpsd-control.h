@@ -94,6 +94,9 @@ typedef gint LocationGPSDControlMethod;
 /**
  * LocationGPSDControlInterval:
  * @LOCATION_INTERVAL_DEFAULT: Default value for the system.
+ * @LOCATION_INTERVAL_100MS: 100 milliseconds between subsequent fixes.
+ * @LOCATION_INTERVAL_200MS: 200 milliseconds between subsequent fixes.
+ * @LOCATION_INTERVAL_500MS: 500 milliseconds between subsequent fixes.
  * @LOCATION_INTERVAL_1S: 1 second between subsequent fixes.
  * @LOCATION_INTERVAL_2S: 2 seconds between subsequent fixes.
  * @LOCATION_INTERVAL_5S: 5 seconds between subsequent fixes.
@@ -103,12 +106,18 @@ typedef gint LocationGPSDControlMethod;
  * @LOCATION_INTERVAL_60S: 60 seconds between subsequent fixes.
  * @LOCATION_INTERVAL_120S: 120 seconds between subsequent fixes.
  *
- * Enum representing valid values for the intervals between fixes.
- * Note that only these constants can be specified for the preferred
- * interval value.
+ * Enum representing common values for the intervals between fixes, in
+ * milliseconds. Other values are accepted for the preferred interval as
+ * well, down to #LOCATION_INTERVAL_MIN. The preferred interval is sent to
+ * location-daemon in a set_interval call just before the request to start,
+ * and sets the rate at which the receiver reports fixes. Daemons without
+ * that method keep their own rate.
  */
 typedef enum {
 	LOCATION_INTERVAL_DEFAULT = 1000,
+	LOCATION_INTERVAL_100MS = 100,
+	LOCATION_INTERVAL_200MS = 200,
+	LOCATION_INTERVAL_500MS = 500,
 	LOCATION_INTERVAL_1S = 1000,
 	LOCATION_INTERVAL_2S = 2000,
 	LOCATION_INTERVAL_5S = 5000,
@@ -119,6 +128,14 @@ typedef enum {
 	LOCATION_INTERVAL_120S = 120000,
 } LocationGPSDControlInterval;
 
+/**
+ * LOCATION_INTERVAL_MIN:
+ *
+ * The shortest preferred interval, in milliseconds, matching a 25 Hz
+ * receiver. Shorter intervals are raised to this.
+ */
+#define LOCATION_INTERVAL_MIN 40
+
 /**
  * LocationGPSDControlError:
  * @LOCATION_ERROR_USER_REJECTED_DIALOG: User rejected location enabling dialog.
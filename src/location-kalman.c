@@ -0,0 +1,279 @@
+/*
+ * Copyright (c) 2020 Ivan J. <parazyd@dyne.org>
+ *
+ * This file is part of liblocation
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "location-kalman.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define D2R (M_PI / 180.0)
+#define R2D (180.0 / M_PI)
+
+/* meters per degree of latitude */
+#define METERS_PER_DEGREE 111318.84502145034
+
+/*
+ * Spectral density of the unmodelled acceleration, (m/s^2)^2 / Hz. Large
+ * enough to follow a car turning or braking, small enough to take the
+ * jitter out of a walking fix.
+ */
+#define ACCEL_NOISE_H 4.0
+#define ACCEL_NOISE_V 1.0
+
+/* used when a measurement comes without an uncertainty */
+#define DEFAULT_POS_SIGMA 30.0
+#define DEFAULT_ALT_SIGMA 50.0
+#define DEFAULT_SPEED_SIGMA 2.0
+
+/* restart from the measurement after a gap this long (s) */
+#define MAX_GAP 30.0
+
+/* move the local frame origin once the state is this far from it (m) */
+#define MAX_OFFSET 20000.0
+
+/* function declarations */
+static void axis_init(LocationKalmanAxis *, double, double, double, double);
+static void axis_predict(const LocationKalmanAxis *, double, double,
+		LocationKalmanAxis *);
+static void axis_update_x(LocationKalmanAxis *, double, double);
+static void axis_update_v(LocationKalmanAxis *, double, double);
+static double sigma_or(double, double);
+static void reanchor(LocationKalman *);
+static double wrap_longitude(double);
+
+void axis_init(LocationKalmanAxis *a, double x, double x_var,
+		double v, double v_var)
+{
+	a->x = x;
+	a->v = v;
+	a->pxx = x_var;
+	a->pxv = 0;
+	a->pvv = v_var;
+}
+
+/* F = [1 dt; 0 1], Q from white noise acceleration of density q */
+void axis_predict(const LocationKalmanAxis *a, double dt, double q,
+		LocationKalmanAxis *out)
+{
+	double dt2 = dt * dt;
+	double dt3 = dt2 * dt;
+
+	out->x = a->x + a->v * dt;
+	out->v = a->v;
+	out->pxx = a->pxx + 2 * dt * a->pxv + dt2 * a->pvv + q * dt3 / 3;
+	out->pxv = a->pxv + dt * a->pvv + q * dt2 / 2;
+	out->pvv = a->pvv + q * dt;
+}
+
+/* scalar update with H = [1 0] */
+void axis_update_x(LocationKalmanAxis *a, double z, double r)
+{
+	double s = a->pxx + r;
+	double kx = a->pxx / s;
+	double kv = a->pxv / s;
+	double y = z - a->x;
+
+	a->x += kx * y;
+	a->v += kv * y;
+	a->pvv -= kv * a->pxv;
+	a->pxv -= kv * a->pxx;
+	a->pxx -= kx * a->pxx;
+}
+
+/* scalar update with H = [0 1] */
+void axis_update_v(LocationKalmanAxis *a, double z, double r)
+{
+	double s = a->pvv + r;
+	double kx = a->pxv / s;
+	double kv = a->pvv / s;
+	double y = z - a->v;
+
+	a->x += kx * y;
+	a->v += kv * y;
+	a->pxx -= kx * a->pxv;
+	a->pxv -= kx * a->pvv;
+	a->pvv -= kv * a->pvv;
+}
+
+double sigma_or(double sigma, double fallback)
+{
+	return isfinite(sigma) && sigma > 0 ? sigma : fallback;
+}
+
+/* keeps the flat earth approximation valid by following the state */
+void reanchor(LocationKalman *kf)
+{
+	if (fabs(kf->east.x) < MAX_OFFSET && fabs(kf->north.x) < MAX_OFFSET)
+		return;
+
+	kf->lat0 += kf->north.x / METERS_PER_DEGREE;
+	kf->lon0 += kf->east.x / kf->lon_scale;
+	kf->lon_scale = MAX(cos(kf->lat0 * D2R), 0.01) * METERS_PER_DEGREE;
+	kf->north.x = 0;
+	kf->east.x = 0;
+}
+
+double wrap_longitude(double lon)
+{
+	if (lon > 180)
+		return lon - 360;
+	if (lon < -180)
+		return lon + 360;
+	return lon;
+}
+
+void location_kalman_reset(LocationKalman *kf)
+{
+	memset(kf, 0, sizeof(*kf));
+}
+
+void location_kalman_update(LocationKalman *kf,
+		const LocationKalmanMeasurement *m)
+{
+	double pos_var, alt_var, spd_var, clb_var, vel_var, dt;
+	double ve = 0, vn = 0;
+	gboolean has_pos, has_vel, has_climb;
+
+	has_pos = isfinite(m->latitude) && isfinite(m->longitude);
+	has_vel = isfinite(m->speed) && isfinite(m->track);
+	has_climb = isfinite(m->climb);
+
+	pos_var = sigma_or(m->pos_sigma, DEFAULT_POS_SIGMA);
+	pos_var *= pos_var;
+	alt_var = sigma_or(m->alt_sigma, DEFAULT_ALT_SIGMA);
+	alt_var *= alt_var;
+	spd_var = sigma_or(m->speed_sigma, DEFAULT_SPEED_SIGMA);
+	spd_var *= spd_var;
+	clb_var = sigma_or(m->climb_sigma, DEFAULT_SPEED_SIGMA);
+	clb_var *= clb_var;
+
+	if (has_vel) {
+		ve = m->speed * sin(m->track * D2R);
+		vn = m->speed * cos(m->track * D2R);
+	}
+
+	/* without a velocity measurement, start out not knowing it at all */
+	vel_var = has_vel ? spd_var : 100.0;
+
+	dt = m->t - kf->t;
+
+	if (!kf->valid || !isfinite(dt) || dt < 0 || dt > MAX_GAP) {
+		if (!has_pos)
+			return;
+
+		kf->valid = TRUE;
+		kf->t = m->t;
+		kf->lat0 = m->latitude;
+		kf->lon0 = m->longitude;
+		kf->lon_scale = MAX(cos(kf->lat0 * D2R), 0.01) * METERS_PER_DEGREE;
+		axis_init(&kf->east, 0, pos_var, ve, vel_var);
+		axis_init(&kf->north, 0, pos_var, vn, vel_var);
+
+		kf->has_altitude = isfinite(m->altitude);
+		axis_init(&kf->up, kf->has_altitude ? m->altitude : 0, alt_var,
+				has_climb ? m->climb : 0, has_climb ? clb_var : 100.0);
+		return;
+	}
+
+	axis_predict(&kf->east, dt, ACCEL_NOISE_H, &kf->east);
+	axis_predict(&kf->north, dt, ACCEL_NOISE_H, &kf->north);
+	axis_predict(&kf->up, dt, ACCEL_NOISE_V, &kf->up);
+	kf->t = m->t;
+
+	if (has_pos) {
+		axis_update_x(&kf->east,
+				(m->longitude - kf->lon0) * kf->lon_scale, pos_var);
+		axis_update_x(&kf->north,
+				(m->latitude - kf->lat0) * METERS_PER_DEGREE, pos_var);
+	}
+
+	if (has_vel) {
+		axis_update_v(&kf->east, ve, spd_var);
+		axis_update_v(&kf->north, vn, spd_var);
+	}
+
+	if (isfinite(m->altitude)) {
+		if (kf->has_altitude) {
+			axis_update_x(&kf->up, m->altitude, alt_var);
+		} else {
+			kf->has_altitude = TRUE;
+			kf->up.x = m->altitude;
+			kf->up.pxx = alt_var;
+			kf->up.pxv = 0;
+		}
+	}
+
+	if (has_climb)
+		axis_update_v(&kf->up, m->climb, clb_var);
+
+	reanchor(kf);
+}
+
+gboolean location_kalman_predict(const LocationKalman *kf, double t,
+		LocationKalmanEstimate *est)
+{
+	LocationKalmanAxis e, n, u;
+	double dt, track;
+
+	if (!kf->valid)
+		return FALSE;
+
+	/* extrapolating further than a gap we would reset on is guessing */
+	dt = CLAMP(t - kf->t, 0, MAX_GAP);
+
+	axis_predict(&kf->east, dt, ACCEL_NOISE_H, &e);
+	axis_predict(&kf->north, dt, ACCEL_NOISE_H, &n);
+	axis_predict(&kf->up, dt, ACCEL_NOISE_V, &u);
+
+	est->latitude = kf->lat0 + n.x / METERS_PER_DEGREE;
+	est->longitude = wrap_longitude(kf->lon0 + e.x / kf->lon_scale);
+	est->pos_sigma = sqrt(e.pxx + n.pxx);
+
+	est->speed = hypot(e.v, n.v);
+	track = atan2(e.v, n.v) * R2D;
+	est->track = track < 0 ? track + 360 : track;
+
+	if (kf->has_altitude) {
+		est->altitude = u.x;
+		est->alt_sigma = sqrt(u.pxx);
+		est->climb = u.v;
+	} else {
+		est->altitude = NAN;
+		est->alt_sigma = NAN;
+		est->climb = NAN;
+	}
+
+	return TRUE;
+}
+
+/* dead reckoning along @track at @speed (m/s) for @dt seconds */
+void location_kalman_extrapolate(double latitude, double longitude,
+		double speed, double track, double dt,
+		double *latitude_out, double *longitude_out)
+{
+	double d = speed * CLAMP(dt, 0, MAX_GAP);
+
+	*latitude_out = latitude + d * cos(track * D2R) / METERS_PER_DEGREE;
+	*longitude_out = wrap_longitude(longitude + d * sin(track * D2R)
+			/ (MAX(cos(latitude * D2R), 0.01) * METERS_PER_DEGREE));
+}
@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2020 Ivan J. <parazyd@dyne.org>
+ *
+ * This file is part of liblocation
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __LOCATION_KALMAN_H__
+#define __LOCATION_KALMAN_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Internal to liblocation, not installed.
+ *
+ * A constant velocity Kalman filter over a local east/north/up frame. Each
+ * axis is filtered on its own with a [position, velocity] state; the axes
+ * are only coupled through the measurements, which keeps every step a
+ * handful of scalar operations.
+ */
+
+typedef struct {
+	double x;	/* position (m) */
+	double v;	/* velocity (m/s) */
+	double pxx;	/* covariance */
+	double pxv;
+	double pvv;
+} LocationKalmanAxis;
+
+typedef struct {
+	gboolean valid;
+	double t;		/* time of the state, as in LocationGPSDeviceFix */
+	double lat0;		/* origin of the local frame (degrees) */
+	double lon0;
+	double lon_scale;	/* meters per degree of longitude at lat0 */
+	gboolean has_altitude;
+	LocationKalmanAxis east;
+	LocationKalmanAxis north;
+	LocationKalmanAxis up;
+} LocationKalman;
+
+/*
+ * A measurement. Unknown values are NaN. Uncertainties are one sigma in
+ * meters and meters per second; NaN selects a conservative default.
+ */
+typedef struct {
+	double t;
+	double latitude;
+	double longitude;
+	double pos_sigma;
+	double altitude;
+	double alt_sigma;
+	double speed;		/* m/s */
+	double track;		/* degrees */
+	double speed_sigma;
+	double climb;		/* m/s */
+	double climb_sigma;
+} LocationKalmanMeasurement;
+
+/* The state at a point in time; unknown values are NaN. */
+typedef struct {
+	double latitude;
+	double longitude;
+	double pos_sigma;
+	double altitude;
+	double alt_sigma;
+	double speed;		/* m/s */
+	double track;		/* degrees */
+	double climb;		/* m/s */
+} LocationKalmanEstimate;
+
+void location_kalman_reset (LocationKalman *kf);
+
+void location_kalman_update (LocationKalman *kf,
+		const LocationKalmanMeasurement *m);
+
+gboolean location_kalman_predict (const LocationKalman *kf,
+		double t,
+		LocationKalmanEstimate *est);
+
+void location_kalman_extrapolate (double latitude,
+		double longitude,
+		double speed,
+		double track,
+		double dt,
+		double *latitude_out,
+		double *longitude_out);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,435 @@
+/*
+ * Copyright (c) 2020 Ivan J. <parazyd@dyne.org>
+ *
+ * This file is part of liblocation
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "location-geodesy.h"
+#include "location-kdtree.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define D2R (M_PI / 180.0)
+
+#define KDTREE_MAGIC   0x544b4c4c /* "LLKT" */
+#define KDTREE_VERSION 1
+
+/*
+ * A point as a unit vector. The nodes form an implicit balanced tree: the
+ * node at the middle of a range splits it along axis, with the nodes
+ * before it on the low side and the ones after it on the high side.
+ */
+typedef struct {
+	double v[3];
+	guint32 index;
+	guint32 axis;
+} Node;
+
+/*
+ * Layout of a saved tree: this header followed by the nodes. Bump
+ * KDTREE_VERSION on any change to either.
+ */
+typedef struct {
+	guint32 magic;
+	guint32 version;
+	guint32 n_nodes;
+	guint32 node_size;
+} FileHeader;
+
+struct _LocationKdTree {
+	const Node *nodes;
+	guint n_nodes;
+
+	/* nodes belong to one of these */
+	Node *built;
+	gpointer map;
+	gsize map_length;
+};
+
+/* the k nearest found so far, as squared chord lengths, nearest first */
+typedef struct {
+	double q[3];
+	guint k;
+	guint found;
+	guint *indices;
+	double *chords;
+} Nearest;
+
+/* the range of a within-radius query */
+typedef struct {
+	double q[3];
+	double chord;
+	guint found;
+	LocationKdTreeFunc func;
+	gpointer user_data;
+} Within;
+
+/* function declarations */
+static void to_vector(double, double, double *);
+static double chord_to_meters(double);
+static double distance2(const double *, const double *);
+static void select_nodes(Node *, gssize, gssize, gssize, guint);
+static void build(Node *, gssize, gssize);
+static void insert_nearest(Nearest *, guint, double);
+static void search_nearest(const Node *, gssize, gssize, Nearest *);
+static void search_within(const Node *, gssize, gssize, Within *);
+
+void to_vector(double latitude, double longitude, double *v)
+{
+	double lat = latitude * D2R, lon = longitude * D2R;
+
+	v[0] = cos(lat) * cos(lon);
+	v[1] = cos(lat) * sin(lon);
+	v[2] = sin(lat);
+}
+
+/* great circle distance of a squared chord of the unit sphere */
+double chord_to_meters(double chord2)
+{
+	return 2 * LOCATION_GEODESY_EARTH_RADIUS * asin(MIN(sqrt(chord2) / 2, 1));
+}
+
+double distance2(const double *a, const double *b)
+{
+	double dx = a[0] - b[0], dy = a[1] - b[1], dz = a[2] - b[2];
+
+	return dx * dx + dy * dy + dz * dz;
+}
+
+/* partially sorts [lo, hi) along axis so that nth is where it belongs */
+void select_nodes(Node *nodes, gssize lo, gssize hi, gssize nth, guint axis)
+{
+	gssize i, j;
+	double pivot;
+	Node tmp;
+
+	hi--;
+	while (lo < hi) {
+		pivot = nodes[lo + (hi - lo) / 2].v[axis];
+		i = lo;
+		j = hi;
+
+		while (i <= j) {
+			while (nodes[i].v[axis] < pivot)
+				i++;
+			while (nodes[j].v[axis] > pivot)
+				j--;
+			if (i <= j) {
+				tmp = nodes[i];
+				nodes[i++] = nodes[j];
+				nodes[j--] = tmp;
+			}
+		}
+
+		/* [lo, j] <= pivot, [i, hi] >= pivot, anything between is equal */
+		if (nth <= j)
+			hi = j;
+		else if (nth >= i)
+			lo = i;
+		else
+			return;
+	}
+}
+
+void build(Node *nodes, gssize lo, gssize hi)
+{
+	double min[3] = { 2, 2, 2 }, max[3] = { -2, -2, -2 };
+	gssize i, mid;
+	guint a, axis = 0;
+
+	if (hi - lo <= 1)
+		return;
+
+	/* split along the widest extent */
+	for (i = lo; i < hi; i++) {
+		for (a = 0; a < 3; a++) {
+			min[a] = MIN(min[a], nodes[i].v[a]);
+			max[a] = MAX(max[a], nodes[i].v[a]);
+		}
+	}
+	for (a = 1; a < 3; a++) {
+		if (max[a] - min[a] > max[axis] - min[axis])
+			axis = a;
+	}
+
+	mid = lo + (hi - lo) / 2;
+	select_nodes(nodes, lo, hi, mid, axis);
+	nodes[mid].axis = axis;
+
+	build(nodes, lo, mid);
+	build(nodes, mid + 1, hi);
+}
+
+void insert_nearest(Nearest *s, guint index, double chord2)
+{
+	guint i;
+
+	if (s->found == s->k) {
+		if (chord2 >= s->chords[s->k - 1])
+			return;
+		s->found--;
+	}
+
+	for (i = s->found; i > 0 && s->chords[i - 1] > chord2; i--) {
+		s->chords[i] = s->chords[i - 1];
+		s->indices[i] = s->indices[i - 1];
+	}
+
+	s->chords[i] = chord2;
+	s->indices[i] = index;
+	s->found++;
+}
+
+void search_nearest(const Node *nodes, gssize lo, gssize hi, Nearest *s)
+{
+	const Node *node;
+	gssize mid;
+	double diff;
+
+	if (lo >= hi)
+		return;
+
+	mid = lo + (hi - lo) / 2;
+	node = &nodes[mid];
+	insert_nearest(s, node->index, distance2(s->q, node->v));
+
+	/* the side of the split the position is on first */
+	diff = s->q[node->axis] - node->v[node->axis];
+	if (diff < 0) {
+		search_nearest(nodes, lo, mid, s);
+		if (s->found < s->k || diff * diff < s->chords[s->found - 1])
+			search_nearest(nodes, mid + 1, hi, s);
+	} else {
+		search_nearest(nodes, mid + 1, hi, s);
+		if (s->found < s->k || diff * diff < s->chords[s->found - 1])
+			search_nearest(nodes, lo, mid, s);
+	}
+}
+
+void search_within(const Node *nodes, gssize lo, gssize hi, Within *s)
+{
+	const Node *node;
+	gssize mid;
+	double diff, chord2;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		node = &nodes[mid];
+
+		chord2 = distance2(s->q, node->v);
+		if (chord2 <= s->chord * s->chord) {
+			s->found++;
+			s->func(node->index, chord_to_meters(chord2), s->user_data);
+		}
+
+		/* recurse into the side that may have points, loop on the other */
+		diff = s->q[node->axis] - node->v[node->axis];
+		if (diff >= -s->chord)
+			search_within(nodes, mid + 1, hi, s);
+		if (diff > s->chord)
+			return;
+		hi = mid;
+	}
+}
+
+LocationKdTree *location_kdtree_new(const double *latitudes,
+		const double *longitudes,
+		guint n_points)
+{
+	LocationKdTree *tree;
+	guint i;
+
+	g_return_val_if_fail(n_points == 0 || (latitudes && longitudes), NULL);
+
+	tree = g_new0(LocationKdTree, 1);
+	tree->built = g_new(Node, n_points);
+	tree->nodes = tree->built;
+	tree->n_nodes = n_points;
+
+	for (i = 0; i < n_points; i++) {
+		to_vector(latitudes[i], longitudes[i], tree->built[i].v);
+		tree->built[i].index = i;
+		tree->built[i].axis = 0;
+	}
+
+	build(tree->built, 0, n_points);
+	return tree;
+}
+
+LocationKdTree *location_kdtree_load(const gchar *path, GError **error)
+{
+	LocationKdTree *tree;
+	const FileHeader *header;
+	struct stat st;
+	gpointer map;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(errno),
+				"Could not open %s", path);
+		return NULL;
+	}
+
+	if (fstat(fd, &st) || st.st_size < (off_t)sizeof(FileHeader)) {
+		close(fd);
+		g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+				"%s is not a k-d tree", path);
+		return NULL;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (map == MAP_FAILED) {
+		g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+				"Could not map %s", path);
+		return NULL;
+	}
+
+	header = map;
+	if (header->magic != KDTREE_MAGIC || header->version != KDTREE_VERSION ||
+			header->node_size != sizeof(Node) ||
+			(guint64)st.st_size != sizeof(FileHeader) +
+			(guint64)header->n_nodes * sizeof(Node)) {
+		munmap(map, st.st_size);
+		g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+				"%s is not a k-d tree", path);
+		return NULL;
+	}
+
+	tree = g_new0(LocationKdTree, 1);
+	tree->map = map;
+	tree->map_length = st.st_size;
+	tree->nodes = (const Node *)(header + 1);
+	tree->n_nodes = header->n_nodes;
+
+	return tree;
+}
+
+gboolean location_kdtree_save(LocationKdTree *tree,
+		const gchar *path,
+		GError **error)
+{
+	FileHeader header = {
+		KDTREE_MAGIC, KDTREE_VERSION, tree->n_nodes, sizeof(Node),
+	};
+	gsize length = sizeof(header) + (gsize)tree->n_nodes * sizeof(Node);
+	gchar *data;
+	gboolean ok;
+
+	g_return_val_if_fail(tree != NULL, FALSE);
+
+	data = g_malloc(length);
+	memcpy(data, &header, sizeof(header));
+	memcpy(data + sizeof(header), tree->nodes,
+			(gsize)tree->n_nodes * sizeof(Node));
+
+	/* writes a temporary file and renames it over the old one */
+	ok = g_file_set_contents(path, data, length, error);
+
+	g_free(data);
+	return ok;
+}
+
+void location_kdtree_free(LocationKdTree *tree)
+{
+	g_return_if_fail(tree != NULL);
+
+	if (tree->map)
+		munmap(tree->map, tree->map_length);
+	g_free(tree->built);
+	g_free(tree);
+}
+
+guint location_kdtree_get_size(LocationKdTree *tree)
+{
+	g_return_val_if_fail(tree != NULL, 0);
+
+	return tree->n_nodes;
+}
+
+guint location_kdtree_nearest(LocationKdTree *tree,
+		double latitude,
+		double longitude,
+		guint k,
+		guint *indices,
+		double *distances)
+{
+	Nearest s;
+	guint i;
+
+	g_return_val_if_fail(tree != NULL, 0);
+	g_return_val_if_fail(k == 0 || indices != NULL, 0);
+
+	if (k == 0 || tree->n_nodes == 0)
+		return 0;
+
+	to_vector(latitude, longitude, s.q);
+	s.k = MIN(k, tree->n_nodes);
+	s.found = 0;
+	s.indices = indices;
+	s.chords = distances ? distances : g_new(double, s.k);
+
+	search_nearest(tree->nodes, 0, tree->n_nodes, &s);
+
+	if (distances) {
+		for (i = 0; i < s.found; i++)
+			distances[i] = chord_to_meters(distances[i]);
+	} else {
+		g_free(s.chords);
+	}
+
+	return s.found;
+}
+
+guint location_kdtree_within(LocationKdTree *tree,
+		double latitude,
+		double longitude,
+		double radius,
+		LocationKdTreeFunc func,
+		gpointer user_data)
+{
+	Within s;
+	double angle;
+
+	g_return_val_if_fail(tree != NULL, 0);
+	g_return_val_if_fail(func != NULL, 0);
+
+	if (radius < 0)
+		return 0;
+
+	/* the chord of the arc, which is all of the sphere past half way */
+	angle = radius / LOCATION_GEODESY_EARTH_RADIUS;
+	to_vector(latitude, longitude, s.q);
+	s.chord = angle >= M_PI ? 2 : 2 * sin(angle / 2);
+	s.found = 0;
+	s.func = func;
+	s.user_data = user_data;
+
+	search_within(tree->nodes, 0, tree->n_nodes, &s);
+	return s.found;
+}
@@ -0,0 +1,155 @@
+/*
+ * Copyright (c) 2020 Ivan J. <parazyd@dyne.org>
+ *
+ * This file is part of liblocation
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __LOCATION_KDTREE_H__
+#define __LOCATION_KDTREE_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/**
+ * LocationKdTree:
+ *
+ * A static spatial index over a set of points, such as points of interest,
+ * for finding the ones nearest to a position. Points are stored as unit
+ * vectors in a balanced k-d tree laid out in a single flat array, so
+ * queries work the same everywhere on the globe, including across the
+ * 180th meridian and near the poles. Distances are great circle distances
+ * in meters, matching #LOCATION_GEODESY_HAVERSINE.
+ *
+ * A tree can not be changed once built, but it can be saved to a file and
+ * mapped back into memory without any parsing.
+ */
+typedef struct _LocationKdTree LocationKdTree;
+
+/**
+ * LocationKdTreeFunc:
+ * @index: The index of the point in the arrays the tree was built from.
+ * @distance: Distance to the point in meters.
+ * @user_data: The data passed to location_kdtree_within().
+ *
+ * Callback for location_kdtree_within().
+ */
+typedef void (*LocationKdTreeFunc) (guint index,
+		double distance,
+		gpointer user_data);
+
+/**
+ * location_kdtree_new:
+ * @latitudes: Latitudes of the points (degrees).
+ * @longitudes: Longitudes of the points (degrees).
+ * @n_points: The number of points.
+ *
+ * Builds a tree over the points in O(n log n) time. Queries report points
+ * by their index in @latitudes and @longitudes.
+ *
+ * Returns: The tree.
+ */
+LocationKdTree *location_kdtree_new (const double *latitudes,
+		const double *longitudes,
+		guint n_points);
+
+/**
+ * location_kdtree_load:
+ * @path: A file written by location_kdtree_save().
+ * @error: Return location for an error, or %NULL.
+ *
+ * Maps a saved tree into memory. The file is used as it is, so loading
+ * takes the same time whatever its size and its pages are shared with
+ * every other process that has it loaded. Files are only readable on
+ * machines with the same byte order as the one they were saved on.
+ *
+ * Returns: The tree, or %NULL if @path is not a readable tree.
+ */
+LocationKdTree *location_kdtree_load (const gchar *path,
+		GError **error);
+
+/**
+ * location_kdtree_save:
+ * @tree: The tree.
+ * @path: The file to write. It is replaced atomically if it exists.
+ * @error: Return location for an error, or %NULL.
+ *
+ * Returns: %TRUE on success.
+ */
+gboolean location_kdtree_save (LocationKdTree *tree,
+		const gchar *path,
+		GError **error);
+
+/**
+ * location_kdtree_free:
+ * @tree: The tree.
+ */
+void location_kdtree_free (LocationKdTree *tree);
+
+/**
+ * location_kdtree_get_size:
+ * @tree: The tree.
+ *
+ * Returns: The number of points in @tree.
+ */
+guint location_kdtree_get_size (LocationKdTree *tree);
+
+/**
+ * location_kdtree_nearest:
+ * @tree: The tree.
+ * @latitude: Latitude of the position (degrees).
+ * @longitude: Longitude of the position (degrees).
+ * @k: The number of points to find.
+ * @indices: (out): At least @k elements for the indices of the points
+ * found, nearest first.
+ * @distances: (out) (optional): At least @k elements for the distances
+ * to the points found in meters, or %NULL.
+ *
+ * Finds the @k points nearest to a position.
+ *
+ * Returns: The number of points found, which is less than @k only if the
+ * tree has fewer points.
+ */
+guint location_kdtree_nearest (LocationKdTree *tree,
+		double latitude,
+		double longitude,
+		guint k,
+		guint *indices,
+		double *distances);
+
+/**
+ * location_kdtree_within:
+ * @tree: The tree.
+ * @latitude: Latitude of the position (degrees).
+ * @longitude: Longitude of the position (degrees).
+ * @radius: Distance from the position in meters.
+ * @func: Called for every point within @radius, in no particular order.
+ * @user_data: Data to pass to @func.
+ *
+ * Finds the points within a distance of a position.
+ *
+ * Returns: The number of points found.
+ */
+guint location_kdtree_within (LocationKdTree *tree,
+		double latitude,
+		double longitude,
+		double radius,
+		LocationKdTreeFunc func,
+		gpointer user_data);
+
+G_END_DECLS
+
+#endif
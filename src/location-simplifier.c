@@ -0,0 +1,186 @@
+/*
+ * Copyright (c) 2020 Ivan J. <parazyd@dyne.org>
+ *
+ * This file is part of liblocation
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+
+#include "location-distance-utils.h"
+#include "location-simplifier.h"
+
+/* meters per degree of latitude */
+#define METERS_PER_DEGREE 111318.84502145034
+
+/* a fix held back, with its position in meters east and north of the anchor */
+typedef struct {
+	LocationGPSDeviceFix fix;
+	double x, y;
+} WindowFix;
+
+struct _LocationSimplifier {
+	double tolerance;
+	guint max_window;
+	LocationSimplifierFunc func;
+	gpointer user_data;
+
+	gboolean anchored;
+	LocationDistanceOrigin anchor;
+	GArray *window;
+
+	guint n_in;
+	guint n_out;
+};
+
+/* function declarations */
+static void project(const LocationSimplifier *, WindowFix *);
+static double segment_distance(const WindowFix *, const WindowFix *);
+static gboolean fits(const LocationSimplifier *, const WindowFix *);
+static void keep(LocationSimplifier *, const LocationGPSDeviceFix *);
+
+void project(const LocationSimplifier *s, WindowFix *w)
+{
+	double dlon = fmod(w->fix.longitude - s->anchor.longitude + 540, 360) - 180;
+
+	w->x = dlon * s->anchor.lng_scale * METERS_PER_DEGREE;
+	w->y = (w->fix.latitude - s->anchor.latitude) * METERS_PER_DEGREE;
+}
+
+/* distance from w to the segment from the anchor to end */
+double segment_distance(const WindowFix *w, const WindowFix *end)
+{
+	double len2 = end->x * end->x + end->y * end->y;
+	double t = 0;
+
+	if (len2 > 0)
+		t = CLAMP((w->x * end->x + w->y * end->y) / len2, 0, 1);
+
+	return hypot(w->x - t * end->x, w->y - t * end->y);
+}
+
+/* whether every fix in the window stays within tolerance of anchor - end */
+gboolean fits(const LocationSimplifier *s, const WindowFix *end)
+{
+	guint i;
+
+	for (i = 0; i < s->window->len; i++) {
+		if (segment_distance(&g_array_index(s->window, WindowFix, i), end)
+				> s->tolerance)
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+void keep(LocationSimplifier *s, const LocationGPSDeviceFix *fix)
+{
+	location_distance_origin_init(&s->anchor, fix->latitude, fix->longitude);
+	s->anchored = TRUE;
+	s->n_out++;
+	s->func(fix, s->user_data);
+}
+
+LocationSimplifier *location_simplifier_new(double tolerance,
+		guint max_window,
+		LocationSimplifierFunc func,
+		gpointer user_data)
+{
+	LocationSimplifier *s;
+
+	g_return_val_if_fail(func != NULL, NULL);
+
+	s = g_new0(LocationSimplifier, 1);
+	s->tolerance = MAX(tolerance, 0);
+	s->max_window = MAX(max_window, 2);
+	s->func = func;
+	s->user_data = user_data;
+	s->window = g_array_sized_new(FALSE, FALSE, sizeof(WindowFix),
+			s->max_window);
+
+	return s;
+}
+
+void location_simplifier_free(LocationSimplifier *s)
+{
+	g_return_if_fail(s != NULL);
+
+	g_array_free(s->window, TRUE);
+	g_free(s);
+}
+
+void location_simplifier_add_fix(LocationSimplifier *s,
+		const LocationGPSDeviceFix *fix)
+{
+	WindowFix w;
+
+	g_return_if_fail(s != NULL);
+	g_return_if_fail(fix != NULL);
+
+	if (!(fix->fields & LOCATION_GPS_DEVICE_LATLONG_SET) ||
+			isnan(fix->latitude) || isnan(fix->longitude))
+		return;
+
+	s->n_in++;
+
+	if (!s->anchored) {
+		keep(s, fix);
+		return;
+	}
+
+	w.fix = *fix;
+	project(s, &w);
+
+	if (s->window->len && (s->window->len == s->max_window || !fits(s, &w))) {
+		/* keep the last fix that fit, and start over from it */
+		keep(s, &g_array_index(s->window, WindowFix,
+					s->window->len - 1).fix);
+		g_array_set_size(s->window, 0);
+		project(s, &w);
+	}
+
+	g_array_append_val(s->window, w);
+}
+
+void location_simplifier_flush(LocationSimplifier *s)
+{
+	g_return_if_fail(s != NULL);
+
+	if (!s->window->len)
+		return;
+
+	keep(s, &g_array_index(s->window, WindowFix, s->window->len - 1).fix);
+	g_array_set_size(s->window, 0);
+}
+
+void location_simplifier_reset(LocationSimplifier *s)
+{
+	g_return_if_fail(s != NULL);
+
+	s->anchored = FALSE;
+	g_array_set_size(s->window, 0);
+}
+
+void location_simplifier_get_counts(LocationSimplifier *s,
+		guint *n_in,
+		guint *n_out)
+{
+	g_return_if_fail(s != NULL);
+
+	if (n_in)
+		*n_in = s->n_in;
+	if (n_out)
+		*n_out = s->n_out;
+}
@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2020 Ivan J. <parazyd@dyne.org>
+ *
+ * This file is part of liblocation
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __LOCATION_SIMPLIFIER_H__
+#define __LOCATION_SIMPLIFIER_H__
+
+#include <glib.h>
+
+#include "location-gps-device.h"
+
+G_BEGIN_DECLS
+
+/**
+ * LocationSimplifier:
+ *
+ * Thins a track while it is being recorded. Fixes are fed one at a time
+ * and only the ones needed to keep every dropped fix within a tolerance
+ * of the simplified track are passed on.
+ */
+typedef struct _LocationSimplifier LocationSimplifier;
+
+/**
+ * LocationSimplifierFunc:
+ * @fix: A fix of the simplified track. It is only valid for the duration
+ * of the call.
+ * @user_data: The data passed to location_simplifier_new().
+ *
+ * Callback for the fixes a #LocationSimplifier keeps.
+ */
+typedef void (*LocationSimplifierFunc) (const LocationGPSDeviceFix *fix,
+		gpointer user_data);
+
+/**
+ * location_simplifier_new:
+ * @tolerance: Largest distance in meters allowed between a dropped fix
+ * and the simplified track.
+ * @max_window: Largest number of fixes held back at a time, at least 2.
+ * When the window fills up a fix is kept even if it could be dropped,
+ * which bounds both memory and the delay before a fix is passed on.
+ * @func: Called with every fix that is kept, in order.
+ * @user_data: Data to pass to @func.
+ *
+ * Creates a simplifier using the sliding window algorithm, a streaming
+ * form of Douglas-Peucker: the last kept fix anchors a segment that is
+ * stretched to each new fix for as long as all fixes in between stay
+ * within @tolerance of it. When a new fix does not fit, the previous one
+ * is kept and becomes the next anchor. So a fix is passed on one fix
+ * late, or when location_simplifier_flush() is called.
+ *
+ * Distances are measured on the equirectangular projection around the
+ * anchor used by location_distance_between(), which is accurate for the
+ * short segments of a track.
+ *
+ * Returns: A new simplifier.
+ */
+LocationSimplifier *location_simplifier_new (double tolerance,
+		guint max_window,
+		LocationSimplifierFunc func,
+		gpointer user_data);
+
+/**
+ * location_simplifier_free:
+ * @simplifier: The simplifier.
+ *
+ * Frees @simplifier without passing on the fixes it holds back. Call
+ * location_simplifier_flush() first to keep the end of the track.
+ */
+void location_simplifier_free (LocationSimplifier *simplifier);
+
+/**
+ * location_simplifier_add_fix:
+ * @simplifier: The simplifier.
+ * @fix: The next fix of the track.
+ *
+ * Feeds a fix, typically from the "changed" handler of a
+ * #LocationGPSDevice. Fixes without #LOCATION_GPS_DEVICE_LATLONG_SET are
+ * ignored. The first fix is always kept.
+ */
+void location_simplifier_add_fix (LocationSimplifier *simplifier,
+		const LocationGPSDeviceFix *fix);
+
+/**
+ * location_simplifier_flush:
+ * @simplifier: The simplifier.
+ *
+ * Keeps the last fix fed, if it has not been passed on yet, so that the
+ * simplified track ends where the track does. Fixes fed afterwards
+ * continue the same track.
+ */
+void location_simplifier_flush (LocationSimplifier *simplifier);
+
+/**
+ * location_simplifier_reset:
+ * @simplifier: The simplifier.
+ *
+ * Drops the fixes held back and starts a new track, whose first fix will
+ * be kept. Use it when the track is interrupted, such as after the fix
+ * was lost.
+ */
+void location_simplifier_reset (LocationSimplifier *simplifier);
+
+/**
+ * location_simplifier_get_counts:
+ * @simplifier: The simplifier.
+ * @n_in: (out) (optional): Number of fixes fed so far.
+ * @n_out: (out) (optional): Number of fixes kept so far.
+ */
+void location_simplifier_get_counts (LocationSimplifier *simplifier,
+		guint *n_in,
+		guint *n_out);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,576 @@
+/*
+ * Copyright (c) 2020 Ivan J. <parazyd@dyne.org>
+ *
+ * This file is part of liblocation
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "location-gps-device.h"
+#include "location-gps-device-private.h"
+#include "location-trace.h"
+
+/*
+ * A trace is a file header followed by records, all in host byte order:
+ *
+ *   header:  guint32 magic, guint32 version
+ *   record:  guint32 dt, guint8 type, guint8 reserved, guint16 length,
+ *            then length bytes of payload
+ *
+ * dt is the time in microseconds since the previous record, type is a
+ * DaemonSignalType and the payload holds the values of the signal as
+ * doubles, in the order of the DaemonSignal fields. FixStatus is a single
+ * byte; SatellitesChanged is a guint16 count followed by one
+ * TRACE_SATELLITE_SIZE entry per satellite (gint16 prn, guint8 in_use,
+ * a padding byte, then elevation, azimuth and signal strength). Records
+ * are only ever appended and each is flushed as it is written, so a trace
+ * cut short by a crash of the recording process is still valid up to its
+ * last complete record.
+ */
+#define TRACE_MAGIC 0x52544c4c /* "LLTR" */
+#define TRACE_VERSION 1
+#define TRACE_HEADER_SIZE 8
+#define TRACE_RECORD_SIZE 8
+#define TRACE_SATELLITE_SIZE 28
+
+/* virtual time of the first record; 0 means "never" to the device */
+#define TRACE_START G_USEC_PER_SEC
+
+typedef struct {
+	guint32 dt;
+	guint8 type;
+	guint8 reserved;
+	guint16 length;
+} TraceRecord;
+
+typedef struct {
+	gint64 due;
+	guint id;
+	GSourceFunc func;
+	gpointer data;
+} ClockTimer;
+
+struct _LocationTraceRecorder {
+	GMutex lock;
+	FILE *file;
+	gint64 last;
+	GByteArray *buf;
+};
+
+struct _LocationTracePlayer {
+	LocationGPSDevice *device;
+	LocationVirtualClock *clock;
+	gchar *data;
+	gsize length;
+	gsize pos;
+	gint64 next_at;		/* virtual time of the record at pos */
+	gboolean has_next;
+	guint count;
+	double speed;
+	gint64 virtual_start;
+	gint64 real_start;
+	GSource *source;
+	GArray *satellites;
+};
+
+/* function declarations */
+static void put(GByteArray *, const void *, gsize);
+static void encode_signal(GByteArray *, const DaemonSignal *);
+static void record_signal(const DaemonSignal *, gpointer);
+static gboolean decode_signal(LocationTracePlayer *, const TraceRecord *,
+		const guint8 *, DaemonSignal *);
+static void peek_record(LocationTracePlayer *);
+static void play_record(LocationTracePlayer *);
+static void play_until(LocationTracePlayer *, gint64);
+static gint64 next_event(LocationTracePlayer *);
+static void schedule_tick(LocationTracePlayer *, gint64);
+static gboolean player_tick(gpointer);
+
+LocationVirtualClock *location_virtual_clock_new(gint64 now)
+{
+	LocationVirtualClock *clock = g_new0(LocationVirtualClock, 1);
+
+	clock->now = now;
+	clock->timers = g_array_new(FALSE, FALSE, sizeof(ClockTimer));
+	return clock;
+}
+
+void location_virtual_clock_free(LocationVirtualClock *clock)
+{
+	g_array_free(clock->timers, TRUE);
+	g_free(clock);
+}
+
+guint location_virtual_clock_add(LocationVirtualClock *clock, guint ms,
+		GSourceFunc func, gpointer data)
+{
+	ClockTimer timer;
+
+	timer.due = clock->now + ms * 1000LL;
+	timer.id = ++clock->last_id;
+	timer.func = func;
+	timer.data = data;
+	g_array_append_val(clock->timers, timer);
+
+	return timer.id;
+}
+
+void location_virtual_clock_remove(LocationVirtualClock *clock, guint id)
+{
+	guint i;
+
+	for (i = 0; i < clock->timers->len; i++) {
+		if (g_array_index(clock->timers, ClockTimer, i).id == id) {
+			g_array_remove_index(clock->timers, i);
+			return;
+		}
+	}
+}
+
+gint64 location_virtual_clock_next_due(LocationVirtualClock *clock)
+{
+	gint64 due = G_MAXINT64;
+	guint i;
+
+	/* a device has at most two timeouts pending, a scan is fine */
+	for (i = 0; i < clock->timers->len; i++)
+		due = MIN(due, g_array_index(clock->timers, ClockTimer, i).due);
+
+	return due;
+}
+
+/* runs the timers due up to @to in order, then sets the clock to @to */
+void location_virtual_clock_advance(LocationVirtualClock *clock, gint64 to)
+{
+	ClockTimer timer;
+	guint i, first;
+
+	while (clock->timers->len) {
+		first = 0;
+		for (i = 1; i < clock->timers->len; i++)
+			if (g_array_index(clock->timers, ClockTimer, i).due
+					< g_array_index(clock->timers, ClockTimer, first).due)
+				first = i;
+
+		timer = g_array_index(clock->timers, ClockTimer, first);
+		if (timer.due > to)
+			break;
+
+		g_array_remove_index(clock->timers, first);
+		clock->now = MAX(clock->now, timer.due);
+		timer.func(timer.data);
+	}
+
+	clock->now = MAX(clock->now, to);
+}
+
+void put(GByteArray *buf, const void *data, gsize size)
+{
+	g_byte_array_append(buf, data, size);
+}
+
+void encode_signal(GByteArray *buf, const DaemonSignal *sig)
+{
+	const LocationGPSDeviceSatellite *sat;
+	guint8 in_use, pad = 0;
+	guint16 count;
+	guint i;
+
+	switch (sig->type) {
+	case DAEMON_SIGNAL_TIME:
+		put(buf, &sig->time, sizeof(double));
+		break;
+	case DAEMON_SIGNAL_POSITION:
+		put(buf, &sig->position.latitude, sizeof(double));
+		put(buf, &sig->position.longitude, sizeof(double));
+		put(buf, &sig->position.altitude, sizeof(double));
+		break;
+	case DAEMON_SIGNAL_COURSE:
+		put(buf, &sig->course.speed, sizeof(double));
+		put(buf, &sig->course.track, sizeof(double));
+		put(buf, &sig->course.climb, sizeof(double));
+		break;
+	case DAEMON_SIGNAL_ACCURACY:
+		put(buf, &sig->accuracy.ept, sizeof(double));
+		put(buf, &sig->accuracy.epv, sizeof(double));
+		put(buf, &sig->accuracy.epd, sizeof(double));
+		put(buf, &sig->accuracy.eps, sizeof(double));
+		put(buf, &sig->accuracy.epc, sizeof(double));
+		put(buf, &sig->accuracy.eph, sizeof(double));
+		break;
+	case DAEMON_SIGNAL_FIX_STATUS:
+		put(buf, &sig->mode, sizeof(guint8));
+		break;
+	case DAEMON_SIGNAL_SATELLITES:
+		count = MIN(sig->satellites->len, G_MAXUINT16);
+		put(buf, &count, sizeof(count));
+		for (i = 0; i < count; i++) {
+			sat = &g_array_index(sig->satellites,
+					LocationGPSDeviceSatellite, i);
+			in_use = sat->in_use ? 1 : 0;
+			put(buf, &sat->prn, sizeof(gint16));
+			put(buf, &in_use, sizeof(in_use));
+			put(buf, &pad, sizeof(pad));
+			put(buf, &sat->elevation, sizeof(double));
+			put(buf, &sat->azimuth, sizeof(double));
+			put(buf, &sat->signal_strength, sizeof(double));
+		}
+		break;
+	}
+}
+
+void record_signal(const DaemonSignal *sig, gpointer user_data)
+{
+	LocationTraceRecorder *recorder = user_data;
+	TraceRecord rec;
+	gint64 now;
+
+	g_mutex_lock(&recorder->lock);
+
+	now = g_get_monotonic_time();
+	rec.dt = recorder->last ? MIN(now - recorder->last, G_MAXUINT32) : 0;
+	rec.type = sig->type;
+	rec.reserved = 0;
+	recorder->last = now;
+
+	g_byte_array_set_size(recorder->buf, TRACE_RECORD_SIZE);
+	encode_signal(recorder->buf, sig);
+	rec.length = recorder->buf->len - TRACE_RECORD_SIZE;
+
+	memcpy(recorder->buf->data, &rec.dt, 4);
+	memcpy(recorder->buf->data + 4, &rec.type, 1);
+	memcpy(recorder->buf->data + 5, &rec.reserved, 1);
+	memcpy(recorder->buf->data + 6, &rec.length, 2);
+
+	if (fwrite(recorder->buf->data, recorder->buf->len, 1,
+				recorder->file) != 1 || fflush(recorder->file))
+		g_warning("%s: could not write trace record", G_STRFUNC);
+
+	g_mutex_unlock(&recorder->lock);
+}
+
+LocationTraceRecorder *location_trace_recorder_new(const gchar *path,
+		GError **error)
+{
+	LocationTraceRecorder *recorder;
+	guint32 header[2] = { TRACE_MAGIC, TRACE_VERSION };
+	FILE *file;
+
+	file = fopen(path, "wb");
+	if (!file || fwrite(header, sizeof(header), 1, file) != 1) {
+		g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+				"Could not write trace %s", path);
+		if (file)
+			fclose(file);
+		return NULL;
+	}
+
+	recorder = g_new0(LocationTraceRecorder, 1);
+	g_mutex_init(&recorder->lock);
+	recorder->file = file;
+	recorder->buf = g_byte_array_new();
+
+	location_gps_device_add_tap(record_signal, recorder);
+	return recorder;
+}
+
+void location_trace_recorder_free(LocationTraceRecorder *recorder)
+{
+	/* no record_signal() call is running once this returns */
+	location_gps_device_remove_tap(record_signal, recorder);
+
+	fclose(recorder->file);
+	g_byte_array_free(recorder->buf, TRUE);
+	g_mutex_clear(&recorder->lock);
+	g_free(recorder);
+}
+
+gboolean decode_signal(LocationTracePlayer *player, const TraceRecord *rec,
+		const guint8 *p, DaemonSignal *sig)
+{
+	LocationGPSDeviceSatellite sat;
+	guint16 count;
+	guint8 in_use;
+	guint i;
+
+	sig->type = rec->type;
+
+	switch (sig->type) {
+	case DAEMON_SIGNAL_TIME:
+		if (rec->length != sizeof(double))
+			return FALSE;
+		memcpy(&sig->time, p, sizeof(double));
+		return TRUE;
+	case DAEMON_SIGNAL_POSITION:
+		if (rec->length != 3 * sizeof(double))
+			return FALSE;
+		memcpy(&sig->position.latitude, p, sizeof(double));
+		memcpy(&sig->position.longitude, p + 8, sizeof(double));
+		memcpy(&sig->position.altitude, p + 16, sizeof(double));
+		return TRUE;
+	case DAEMON_SIGNAL_COURSE:
+		if (rec->length != 3 * sizeof(double))
+			return FALSE;
+		memcpy(&sig->course.speed, p, sizeof(double));
+		memcpy(&sig->course.track, p + 8, sizeof(double));
+		memcpy(&sig->course.climb, p + 16, sizeof(double));
+		return TRUE;
+	case DAEMON_SIGNAL_ACCURACY:
+		if (rec->length != 6 * sizeof(double))
+			return FALSE;
+		memcpy(&sig->accuracy.ept, p, sizeof(double));
+		memcpy(&sig->accuracy.epv, p + 8, sizeof(double));
+		memcpy(&sig->accuracy.epd, p + 16, sizeof(double));
+		memcpy(&sig->accuracy.eps, p + 24, sizeof(double));
+		memcpy(&sig->accuracy.epc, p + 32, sizeof(double));
+		memcpy(&sig->accuracy.eph, p + 40, sizeof(double));
+		return TRUE;
+	case DAEMON_SIGNAL_FIX_STATUS:
+		if (rec->length != 1)
+			return FALSE;
+		sig->mode = *p;
+		return TRUE;
+	case DAEMON_SIGNAL_SATELLITES:
+		if (rec->length < sizeof(count))
+			return FALSE;
+		memcpy(&count, p, sizeof(count));
+		if (rec->length != sizeof(count) + count * TRACE_SATELLITE_SIZE)
+			return FALSE;
+
+		g_array_set_size(player->satellites, 0);
+		for (i = 0, p += sizeof(count); i < count; i++) {
+			memcpy(&sat.prn, p, sizeof(gint16));
+			memcpy(&in_use, p + 2, sizeof(in_use));
+			sat.in_use = in_use;
+			memcpy(&sat.elevation, p + 4, sizeof(double));
+			memcpy(&sat.azimuth, p + 12, sizeof(double));
+			memcpy(&sat.signal_strength, p + 20, sizeof(double));
+			g_array_append_val(player->satellites, sat);
+			p += TRACE_SATELLITE_SIZE;
+		}
+
+		sig->satellites = player->satellites;
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
+/* looks at the record at pos and works out when it is due */
+void peek_record(LocationTracePlayer *player)
+{
+	guint32 dt;
+	guint16 length;
+
+	player->has_next = FALSE;
+
+	if (player->length - player->pos < TRACE_RECORD_SIZE)
+		return;
+
+	memcpy(&dt, player->data + player->pos, 4);
+	memcpy(&length, player->data + player->pos + 6, 2);
+
+	if (player->length - player->pos - TRACE_RECORD_SIZE < length) {
+		g_warning("%s: trace ends in a partial record", G_STRFUNC);
+		return;
+	}
+
+	player->has_next = TRUE;
+	player->next_at += dt;
+}
+
+void play_record(LocationTracePlayer *player)
+{
+	const guint8 *p = (const guint8 *)player->data + player->pos;
+	DaemonSignal sig;
+	TraceRecord rec;
+
+	memcpy(&rec.dt, p, 4);
+	rec.type = p[4];
+	rec.reserved = p[5];
+	memcpy(&rec.length, p + 6, 2);
+
+	player->pos += TRACE_RECORD_SIZE + rec.length;
+
+	if (decode_signal(player, &rec, p + TRACE_RECORD_SIZE, &sig)) {
+		location_gps_device_apply_signal(player->device, &sig);
+		player->count++;
+	} else {
+		g_warning("%s: skipping malformed record of type %u",
+				G_STRFUNC, rec.type);
+	}
+
+	peek_record(player);
+}
+
+/* the virtual time of the next record or device timeout */
+gint64 next_event(LocationTracePlayer *player)
+{
+	gint64 due = location_virtual_clock_next_due(player->clock);
+
+	if (player->has_next)
+		due = MIN(due, player->next_at);
+
+	return due;
+}
+
+/*
+ * Plays everything due up to @limit. Device timeouts due at the same
+ * time as a record run first, as they were armed before it arrived.
+ */
+void play_until(LocationTracePlayer *player, gint64 limit)
+{
+	gint64 next;
+
+	while ((next = next_event(player)) != G_MAXINT64 && next <= limit) {
+		location_virtual_clock_advance(player->clock, next);
+
+		if (player->has_next && player->next_at == next
+				&& location_virtual_clock_next_due(player->clock) > next)
+			play_record(player);
+	}
+}
+
+void schedule_tick(LocationTracePlayer *player, gint64 now)
+{
+	gint64 next = next_event(player);
+	gint64 wait;
+
+	if (next == G_MAXINT64)
+		return;
+
+	wait = (next - now) / player->speed / 1000;
+
+	player->source = g_timeout_source_new(CLAMP(wait, 0, G_MAXUINT));
+	g_source_set_callback(player->source, player_tick, player, NULL);
+	g_source_attach(player->source,
+			location_gps_device_get_context(player->device));
+}
+
+gboolean player_tick(gpointer data)
+{
+	LocationTracePlayer *player = data;
+	gint64 now;
+
+	g_source_unref(player->source);
+	player->source = NULL;
+
+	now = player->virtual_start + (g_get_monotonic_time()
+			- player->real_start) * player->speed;
+
+	play_until(player, now);
+	schedule_tick(player, now);
+	return FALSE;
+}
+
+LocationTracePlayer *location_trace_player_new(LocationGPSDevice *device,
+		const gchar *path, GError **error)
+{
+	LocationTracePlayer *player;
+	guint32 header[2];
+	gchar *data;
+	gsize length;
+
+	if (!g_file_get_contents(path, &data, &length, error))
+		return NULL;
+
+	if (length >= TRACE_HEADER_SIZE)
+		memcpy(header, data, TRACE_HEADER_SIZE);
+
+	if (length < TRACE_HEADER_SIZE || header[0] != TRACE_MAGIC
+			|| header[1] != TRACE_VERSION) {
+		g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+				"%s is not a version %d trace", path,
+				TRACE_VERSION);
+		g_free(data);
+		return NULL;
+	}
+
+	player = g_new0(LocationTracePlayer, 1);
+	player->device = g_object_ref(device);
+	player->clock = location_virtual_clock_new(TRACE_START);
+	player->data = data;
+	player->length = length;
+	player->pos = TRACE_HEADER_SIZE;
+	player->next_at = TRACE_START;
+	player->satellites = g_array_new(FALSE, FALSE,
+			sizeof(LocationGPSDeviceSatellite));
+
+	if (!location_gps_device_set_clock(device, player->clock)) {
+		g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_AGAIN,
+				"The device has updates pending, "
+				"try again once it is idle");
+		location_virtual_clock_free(player->clock);
+		g_object_unref(player->device);
+		g_array_free(player->satellites, TRUE);
+		g_free(player->data);
+		g_free(player);
+		return NULL;
+	}
+
+	peek_record(player);
+	return player;
+}
+
+void location_trace_player_play(LocationTracePlayer *player, double speed)
+{
+	g_return_if_fail(player->source == NULL);
+
+	if (speed <= 0) {
+		play_until(player, G_MAXINT64);
+		return;
+	}
+
+	player->speed = speed;
+	player->virtual_start = player->clock->now;
+	player->real_start = g_get_monotonic_time();
+	schedule_tick(player, player->virtual_start);
+}
+
+gboolean location_trace_player_is_done(LocationTracePlayer *player)
+{
+	return next_event(player) == G_MAXINT64;
+}
+
+guint location_trace_player_get_count(LocationTracePlayer *player)
+{
+	return player->count;
+}
+
+void location_trace_player_free(LocationTracePlayer *player)
+{
+	gint64 due;
+
+	if (player->source) {
+		g_source_destroy(player->source);
+		g_source_unref(player->source);
+	}
+
+	/* the device holds a reference for each pending timeout */
+	while ((due = location_virtual_clock_next_due(player->clock))
+			!= G_MAXINT64)
+		location_virtual_clock_advance(player->clock, due);
+
+	location_gps_device_set_clock(player->device, NULL);
+	location_virtual_clock_free(player->clock);
+	g_object_unref(player->device);
+	g_array_free(player->satellites, TRUE);
+	g_free(player->data);
+	g_free(player);
+}
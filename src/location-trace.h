@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2020 Ivan J. <parazyd@dyne.org>
+ *
+ * This file is part of liblocation
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __LOCATION_TRACE_H__
+#define __LOCATION_TRACE_H__
+
+#include <glib.h>
+
+#include "location-gps-device.h"
+
+G_BEGIN_DECLS
+
+/**
+ * LocationTraceRecorder:
+ *
+ * Appends every signal received from location-daemon, with its arrival
+ * time, to a trace file.
+ */
+typedef struct _LocationTraceRecorder LocationTraceRecorder;
+
+/**
+ * LocationTracePlayer:
+ *
+ * Feeds a recorded trace to a #LocationGPSDevice.
+ */
+typedef struct _LocationTracePlayer LocationTracePlayer;
+
+/**
+ * location_trace_recorder_new:
+ * @path: The file to write, it is truncated if it exists.
+ * @error: Return location for an error, or %NULL.
+ *
+ * Starts recording. Signals are captured as they arrive on any of the
+ * connections the devices of this process share, whichever thread they
+ * run on, so at least one #LocationGPSDevice must exist for anything to be
+ * recorded.
+ *
+ * Returns: The recorder, or %NULL if @path could not be opened.
+ */
+LocationTraceRecorder *location_trace_recorder_new (const gchar *path,
+		GError **error);
+
+/**
+ * location_trace_recorder_free:
+ * @recorder: The recorder.
+ *
+ * Stops recording and closes the trace file.
+ */
+void location_trace_recorder_free (LocationTraceRecorder *recorder);
+
+/**
+ * location_trace_player_new:
+ * @device: The device to feed.
+ * @path: The trace to play.
+ * @error: Return location for an error, or %NULL.
+ *
+ * Loads a trace into memory. While the player exists @device runs on a
+ * virtual clock that follows the trace, so its epoch and interval timing
+ * is the same at any playback speed. Signals location-daemon sends in the
+ * meantime still reach @device as well.
+ *
+ * @device must not have updates pending, i.e. it must have emitted
+ * "changed" for everything it received so far.
+ *
+ * Returns: The player, or %NULL if @path is not a readable trace or
+ * @device is not idle.
+ */
+LocationTracePlayer *location_trace_player_new (LocationGPSDevice *device,
+		const gchar *path,
+		GError **error);
+
+/**
+ * location_trace_player_play:
+ * @player: The player.
+ * @speed: Playback speed, 1.0 for real time. 0 plays the whole trace
+ * before returning, as fast as possible.
+ *
+ * Starts playback. With a non-zero @speed the trace is played from the
+ * main context of the device; check location_trace_player_is_done() to
+ * see when it has finished.
+ */
+void location_trace_player_play (LocationTracePlayer *player, double speed);
+
+/**
+ * location_trace_player_is_done:
+ * @player: The player.
+ *
+ * Returns: %TRUE once every record has been played and the device has
+ * emitted the resulting "changed" signals.
+ */
+gboolean location_trace_player_is_done (LocationTracePlayer *player);
+
+/**
+ * location_trace_player_get_count:
+ * @player: The player.
+ *
+ * Returns: The number of records played so far.
+ */
+guint location_trace_player_get_count (LocationTracePlayer *player);
+
+/**
+ * location_trace_player_free:
+ * @player: The player.
+ *
+ * Stops playback and puts the device back on the real clock. Timeouts the
+ * device still has pending on the virtual clock are run first.
+ */
+void location_trace_player_free (LocationTracePlayer *player);
+
+G_END_DECLS
+
+#endif
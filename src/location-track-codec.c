@@ -0,0 +1,494 @@
+/*
+ * Copyright (c) 2020 Ivan J. <parazyd@dyne.org>
+ *
+ * This file is part of liblocation
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "location-track-codec.h"
+
+#define TRACK_MAGIC   0x43544c4c /* "LLTC" */
+#define TRACK_VERSION 1
+
+#define DEFAULT_KEYFRAME_INTERVAL 60
+
+/*
+ * A track is a Header followed by records. A record is a tag byte
+ * followed by one zig-zag varint for each channel the tag has a bit for,
+ * in channel order, latitude and longitude sharing TAG_LATLONG.
+ */
+#define TAG_KEYFRAME  (1 << 0)
+#define TAG_MODE_SHIFT 1
+#define TAG_MODE_MASK (3 << TAG_MODE_SHIFT)
+#define TAG_TIME      (1 << 3)
+#define TAG_LATLONG   (1 << 4)
+#define TAG_ALTITUDE  (1 << 5)
+#define TAG_SPEED     (1 << 6)
+#define TAG_TRACK     (1 << 7)
+
+/* tag byte and up to ten bytes for each of the six channels */
+#define MAX_RECORD (1 + 6 * 10)
+
+/* the native byte order layout of the start of a track */
+typedef struct {
+	guint32 magic;
+	guint32 version;
+	LocationTrackPrecision precision;
+} Header;
+
+enum {
+	CHANNEL_TIME,
+	CHANNEL_LATITUDE,
+	CHANNEL_LONGITUDE,
+	CHANNEL_ALTITUDE,
+	CHANNEL_SPEED,
+	CHANNEL_TRACK,
+	N_CHANNELS,
+};
+
+/*
+ * A quantized field. Values after the first since a keyframe are coded as
+ * their difference from the one before, or for second order channels as
+ * the change in that difference.
+ */
+typedef struct {
+	gint64 value;
+	gint64 delta;
+	gboolean valid;
+} Channel;
+
+typedef struct {
+	LocationTrackPrecision precision;
+	double scale[N_CHANNELS];
+	/* quantized track is kept in [0, track_range) */
+	gint64 track_range;
+	Channel channels[N_CHANNELS];
+} Codec;
+
+struct _LocationTrackEncoder {
+	Codec codec;
+	guint keyframe_interval;
+	guint count;
+	GByteArray *buf;
+};
+
+struct _LocationTrackDecoder {
+	Codec codec;
+	const guint8 *start;
+	const guint8 *pos;
+	const guint8 *end;
+};
+
+static const LocationTrackPrecision default_precision = {
+	1e-7, 0.1, 0.001, 0.1, 0.1,
+};
+
+static const gboolean second_order[N_CHANNELS] = {
+	TRUE, TRUE, TRUE, FALSE, FALSE, FALSE,
+};
+
+/* function declarations */
+static void codec_init(Codec *, const LocationTrackPrecision *);
+static void codec_reset(Codec *);
+static guint8 *put_varint(guint8 *, guint64);
+static gboolean get_varint(LocationTrackDecoder *, guint64 *);
+static guint8 *put_channel(Codec *, guint, guint8 *, double);
+static gboolean get_channel(LocationTrackDecoder *, guint, double *);
+static guint n_varints(guint8);
+
+void codec_init(Codec *codec, const LocationTrackPrecision *precision)
+{
+	codec->precision = *precision;
+	codec->scale[CHANNEL_TIME] = 1 / precision->time;
+	codec->scale[CHANNEL_LATITUDE] = 1 / precision->latlong;
+	codec->scale[CHANNEL_LONGITUDE] = 1 / precision->latlong;
+	codec->scale[CHANNEL_ALTITUDE] = 1 / precision->altitude;
+	codec->scale[CHANNEL_SPEED] = 1 / precision->speed;
+	codec->scale[CHANNEL_TRACK] = 1 / precision->track;
+	codec->track_range = MAX(llround(360 / precision->track), 1);
+	codec_reset(codec);
+}
+
+void codec_reset(Codec *codec)
+{
+	memset(codec->channels, 0, sizeof(codec->channels));
+}
+
+guint8 *put_varint(guint8 *p, guint64 v)
+{
+	while (v >= 0x80) {
+		*p++ = (guint8)v | 0x80;
+		v >>= 7;
+	}
+	*p++ = (guint8)v;
+	return p;
+}
+
+gboolean get_varint(LocationTrackDecoder *dec, guint64 *v)
+{
+	const guint8 *p = dec->pos;
+	guint64 result = 0;
+	guint shift;
+
+	for (shift = 0; shift < 64 && p < dec->end; shift += 7) {
+		result |= (guint64)(*p & 0x7f) << shift;
+		if (!(*p++ & 0x80)) {
+			dec->pos = p;
+			*v = result;
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+guint8 *put_channel(Codec *codec, guint i, guint8 *p, double value)
+{
+	Channel *c = &codec->channels[i];
+	gint64 v = llround(value * codec->scale[i]), delta = 0, out;
+
+	if (i == CHANNEL_TRACK) {
+		v %= codec->track_range;
+		if (v < 0)
+			v += codec->track_range;
+	}
+
+	if (!c->valid) {
+		out = v;
+		c->valid = TRUE;
+	} else {
+		delta = v - c->value;
+
+		/* the short way around */
+		if (i == CHANNEL_TRACK) {
+			if (delta >= codec->track_range / 2)
+				delta -= codec->track_range;
+			else if (delta < -codec->track_range / 2)
+				delta += codec->track_range;
+		}
+
+		out = second_order[i] ? delta - c->delta : delta;
+	}
+
+	c->value = v;
+	c->delta = delta;
+
+	/* zig-zag, so that small negative numbers stay small */
+	return put_varint(p, ((guint64)out << 1) ^ (guint64)(out >> 63));
+}
+
+gboolean get_channel(LocationTrackDecoder *dec, guint i, double *value)
+{
+	Channel *c = &dec->codec.channels[i];
+	gint64 in, v, delta = 0;
+	guint64 raw;
+
+	if (!get_varint(dec, &raw))
+		return FALSE;
+
+	in = (gint64)(raw >> 1) ^ -(gint64)(raw & 1);
+
+	if (!c->valid) {
+		v = in;
+		c->valid = TRUE;
+	} else {
+		delta = second_order[i] ? c->delta + in : in;
+		v = c->value + delta;
+
+		if (i == CHANNEL_TRACK) {
+			v %= dec->codec.track_range;
+			if (v < 0)
+				v += dec->codec.track_range;
+		}
+	}
+
+	c->value = v;
+	c->delta = delta;
+
+	*value = v / dec->codec.scale[i];
+	return TRUE;
+}
+
+/* the number of varints following a tag */
+guint n_varints(guint8 tag)
+{
+	return !!(tag & TAG_TIME) + 2 * !!(tag & TAG_LATLONG) +
+		!!(tag & TAG_ALTITUDE) + !!(tag & TAG_SPEED) + !!(tag & TAG_TRACK);
+}
+
+LocationTrackEncoder *location_track_encoder_new(
+		const LocationTrackPrecision *precision,
+		guint keyframe_interval)
+{
+	LocationTrackEncoder *enc;
+	Header header;
+
+	if (!precision)
+		precision = &default_precision;
+
+	g_return_val_if_fail(precision->latlong > 0 && precision->altitude > 0 &&
+			precision->time > 0 && precision->speed > 0 &&
+			precision->track > 0, NULL);
+
+	enc = g_new0(LocationTrackEncoder, 1);
+	codec_init(&enc->codec, precision);
+	enc->keyframe_interval = keyframe_interval ?
+		keyframe_interval : DEFAULT_KEYFRAME_INTERVAL;
+	enc->buf = g_byte_array_new();
+
+	memset(&header, 0, sizeof(header));
+	header.magic = TRACK_MAGIC;
+	header.version = TRACK_VERSION;
+	header.precision = *precision;
+	g_byte_array_append(enc->buf, (const guint8 *)&header, sizeof(header));
+
+	return enc;
+}
+
+void location_track_encoder_free(LocationTrackEncoder *enc)
+{
+	g_return_if_fail(enc != NULL);
+
+	g_byte_array_free(enc->buf, TRUE);
+	g_free(enc);
+}
+
+void location_track_encoder_add_fix(LocationTrackEncoder *enc,
+		const LocationGPSDeviceFix *fix)
+{
+	guint8 record[MAX_RECORD], *p = record + 1;
+	Codec *codec;
+	guint8 tag;
+
+	g_return_if_fail(enc != NULL);
+	g_return_if_fail(fix != NULL);
+
+	codec = &enc->codec;
+	tag = (fix->mode << TAG_MODE_SHIFT) & TAG_MODE_MASK;
+
+	if (enc->count++ % enc->keyframe_interval == 0) {
+		tag |= TAG_KEYFRAME;
+		codec_reset(codec);
+	}
+
+	if ((fix->fields & LOCATION_GPS_DEVICE_TIME_SET) && !isnan(fix->time)) {
+		tag |= TAG_TIME;
+		p = put_channel(codec, CHANNEL_TIME, p, fix->time);
+	}
+
+	if ((fix->fields & LOCATION_GPS_DEVICE_LATLONG_SET) &&
+			!isnan(fix->latitude) && !isnan(fix->longitude)) {
+		tag |= TAG_LATLONG;
+		p = put_channel(codec, CHANNEL_LATITUDE, p, fix->latitude);
+		p = put_channel(codec, CHANNEL_LONGITUDE, p, fix->longitude);
+	}
+
+	if ((fix->fields & LOCATION_GPS_DEVICE_ALTITUDE_SET) &&
+			!isnan(fix->altitude)) {
+		tag |= TAG_ALTITUDE;
+		p = put_channel(codec, CHANNEL_ALTITUDE, p, fix->altitude);
+	}
+
+	if ((fix->fields & LOCATION_GPS_DEVICE_SPEED_SET) && !isnan(fix->speed)) {
+		tag |= TAG_SPEED;
+		p = put_channel(codec, CHANNEL_SPEED, p, fix->speed);
+	}
+
+	if ((fix->fields & LOCATION_GPS_DEVICE_TRACK_SET) && !isnan(fix->track)) {
+		tag |= TAG_TRACK;
+		p = put_channel(codec, CHANNEL_TRACK, p, fix->track);
+	}
+
+	record[0] = tag;
+	g_byte_array_append(enc->buf, record, p - record);
+}
+
+const guint8 *location_track_encoder_get_data(LocationTrackEncoder *enc,
+		gsize *length)
+{
+	g_return_val_if_fail(enc != NULL, NULL);
+	g_return_val_if_fail(length != NULL, NULL);
+
+	*length = enc->buf->len;
+	return enc->buf->data;
+}
+
+void location_track_encoder_clear(LocationTrackEncoder *enc)
+{
+	g_return_if_fail(enc != NULL);
+
+	g_byte_array_set_size(enc->buf, 0);
+}
+
+LocationTrackDecoder *location_track_decoder_new(const guint8 *data,
+		gsize length,
+		GError **error)
+{
+	LocationTrackDecoder *dec;
+	Header header;
+
+	if (!data || length < sizeof(Header)) {
+		g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+				"Track is too short");
+		return NULL;
+	}
+
+	memcpy(&header, data, sizeof(header));
+	if (header.magic != TRACK_MAGIC || header.version != TRACK_VERSION ||
+			!(header.precision.latlong > 0) ||
+			!(header.precision.altitude > 0) ||
+			!(header.precision.time > 0) ||
+			!(header.precision.speed > 0) ||
+			!(header.precision.track > 0)) {
+		g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+				"Not a track, or from an unknown version");
+		return NULL;
+	}
+
+	dec = g_new0(LocationTrackDecoder, 1);
+	codec_init(&dec->codec, &header.precision);
+	dec->start = data + sizeof(Header);
+	dec->pos = dec->start;
+	dec->end = data + length;
+
+	return dec;
+}
+
+void location_track_decoder_free(LocationTrackDecoder *dec)
+{
+	g_return_if_fail(dec != NULL);
+
+	g_free(dec);
+}
+
+gboolean location_track_decoder_next(LocationTrackDecoder *dec,
+		LocationGPSDeviceFix *fix)
+{
+	const guint8 *record;
+	guint8 tag;
+
+	g_return_val_if_fail(dec != NULL, FALSE);
+	g_return_val_if_fail(fix != NULL, FALSE);
+
+	if (dec->pos >= dec->end)
+		return FALSE;
+
+	record = dec->pos;
+	tag = *dec->pos++;
+
+	if (tag & TAG_KEYFRAME)
+		codec_reset(&dec->codec);
+
+	fix->mode = (tag & TAG_MODE_MASK) >> TAG_MODE_SHIFT;
+	fix->fields = LOCATION_GPS_DEVICE_NONE_SET;
+	fix->time = fix->ept = LOCATION_GPS_DEVICE_NAN;
+	fix->latitude = fix->longitude = fix->eph = LOCATION_GPS_DEVICE_NAN;
+	fix->altitude = fix->epv = LOCATION_GPS_DEVICE_NAN;
+	fix->track = fix->epd = LOCATION_GPS_DEVICE_NAN;
+	fix->speed = fix->eps = LOCATION_GPS_DEVICE_NAN;
+	fix->climb = fix->epc = LOCATION_GPS_DEVICE_NAN;
+	fix->pitch = fix->roll = fix->dip = LOCATION_GPS_DEVICE_NAN;
+
+	if (tag & TAG_TIME) {
+		if (!get_channel(dec, CHANNEL_TIME, &fix->time))
+			goto truncated;
+		fix->fields |= LOCATION_GPS_DEVICE_TIME_SET;
+	}
+
+	if (tag & TAG_LATLONG) {
+		if (!get_channel(dec, CHANNEL_LATITUDE, &fix->latitude) ||
+				!get_channel(dec, CHANNEL_LONGITUDE, &fix->longitude))
+			goto truncated;
+		fix->fields |= LOCATION_GPS_DEVICE_LATLONG_SET;
+	}
+
+	if (tag & TAG_ALTITUDE) {
+		if (!get_channel(dec, CHANNEL_ALTITUDE, &fix->altitude))
+			goto truncated;
+		fix->fields |= LOCATION_GPS_DEVICE_ALTITUDE_SET;
+	}
+
+	if (tag & TAG_SPEED) {
+		if (!get_channel(dec, CHANNEL_SPEED, &fix->speed))
+			goto truncated;
+		fix->fields |= LOCATION_GPS_DEVICE_SPEED_SET;
+	}
+
+	if (tag & TAG_TRACK) {
+		if (!get_channel(dec, CHANNEL_TRACK, &fix->track))
+			goto truncated;
+		fix->fields |= LOCATION_GPS_DEVICE_TRACK_SET;
+	}
+
+	return TRUE;
+
+truncated:
+	/* the channels are already past this record, so it ends here */
+	dec->pos = record;
+	dec->end = record;
+	return FALSE;
+}
+
+gboolean location_track_decoder_seek(LocationTrackDecoder *dec, double time)
+{
+	const guint8 *record, *best;
+	gboolean ok = TRUE;
+	guint64 raw;
+	gint64 t;
+	guint8 tag;
+	guint i, n;
+
+	g_return_val_if_fail(dec != NULL, FALSE);
+
+	best = dec->start;
+	dec->pos = dec->start;
+
+	while (dec->pos < dec->end) {
+		record = dec->pos;
+		tag = *dec->pos++;
+		n = n_varints(tag);
+
+		/* a keyframe time is absolute */
+		if ((tag & TAG_KEYFRAME) && (tag & TAG_TIME)) {
+			if (!get_varint(dec, &raw)) {
+				ok = FALSE;
+				break;
+			}
+
+			t = (gint64)(raw >> 1) ^ -(gint64)(raw & 1);
+			if (t / dec->codec.scale[CHANNEL_TIME] > time)
+				break;
+
+			best = record;
+			n--;
+		}
+
+		for (i = 0; i < n; i++) {
+			if (!get_varint(dec, &raw)) {
+				ok = FALSE;
+				break;
+			}
+		}
+		if (!ok)
+			break;
+	}
+
+	dec->pos = best;
+	codec_reset(&dec->codec);
+	return ok;
+}
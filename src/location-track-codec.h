@@ -0,0 +1,174 @@
+/*
+ * Copyright (c) 2020 Ivan J. <parazyd@dyne.org>
+ *
+ * This file is part of liblocation
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __LOCATION_TRACK_CODEC_H__
+#define __LOCATION_TRACK_CODEC_H__
+
+#include <glib.h>
+
+#include "location-gps-device.h"
+
+G_BEGIN_DECLS
+
+/**
+ * LocationTrackPrecision:
+ * @latlong: Resolution of latitude and longitude (degrees).
+ * @altitude: Resolution of altitude (m).
+ * @time: Resolution of time (s).
+ * @speed: Resolution of speed (km/h).
+ * @track: Resolution of track (degrees).
+ *
+ * How finely the fields of a fix are kept by a #LocationTrackEncoder.
+ * Coarser resolutions give smaller tracks.
+ */
+typedef struct {
+	double latlong;
+	double altitude;
+	double time;
+	double speed;
+	double track;
+} LocationTrackPrecision;
+
+/**
+ * LocationTrackEncoder:
+ *
+ * Encodes a track compactly, one fix at a time. Each fix stores its time,
+ * position, altitude, speed and track, quantized to a
+ * #LocationTrackPrecision, as variable length differences from the fix
+ * before it. Time, latitude and longitude use the change in their
+ * difference instead, which is near zero at a steady pace. At the default
+ * precision a track recorded once a second takes under 10 bytes per fix.
+ *
+ * Every so often a keyframe stores a fix on its own, so decoding can start
+ * there; see location_track_decoder_seek().
+ */
+typedef struct _LocationTrackEncoder LocationTrackEncoder;
+
+/**
+ * LocationTrackDecoder:
+ *
+ * Reads back a track written by a #LocationTrackEncoder.
+ */
+typedef struct _LocationTrackDecoder LocationTrackDecoder;
+
+/**
+ * location_track_encoder_new:
+ * @precision: The precision to keep, or %NULL for 1e-7 degrees of
+ * latitude and longitude (about 1 cm), 0.1 m of altitude, 1 ms, 0.1 km/h
+ * and 0.1 degrees of track.
+ * @keyframe_interval: Number of fixes from one keyframe to the next, 0
+ * for the default of 60.
+ *
+ * Returns: A new encoder, with the track header already in its buffer.
+ */
+LocationTrackEncoder *location_track_encoder_new (
+		const LocationTrackPrecision *precision,
+		guint keyframe_interval);
+
+/**
+ * location_track_encoder_free:
+ * @encoder: The encoder.
+ */
+void location_track_encoder_free (LocationTrackEncoder *encoder);
+
+/**
+ * location_track_encoder_add_fix:
+ * @encoder: The encoder.
+ * @fix: The next fix of the track.
+ *
+ * Appends @fix to the buffer of @encoder. Fields without their flag in
+ * @fix->fields, and fields that are not a number, are left out. The
+ * climb, the uncertainties and the unused fields are not stored.
+ */
+void location_track_encoder_add_fix (LocationTrackEncoder *encoder,
+		const LocationGPSDeviceFix *fix);
+
+/**
+ * location_track_encoder_get_data:
+ * @encoder: The encoder.
+ * @length: (out): The number of bytes in the buffer.
+ *
+ * Returns: The bytes encoded since the encoder was created or since the
+ * last location_track_encoder_clear(). They stay valid until the next
+ * call on @encoder.
+ */
+const guint8 *location_track_encoder_get_data (LocationTrackEncoder *encoder,
+		gsize *length);
+
+/**
+ * location_track_encoder_clear:
+ * @encoder: The encoder.
+ *
+ * Empties the buffer, for example after writing its contents to a file.
+ * The fixes added next continue the same track, so their bytes have to be
+ * appended to the ones written before.
+ */
+void location_track_encoder_clear (LocationTrackEncoder *encoder);
+
+/**
+ * location_track_decoder_new:
+ * @data: An encoded track. It is not copied and has to stay valid for
+ * the lifetime of the decoder.
+ * @length: The number of bytes in @data.
+ * @error: Return location for an error, or %NULL.
+ *
+ * Returns: A decoder positioned at the first fix, or %NULL if @data does
+ * not start with a track header.
+ */
+LocationTrackDecoder *location_track_decoder_new (const guint8 *data,
+		gsize length,
+		GError **error);
+
+/**
+ * location_track_decoder_free:
+ * @decoder: The decoder.
+ */
+void location_track_decoder_free (LocationTrackDecoder *decoder);
+
+/**
+ * location_track_decoder_next:
+ * @decoder: The decoder.
+ * @fix: (out): The next fix.
+ *
+ * Decodes the next fix. Fields that were not stored are %NAN and have
+ * their flag cleared.
+ *
+ * Returns: %TRUE if a fix was decoded, %FALSE at the end of the data or
+ * where it is truncated or corrupt.
+ */
+gboolean location_track_decoder_next (LocationTrackDecoder *decoder,
+		LocationGPSDeviceFix *fix);
+
+/**
+ * location_track_decoder_seek:
+ * @decoder: The decoder.
+ * @time: A time (s).
+ *
+ * Moves to the last keyframe at or before @time, or to the first fix if
+ * there is none, skipping over records without decoding them. Fixes
+ * without a time do not count as being at or before anything.
+ *
+ * Returns: %FALSE if the data is truncated or corrupt.
+ */
+gboolean location_track_decoder_seek (LocationTrackDecoder *decoder,
+		double time);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,262 @@
+/*
+ * Copyright (c) 2020 Ivan J. <parazyd@dyne.org>
+ *
+ * This file is part of liblocation
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "location-geodesy.h"
+#include "location-trip.h"
+
+#define TRIP_MAGIC   0x50544c4c /* "LLTP" */
+#define TRIP_VERSION 1
+
+/* uncertainties assumed when the receiver does not report one (m) */
+#define DEFAULT_EPH 10.0
+#define DEFAULT_EPV 15.0
+
+/* fixes less certain than this are left out of distance and elevation (m) */
+#define MAX_EPH 100.0
+#define MAX_EPV 100.0
+
+/* position changes below this many times the combined eph are noise */
+#define JITTER_GATE 2.0
+
+/* reported speeds above this count as moving (km/h) */
+#define MOVING_SPEED 2.0
+
+/* time constant of the altitude filter (s) */
+#define ALTITUDE_TAU 10.0
+
+/* longer gaps between fixes do not count as moving time (s) */
+#define MAX_GAP 120.0
+
+#define HAVE_TIME     (1 << 0)
+#define HAVE_POSITION (1 << 1)
+#define HAVE_ALTITUDE (1 << 2)
+
+/*
+ * Everything a trip knows, which is also the snapshot layout. Bump
+ * TRIP_VERSION on any change to it.
+ */
+typedef struct {
+	guint32 magic;
+	guint32 version;
+	guint32 flags;
+	guint32 reserved;
+
+	double start_time;
+	double last_time;
+
+	/* where distance and elevation were last counted */
+	double latitude;
+	double longitude;
+	double eph;
+	double altitude;
+
+	/* altitude after low-pass filtering */
+	double smoothed_altitude;
+
+	double distance;
+	double moving_time;
+	double max_speed;
+	double elevation_gain;
+	double elevation_loss;
+} TripState;
+
+struct _LocationTrip {
+	TripState state;
+	LocationGPSDevice *device;
+	gulong changed_id;
+};
+
+/* function declarations */
+static void on_changed(LocationGPSDevice *, gpointer);
+
+void on_changed(LocationGPSDevice *device, gpointer user_data)
+{
+	location_trip_add_fix(user_data, device->fix);
+}
+
+LocationTrip *location_trip_new(LocationGPSDevice *device)
+{
+	LocationTrip *trip = g_new0(LocationTrip, 1);
+
+	location_trip_reset(trip);
+
+	if (device) {
+		trip->device = g_object_ref(device);
+		trip->changed_id = g_signal_connect(device, "changed",
+				G_CALLBACK(on_changed), trip);
+	}
+
+	return trip;
+}
+
+void location_trip_free(LocationTrip *trip)
+{
+	g_return_if_fail(trip != NULL);
+
+	if (trip->device) {
+		g_signal_handler_disconnect(trip->device, trip->changed_id);
+		g_object_unref(trip->device);
+	}
+
+	g_free(trip);
+}
+
+void location_trip_add_fix(LocationTrip *trip, const LocationGPSDeviceFix *fix)
+{
+	TripState *s;
+	gboolean moving = FALSE, has_speed = FALSE, speed_moving = FALSE;
+	double dt = 0, eph, epv, eps, d;
+
+	g_return_if_fail(trip != NULL);
+	g_return_if_fail(fix != NULL);
+
+	s = &trip->state;
+
+	if (!(fix->fields & LOCATION_GPS_DEVICE_TIME_SET) || isnan(fix->time))
+		return;
+
+	if (s->flags & HAVE_TIME) {
+		dt = fix->time - s->last_time;
+		if (dt < 0)
+			return;
+	} else {
+		s->start_time = fix->time;
+		s->flags |= HAVE_TIME;
+	}
+	s->last_time = fix->time;
+
+	/* the speed comes from Doppler, independent of position noise */
+	if ((fix->fields & LOCATION_GPS_DEVICE_SPEED_SET) && !isnan(fix->speed)) {
+		eps = isnan(fix->eps) ? 0 : fix->eps;
+		has_speed = TRUE;
+		speed_moving = fix->speed > MAX(MOVING_SPEED, eps);
+		if (fix->speed > eps)
+			s->max_speed = MAX(s->max_speed, fix->speed);
+	}
+
+	eph = isnan(fix->eph) ? DEFAULT_EPH : fix->eph / 100;
+	if ((fix->fields & LOCATION_GPS_DEVICE_LATLONG_SET) && eph <= MAX_EPH) {
+		if (!(s->flags & HAVE_POSITION)) {
+			s->latitude = fix->latitude;
+			s->longitude = fix->longitude;
+			s->eph = eph;
+			s->flags |= HAVE_POSITION;
+		} else if (!has_speed || speed_moving) {
+			d = location_geodesy_distance(LOCATION_GEODESY_HAVERSINE,
+					s->latitude, s->longitude,
+					fix->latitude, fix->longitude);
+			/* noise alone rarely moves a fix this far */
+			if (d > JITTER_GATE * hypot(s->eph, eph)) {
+				s->distance += d;
+				s->latitude = fix->latitude;
+				s->longitude = fix->longitude;
+				s->eph = eph;
+				moving = TRUE;
+			}
+		}
+	}
+
+	epv = isnan(fix->epv) ? DEFAULT_EPV : fix->epv;
+	if ((fix->fields & LOCATION_GPS_DEVICE_ALTITUDE_SET) && epv <= MAX_EPV) {
+		if (!(s->flags & HAVE_ALTITUDE)) {
+			s->altitude = fix->altitude;
+			s->smoothed_altitude = fix->altitude;
+			s->flags |= HAVE_ALTITUDE;
+		} else {
+			s->smoothed_altitude += (fix->altitude - s->smoothed_altitude) *
+				dt / (dt + ALTITUDE_TAU);
+
+			d = s->smoothed_altitude - s->altitude;
+			if (fabs(d) > epv) {
+				if (d > 0)
+					s->elevation_gain += d;
+				else
+					s->elevation_loss -= d;
+				s->altitude = s->smoothed_altitude;
+			}
+		}
+	}
+
+	if ((moving || speed_moving) && dt <= MAX_GAP)
+		s->moving_time += dt;
+}
+
+void location_trip_get_stats(LocationTrip *trip, LocationTripStats *stats)
+{
+	const TripState *s;
+
+	g_return_if_fail(trip != NULL);
+	g_return_if_fail(stats != NULL);
+
+	s = &trip->state;
+
+	stats->distance = s->distance;
+	stats->moving_time = s->moving_time;
+	stats->elapsed_time = s->last_time - s->start_time;
+	stats->max_speed = s->max_speed;
+	stats->avg_speed = s->moving_time > 0 ?
+		s->distance / s->moving_time * 3.6 : 0;
+	stats->elevation_gain = s->elevation_gain;
+	stats->elevation_loss = s->elevation_loss;
+}
+
+void location_trip_reset(LocationTrip *trip)
+{
+	g_return_if_fail(trip != NULL);
+
+	memset(&trip->state, 0, sizeof(TripState));
+	trip->state.magic = TRIP_MAGIC;
+	trip->state.version = TRIP_VERSION;
+}
+
+gpointer location_trip_snapshot(LocationTrip *trip, gsize *length)
+{
+	TripState *copy;
+
+	g_return_val_if_fail(trip != NULL, NULL);
+	g_return_val_if_fail(length != NULL, NULL);
+
+	copy = g_new(TripState, 1);
+	*copy = trip->state;
+
+	*length = sizeof(TripState);
+	return copy;
+}
+
+gboolean location_trip_restore(LocationTrip *trip,
+		gconstpointer data,
+		gsize length)
+{
+	TripState state;
+
+	g_return_val_if_fail(trip != NULL, FALSE);
+
+	if (!data || length != sizeof(TripState))
+		return FALSE;
+
+	memcpy(&state, data, sizeof(TripState));
+	if (state.magic != TRIP_MAGIC || state.version != TRIP_VERSION)
+		return FALSE;
+
+	trip->state = state;
+	return TRUE;
+}
@@ -0,0 +1,155 @@
+/*
+ * Copyright (c) 2020 Ivan J. <parazyd@dyne.org>
+ *
+ * This file is part of liblocation
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __LOCATION_TRIP_H__
+#define __LOCATION_TRIP_H__
+
+#include <glib.h>
+
+#include "location-gps-device.h"
+
+G_BEGIN_DECLS
+
+/**
+ * LocationTrip:
+ *
+ * An odometer and trip computer. It accumulates statistics over the fixes
+ * it is fed in constant time and memory per fix. Position and altitude
+ * changes smaller than the uncertainty the receiver reports for them are
+ * treated as noise, so a receiver standing still does not add distance or
+ * climb.
+ */
+typedef struct _LocationTrip LocationTrip;
+
+/**
+ * LocationTripStats:
+ * @distance: Distance travelled (m).
+ * @moving_time: Time spent moving (s).
+ * @elapsed_time: Time from the first to the last fix (s).
+ * @max_speed: Highest speed reported by the receiver (km/h).
+ * @avg_speed: Average speed while moving (km/h).
+ * @elevation_gain: Total climb (m).
+ * @elevation_loss: Total descent (m).
+ *
+ * The statistics of a #LocationTrip.
+ */
+typedef struct {
+	double distance;
+	double moving_time;
+	double elapsed_time;
+	double max_speed;
+	double avg_speed;
+	double elevation_gain;
+	double elevation_loss;
+} LocationTripStats;
+
+/**
+ * location_trip_new:
+ * @device: A device to follow, or %NULL.
+ *
+ * Creates an empty trip. If @device is given the trip is fed the fix of
+ * every "changed" emission of @device until it is freed.
+ *
+ * Returns: The trip.
+ */
+LocationTrip *location_trip_new (LocationGPSDevice *device);
+
+/**
+ * location_trip_free:
+ * @trip: The trip.
+ *
+ * Stops following the device and frees @trip.
+ */
+void location_trip_free (LocationTrip *trip);
+
+/**
+ * location_trip_add_fix:
+ * @trip: The trip.
+ * @fix: The next fix.
+ *
+ * Accounts for @fix. Fixes are expected in time order; ones without
+ * #LOCATION_GPS_DEVICE_TIME_SET or older than the previous fix are
+ * ignored.
+ *
+ * Distance is added once the position has moved further from where it was
+ * last counted than twice the combined eph of both fixes. While the
+ * reported speed is below walking pace or its own uncertainty, no
+ * distance is added at all.
+ * Elevation is added once the altitude, smoothed over about ten seconds,
+ * has moved further than the epv of the fix from where it was last
+ * counted. Fixes with a very large eph or epv do not count towards
+ * distance or elevation.
+ *
+ * Time between fixes counts as moving when the reported speed is above
+ * walking pace and its uncertainty, or when distance was added. Gaps of
+ * more than two minutes between fixes count towards the elapsed time
+ * only.
+ */
+void location_trip_add_fix (LocationTrip *trip,
+		const LocationGPSDeviceFix *fix);
+
+/**
+ * location_trip_get_stats:
+ * @trip: The trip.
+ * @stats: (out): The statistics so far.
+ */
+void location_trip_get_stats (LocationTrip *trip,
+		LocationTripStats *stats);
+
+/**
+ * location_trip_reset:
+ * @trip: The trip.
+ *
+ * Zeroes the statistics and starts a new trip.
+ */
+void location_trip_reset (LocationTrip *trip);
+
+/**
+ * location_trip_snapshot:
+ * @trip: The trip.
+ * @length: (out): The size of the snapshot in bytes.
+ *
+ * Saves the state of @trip, for example to a file, so that it can be
+ * continued with location_trip_restore() after the application restarts.
+ *
+ * Returns: The snapshot, free it with g_free().
+ */
+gpointer location_trip_snapshot (LocationTrip *trip,
+		gsize *length);
+
+/**
+ * location_trip_restore:
+ * @trip: The trip.
+ * @data: A snapshot from location_trip_snapshot().
+ * @length: The size of @data in bytes.
+ *
+ * Replaces the state of @trip with a snapshot. The trip continues from
+ * the last fix in the snapshot, so the way travelled in between is
+ * counted once the next fix arrives.
+ *
+ * Returns: %TRUE on success, %FALSE if @data is not a snapshot of this
+ * version of the library, in which case @trip is left unchanged.
+ */
+gboolean location_trip_restore (LocationTrip *trip,
+		gconstpointer data,
+		gsize length);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,249 @@
+/*
+ * Copyright (c) 2020 Ivan J. <parazyd@dyne.org>
+ *
+ * This file is part of liblocation
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "location-cell.h"
+
+#define POINTS 4000
+
+/* longer than a few vectors, so every tail length comes up */
+#define MAX_RUN 13
+
+typedef struct {
+	double latitudes[POINTS];
+	double longitudes[POINTS];
+} Points;
+
+/* function declarations */
+static void random_points(Points *, guint32);
+static void test_many(void);
+static void test_round_trip(void);
+static void test_hierarchy(void);
+static void test_neighbors(void);
+
+/*
+ * Mostly ordinary positions, with edges, cell boundaries, values out of
+ * range and values that are not numbers mixed in.
+ */
+void random_points(Points *pts, guint32 seed)
+{
+	static const double odd[][2] = {
+		{ 90, 180 }, { -90, -180 }, { 0, 0 }, { 0, 180 }, { 0, -180 },
+		{ 45, 90 }, { -45, -90 }, { 100, 200 }, { -100, -540 },
+		{ 0, 1e300 }, { 0, -1e300 }, { 1e300, 0 },
+		{ NAN, 0 }, { 0, NAN }, { INFINITY, 0 }, { 0, INFINITY },
+	};
+	GRand *rand = g_rand_new_with_seed(seed);
+	guint i, j;
+
+	for (i = 0; i < POINTS; i++) {
+		if (g_rand_int_range(rand, 0, 8)) {
+			pts->latitudes[i] = g_rand_double_range(rand, -90, 90);
+			pts->longitudes[i] = g_rand_double_range(rand,
+					-180, 180);
+		} else {
+			j = g_rand_int_range(rand, 0, G_N_ELEMENTS(odd));
+			pts->latitudes[i] = odd[j][0];
+			pts->longitudes[i] = odd[j][1];
+		}
+	}
+
+	g_rand_free(rand);
+}
+
+/* the vector kernel against one position at a time, at any offset */
+void test_many(void)
+{
+	static Points pts;
+	LocationCellId many[POINTS], one[POINTS];
+	guint level, start, n, i;
+
+	random_points(&pts, 1);
+
+	for (level = 0; level <= LOCATION_CELL_MAX_LEVEL; level++) {
+		for (i = 0; i < POINTS; i++)
+			one[i] = location_cell_from_latlong(pts.latitudes[i],
+					pts.longitudes[i], level);
+
+		location_cell_from_latlong_many(pts.latitudes, pts.longitudes,
+				POINTS, level, many);
+		g_assert_cmpmem(many, sizeof(many), one, sizeof(one));
+
+		for (start = 0; start < 4; start++) {
+			for (n = 0; n <= MAX_RUN; n++) {
+				memset(many, 0xff, sizeof(many));
+				location_cell_from_latlong_many(
+						pts.latitudes + start,
+						pts.longitudes + start, n,
+						level, many + start);
+				g_assert_cmpmem(many + start,
+						n * sizeof(LocationCellId),
+						one + start,
+						n * sizeof(LocationCellId));
+
+				/* nothing written past the end */
+				g_assert_cmpuint(many[start + n], ==, G_MAXUINT64);
+			}
+		}
+	}
+}
+
+/* a position is inside its cell, and the center of a cell is in it */
+void test_round_trip(void)
+{
+	static Points pts;
+	LocationCellId id;
+	double lat, lon, south, west, north, east;
+	guint level, i;
+
+	random_points(&pts, 2);
+
+	for (level = 0; level <= LOCATION_CELL_MAX_LEVEL; level++) {
+		for (i = 0; i < POINTS; i++) {
+			if (fabs(pts.latitudes[i]) > 90 ||
+					fabs(pts.longitudes[i]) > 180)
+				continue;
+
+			id = location_cell_from_latlong(pts.latitudes[i],
+					pts.longitudes[i], level);
+			if (isnan(pts.latitudes[i]) || isnan(pts.longitudes[i])) {
+				g_assert_cmpuint(id, ==, LOCATION_CELL_INVALID);
+				continue;
+			}
+
+			g_assert_cmpuint(location_cell_get_level(id), ==, level);
+
+			location_cell_get_bounds(id, &south, &west, &north,
+					&east);
+			g_assert_cmpfloat(south, <=, pts.latitudes[i]);
+			g_assert_cmpfloat(pts.latitudes[i], <=, north);
+
+			/* 180 is the same meridian as -180 */
+			lon = pts.longitudes[i] == 180 && west == -180
+				? -180 : pts.longitudes[i];
+			g_assert_cmpfloat(west, <=, lon);
+			g_assert_cmpfloat(lon, <=, east);
+
+			location_cell_to_latlong(id, &lat, &lon);
+			g_assert_cmpfloat(lat, ==, (south + north) / 2);
+			g_assert_cmpfloat(lon, ==, (west + east) / 2);
+			g_assert_cmpuint(location_cell_from_latlong(lat, lon,
+						level), ==, id);
+		}
+	}
+}
+
+/* parents, levels and containment agree with encoding at each level */
+void test_hierarchy(void)
+{
+	static Points pts;
+	LocationCellId leaf, id, parent, other;
+	guint level, i;
+
+	random_points(&pts, 3);
+
+	for (i = 0; i + 1 < POINTS; i++) {
+		leaf = location_cell_from_latlong(pts.latitudes[i],
+				pts.longitudes[i], LOCATION_CELL_MAX_LEVEL);
+		other = location_cell_from_latlong(pts.latitudes[i + 1],
+				pts.longitudes[i + 1], LOCATION_CELL_MAX_LEVEL);
+		if (leaf == LOCATION_CELL_INVALID ||
+				other == LOCATION_CELL_INVALID)
+			continue;
+
+		for (level = 0; level <= LOCATION_CELL_MAX_LEVEL; level++) {
+			id = location_cell_from_latlong(pts.latitudes[i],
+					pts.longitudes[i], level);
+
+			g_assert_cmpuint(location_cell_get_parent(leaf, level),
+					==, id);
+			g_assert_cmpuint(location_cell_get_parent(id, level),
+					==, id);
+			g_assert_true(location_cell_contains(id, id));
+			g_assert_true(location_cell_contains(id, leaf));
+
+			/* contained exactly when the parents are the same */
+			g_assert_cmpint(location_cell_contains(id, other), ==,
+					location_cell_get_parent(other, level) == id);
+
+			if (level > 0) {
+				parent = location_cell_get_parent(id, level - 1);
+				g_assert_cmpuint(location_cell_get_level(parent),
+						==, level - 1);
+				g_assert_true(location_cell_contains(parent, id));
+				g_assert_false(location_cell_contains(id, parent));
+			}
+		}
+	}
+}
+
+/* neighbors are distinct cells of the same level, neighbors both ways */
+void test_neighbors(void)
+{
+	static Points pts;
+	LocationCellId id, neighbors[8], back[8];
+	guint level, i, j, k, n, m;
+
+	random_points(&pts, 4);
+
+	for (level = 0; level <= LOCATION_CELL_MAX_LEVEL; level++) {
+		for (i = 0; i < 200; i++) {
+			id = location_cell_from_latlong(pts.latitudes[i],
+					pts.longitudes[i], level);
+			if (id == LOCATION_CELL_INVALID)
+				continue;
+
+			n = location_cell_get_neighbors(id, neighbors);
+			g_assert_cmpuint(n, <=, 8);
+			if (level >= 2)
+				g_assert_cmpuint(n, >=, 5);
+
+			for (j = 0; j < n; j++) {
+				g_assert_cmpuint(neighbors[j], !=, id);
+				g_assert_cmpuint(location_cell_get_level(
+							neighbors[j]), ==, level);
+				for (k = 0; k < j; k++)
+					g_assert_cmpuint(neighbors[j], !=,
+							neighbors[k]);
+
+				m = location_cell_get_neighbors(neighbors[j],
+						back);
+				for (k = 0; k < m && back[k] != id; k++)
+					;
+				g_assert_cmpuint(k, <, m);
+			}
+		}
+	}
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/cell/many", test_many);
+	g_test_add_func("/cell/round-trip", test_round_trip);
+	g_test_add_func("/cell/hierarchy", test_hierarchy);
+	g_test_add_func("/cell/neighbors", test_neighbors);
+
+	return g_test_run();
+}
@@ -0,0 +1,171 @@
+/*
+ * Copyright (c) 2020 Ivan J. <parazyd@dyne.org>
+ *
+ * This file is part of liblocation
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "location-distance-utils.h"
+
+/* enough to run every vector width over its body and its tail */
+#define POINTS 1027
+
+typedef struct {
+	double latitudes[POINTS];
+	double longitudes[POINTS];
+} Points;
+
+/* function declarations */
+static void random_points(Points *, guint32);
+static void test_many(void);
+static void test_matrix(void);
+static void test_nearest(void);
+
+void random_points(Points *pts, guint32 seed)
+{
+	GRand *rand = g_rand_new_with_seed(seed);
+	guint i;
+
+	for (i = 0; i < POINTS; i++) {
+		pts->latitudes[i] = g_rand_double_range(rand, -89.9, 89.9);
+		pts->longitudes[i] = g_rand_double_range(rand, -180, 180);
+	}
+
+	g_rand_free(rand);
+}
+
+/*
+ * The batch kernel picked for this machine against the scalar one behind
+ * location_distance_from_origin(), byte for byte, for every length up to
+ * a few vectors and from unaligned starts.
+ */
+void test_many(void)
+{
+	static Points pts;
+	LocationDistanceOrigin origin;
+	double batch[POINTS], scalar[POINTS], single;
+	guint o, n, start, i;
+
+	random_points(&pts, 1);
+
+	for (o = 0; o < 16; o++) {
+		location_distance_origin_init(&origin, pts.latitudes[o],
+				pts.longitudes[o]);
+
+		for (i = 0; i < POINTS; i++) {
+			scalar[i] = location_distance_from_origin(&origin,
+					pts.latitudes[i], pts.longitudes[i]);
+			single = location_distance_between(pts.latitudes[o],
+					pts.longitudes[o], pts.latitudes[i],
+					pts.longitudes[i]);
+			g_assert_cmpmem(&scalar[i], sizeof(double),
+					&single, sizeof(double));
+		}
+
+		for (start = 0; start < 3; start++) {
+			for (n = 0; n <= 19; n++) {
+				location_distance_between_many(&origin,
+						pts.latitudes + start,
+						pts.longitudes + start, n, batch);
+				g_assert_cmpmem(batch, n * sizeof(double),
+						scalar + start, n * sizeof(double));
+			}
+		}
+
+		location_distance_between_many(&origin, pts.latitudes,
+				pts.longitudes, POINTS, batch);
+		g_assert_cmpmem(batch, sizeof(batch), scalar, sizeof(scalar));
+	}
+}
+
+void test_matrix(void)
+{
+	static Points a, b;
+	static double matrix[8 * POINTS];
+	LocationDistanceOrigin origin;
+	double row[POINTS];
+	guint i;
+
+	random_points(&a, 2);
+	random_points(&b, 3);
+
+	location_distance_matrix(a.latitudes, a.longitudes, 8,
+			b.latitudes, b.longitudes, POINTS, matrix);
+
+	for (i = 0; i < 8; i++) {
+		location_distance_origin_init(&origin, a.latitudes[i],
+				a.longitudes[i]);
+		location_distance_between_many(&origin, b.latitudes,
+				b.longitudes, POINTS, row);
+		g_assert_cmpmem(matrix + i * POINTS, sizeof(row),
+				row, sizeof(row));
+	}
+}
+
+void test_nearest(void)
+{
+	static Points pts;
+	LocationDistanceOrigin origin;
+	double distance, best, d;
+	gssize nearest, expected;
+	guint o, i;
+
+	random_points(&pts, 4);
+
+	/* the same point twice, so that the tie goes to the first */
+	pts.latitudes[700] = pts.latitudes[300];
+	pts.longitudes[700] = pts.longitudes[300];
+
+	for (o = 0; o < 32; o++) {
+		location_distance_origin_init(&origin,
+				o ? pts.latitudes[o] + 0.01 : pts.latitudes[300],
+				o ? pts.longitudes[o] - 0.01 : pts.longitudes[300]);
+
+		expected = -1;
+		best = INFINITY;
+		for (i = 0; i < POINTS; i++) {
+			d = location_distance_from_origin(&origin,
+					pts.latitudes[i], pts.longitudes[i]);
+			if (d < best) {
+				best = d;
+				expected = i;
+			}
+		}
+
+		nearest = location_distance_nearest(&origin, pts.latitudes,
+				pts.longitudes, POINTS, &distance);
+		g_assert_cmpint(nearest, ==, expected);
+		g_assert_cmpfloat(distance, ==, best);
+	}
+
+	g_assert_cmpint(location_distance_nearest(&origin, pts.latitudes,
+				pts.longitudes, 0, &distance), ==, -1);
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/distance/many", test_many);
+	g_test_add_func("/distance/matrix", test_matrix);
+	g_test_add_func("/distance/nearest", test_nearest);
+
+	return g_test_run();
+}
@@ -0,0 +1,156 @@
+/*
+ * Copyright (c) 2020 Ivan J. <parazyd@dyne.org>
+ *
+ * This file is part of liblocation
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+
+#include <glib.h>
+
+#include "location-geodesy.h"
+
+/* degrees, minutes and seconds to degrees */
+#define DMS(d, m, s) ((d) + (m) / 60.0 + (s) / 3600.0)
+
+/*
+ * Flinders Peak to Buninyong, the worked example of the Geoscience
+ * Australia Geodetic Datum technical manual, on GRS80; WGS84 differs from
+ * it by far less than the millimeter the figures are given to.
+ */
+#define FLINDERS_LAT (-DMS(37, 57, 3.72030))
+#define FLINDERS_LON DMS(144, 25, 29.52440)
+#define BUNINYONG_LAT (-DMS(37, 39, 10.15610))
+#define BUNINYONG_LON DMS(143, 55, 35.38390)
+#define FLINDERS_BUNINYONG 54972.271
+#define FLINDERS_BEARING DMS(306, 52, 5.37)
+#define BUNINYONG_BEARING DMS(127, 10, 25.07)
+
+/* the WGS84 meridian quadrant, and a degree of the equator */
+#define QUADRANT 10001965.729
+#define EQUATOR_DEGREE (6378137.0 * G_PI / 180)
+
+/* a hundredth of an arc second */
+#define BEARING_EPS (0.01 / 3600)
+
+/*
+ * The documented error bounds against Vincenty, up to 1 km, 100 km and
+ * 10000 km; the equirectangular one is not bounded at 10000 km.
+ */
+static const double ranges[] = { 1e3, 1e5, 1e7 };
+static const double documented[][3] = {
+	{ 0.0068, 0.02, INFINITY },	/* equirectangular */
+	{ 0.0057, 0.0057, 0.0057 },	/* haversine */
+};
+
+/* function declarations */
+static void test_reference(void);
+static void test_destination(void);
+static void test_errors(void);
+
+void test_reference(void)
+{
+	g_assert_cmpfloat_with_epsilon(location_geodesy_distance(
+				LOCATION_GEODESY_VINCENTY,
+				FLINDERS_LAT, FLINDERS_LON,
+				BUNINYONG_LAT, BUNINYONG_LON),
+			FLINDERS_BUNINYONG, 0.001);
+	g_assert_cmpfloat_with_epsilon(location_geodesy_bearing(
+				LOCATION_GEODESY_VINCENTY,
+				FLINDERS_LAT, FLINDERS_LON,
+				BUNINYONG_LAT, BUNINYONG_LON),
+			FLINDERS_BEARING, BEARING_EPS);
+	g_assert_cmpfloat_with_epsilon(location_geodesy_bearing(
+				LOCATION_GEODESY_VINCENTY,
+				BUNINYONG_LAT, BUNINYONG_LON,
+				FLINDERS_LAT, FLINDERS_LON),
+			BUNINYONG_BEARING, BEARING_EPS);
+
+	g_assert_cmpfloat_with_epsilon(location_geodesy_distance(
+				LOCATION_GEODESY_VINCENTY, 0, 0, 90, 0),
+			QUADRANT, 0.001);
+	g_assert_cmpfloat_with_epsilon(location_geodesy_distance(
+				LOCATION_GEODESY_VINCENTY, 0, 179.5, 0, -179.5),
+			EQUATOR_DEGREE, 0.001);
+	g_assert_cmpfloat(location_geodesy_distance(LOCATION_GEODESY_VINCENTY,
+				FLINDERS_LAT, FLINDERS_LON,
+				FLINDERS_LAT, FLINDERS_LON), ==, 0);
+}
+
+void test_destination(void)
+{
+	double lat, lon;
+
+	location_geodesy_destination(LOCATION_GEODESY_VINCENTY,
+			FLINDERS_LAT, FLINDERS_LON, FLINDERS_BEARING,
+			FLINDERS_BUNINYONG, &lat, &lon);
+
+	/*
+	 * The bearing is published to 0.01 arc seconds, which is 1.3 mm
+	 * sideways at 55 km; a ten thousandth of an arc second is 3 mm.
+	 */
+	g_assert_cmpfloat_with_epsilon(lat, BUNINYONG_LAT, 1e-4 / 3600);
+	g_assert_cmpfloat_with_epsilon(lon, BUNINYONG_LON, 1e-4 / 3600);
+
+	/* across the 180th meridian */
+	location_geodesy_destination(LOCATION_GEODESY_VINCENTY, 0, 179.5, 90,
+			EQUATOR_DEGREE, &lat, &lon);
+	g_assert_cmpfloat_with_epsilon(lat, 0, 1e-9);
+	g_assert_cmpfloat_with_epsilon(lon, -179.5, 1e-9);
+}
+
+/* the error table in location-geodesy.h, sampled the same way as there */
+void test_errors(void)
+{
+	GRand *rand = g_rand_new_with_seed(1);
+	double lat_s, lon_s, lat_f, lon_f, truth, d;
+	guint r, m, i;
+
+	for (r = 0; r < G_N_ELEMENTS(ranges); r++) {
+		for (i = 0; i < 20000; i++) {
+			lat_s = g_rand_double_range(rand, -80, 80);
+			lon_s = g_rand_double_range(rand, -180, 180);
+			location_geodesy_destination(LOCATION_GEODESY_VINCENTY,
+					lat_s, lon_s,
+					g_rand_double_range(rand, 0, 360),
+					g_rand_double_range(rand, 1, ranges[r]),
+					&lat_f, &lon_f);
+			truth = location_geodesy_distance(
+					LOCATION_GEODESY_VINCENTY,
+					lat_s, lon_s, lat_f, lon_f);
+
+			for (m = 0; m < G_N_ELEMENTS(documented); m++) {
+				d = location_geodesy_distance(m, lat_s, lon_s,
+						lat_f, lon_f);
+				g_assert_cmpfloat(fabs(d - truth) / truth, <=,
+						documented[m][r]);
+			}
+		}
+	}
+
+	g_rand_free(rand);
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/geodesy/reference", test_reference);
+	g_test_add_func("/geodesy/destination", test_destination);
+	g_test_add_func("/geodesy/errors", test_errors);
+
+	return g_test_run();
+}
@@ -0,0 +1,183 @@
+/*
+ * Copyright (c) 2020 Ivan J. <parazyd@dyne.org>
+ *
+ * This file is part of liblocation
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <glib.h>
+
+#include "location-geofence.h"
+
+/* Oulu market square, and a point 5 km north of it */
+#define LAT 65.0121
+#define LON 25.4651
+#define FAR_LAT 65.0571
+
+typedef struct {
+	LocationGeofenceSet *set;
+	guint enter;
+	guint exit;
+	guint dwell;
+	guint last;
+	gboolean remove_self;
+	guint remove_other;
+	guint add;
+} Handler;
+
+/* function declarations */
+static void on_transition(guint, LocationGeofenceTransition, gpointer);
+static void test_transitions(void);
+static void test_remove_self(void);
+static void test_remove_pending(void);
+static void test_add_from_handler(void);
+
+void on_transition(guint id, LocationGeofenceTransition transition,
+		gpointer data)
+{
+	Handler *h = data;
+	guint i;
+
+	h->last = id;
+
+	switch (transition) {
+	case LOCATION_GEOFENCE_ENTER:
+		h->enter++;
+		break;
+	case LOCATION_GEOFENCE_EXIT:
+		h->exit++;
+		break;
+	case LOCATION_GEOFENCE_DWELL:
+		h->dwell++;
+		break;
+	}
+
+	if (h->remove_self)
+		g_assert_true(location_geofence_set_remove(h->set, id));
+
+	if (h->remove_other && h->remove_other != id)
+		location_geofence_set_remove(h->set, h->remove_other);
+
+	/* enough to move the fences around in memory */
+	for (i = 0; i < h->add; i++)
+		location_geofence_set_add_circle(h->set, LAT, LON + 1, 100);
+}
+
+void test_transitions(void)
+{
+	Handler h = { 0 };
+	guint id;
+
+	h.set = location_geofence_set_new(10, 1000);
+	id = location_geofence_set_add_circle(h.set, LAT, LON, 500);
+
+	g_assert_cmpuint(location_geofence_set_update(h.set, LAT, LON, 0,
+				on_transition, &h), ==, 1);
+	g_assert_cmpuint(h.enter, ==, 1);
+	g_assert_cmpuint(h.last, ==, id);
+	g_assert_true(location_geofence_set_is_inside(h.set, id));
+
+	g_assert_cmpuint(location_geofence_set_update(h.set, LAT, LON, 1000,
+				on_transition, &h), ==, 1);
+	g_assert_cmpuint(h.dwell, ==, 1);
+
+	g_assert_cmpuint(location_geofence_set_update(h.set, FAR_LAT, LON,
+				2000, on_transition, &h), ==, 1);
+	g_assert_cmpuint(h.exit, ==, 1);
+	g_assert_false(location_geofence_set_is_inside(h.set, id));
+
+	location_geofence_set_unref(h.set);
+}
+
+void test_remove_self(void)
+{
+	Handler h = { 0 };
+	guint i, ids[8];
+
+	h.set = location_geofence_set_new(0, 0);
+	for (i = 0; i < G_N_ELEMENTS(ids); i++)
+		ids[i] = location_geofence_set_add_circle(h.set, LAT, LON,
+				100 * (i + 1));
+
+	h.remove_self = TRUE;
+	g_assert_cmpuint(location_geofence_set_update(h.set, LAT, LON, 0,
+				on_transition, &h), ==, G_N_ELEMENTS(ids));
+	g_assert_cmpuint(h.enter, ==, G_N_ELEMENTS(ids));
+
+	for (i = 0; i < G_N_ELEMENTS(ids); i++) {
+		g_assert_false(location_geofence_set_is_inside(h.set, ids[i]));
+		g_assert_false(location_geofence_set_remove(h.set, ids[i]));
+	}
+
+	/* removed fences are not left again */
+	g_assert_cmpuint(location_geofence_set_update(h.set, FAR_LAT, LON, 0,
+				on_transition, &h), ==, 0);
+	g_assert_cmpuint(h.exit, ==, 0);
+
+	location_geofence_set_unref(h.set);
+}
+
+void test_remove_pending(void)
+{
+	Handler h = { 0 };
+	guint a, b;
+
+	h.set = location_geofence_set_new(0, 0);
+	a = location_geofence_set_add_circle(h.set, LAT, LON, 100);
+	b = location_geofence_set_add_circle(h.set, LAT, LON, 200);
+
+	/* whichever is reported first removes the other before its turn */
+	h.remove_other = b;
+	g_assert_cmpuint(location_geofence_set_update(h.set, LAT, LON, 0,
+				on_transition, &h), ==, 1);
+	g_assert_cmpuint(h.last, ==, a);
+	g_assert_true(location_geofence_set_is_inside(h.set, a));
+	g_assert_false(location_geofence_set_is_inside(h.set, b));
+
+	location_geofence_set_unref(h.set);
+}
+
+void test_add_from_handler(void)
+{
+	Handler h = { 0 };
+	guint i;
+
+	h.set = location_geofence_set_new(0, 0);
+	for (i = 0; i < 4; i++)
+		location_geofence_set_add_circle(h.set, LAT, LON, 100);
+
+	h.add = 256;
+	g_assert_cmpuint(location_geofence_set_update(h.set, LAT, LON, 0,
+				on_transition, &h), ==, 4);
+
+	/* the fences added on the way are found by the next update */
+	h.add = 0;
+	g_assert_cmpuint(location_geofence_set_update(h.set, LAT, LON + 1, 0,
+				on_transition, &h), ==, 4 + 4 * 256);
+
+	location_geofence_set_unref(h.set);
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/geofence/transitions", test_transitions);
+	g_test_add_func("/geofence/remove-self", test_remove_self);
+	g_test_add_func("/geofence/remove-pending", test_remove_pending);
+	g_test_add_func("/geofence/add-from-handler", test_add_from_handler);
+
+	return g_test_run();
+}
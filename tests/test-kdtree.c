@@ -0,0 +1,354 @@
+/*
+ * Copyright (c) 2020 Ivan J. <parazyd@dyne.org>
+ *
+ * This file is part of liblocation
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "location-geodesy.h"
+#include "location-kdtree.h"
+
+#define POINTS 5000
+#define QUERIES 200
+#define K 16
+
+/* distances from the tree and by brute force differ in the last bits */
+#define EPS 1e-6
+
+typedef struct {
+	double latitudes[POINTS];
+	double longitudes[POINTS];
+} Points;
+
+typedef struct {
+	guint index;
+	double distance;
+} Hit;
+
+/* function declarations */
+static void random_points(Points *, guint32);
+static void random_query(GRand *, const Points *, double *, double *);
+static gint compare_hits(gconstpointer, gconstpointer);
+static Hit *brute_force(const Points *, double, double);
+static void on_within(guint, double, gpointer);
+static void on_count(guint, double, gpointer);
+static void test_nearest(void);
+static void test_within(void);
+static void test_save_load(void);
+static void test_load_invalid(void);
+
+/*
+ * Spread over the globe, with clusters on the 180th meridian and around
+ * the north pole, where a flat index would go wrong.
+ */
+void random_points(Points *pts, guint32 seed)
+{
+	GRand *rand = g_rand_new_with_seed(seed);
+	guint i;
+
+	for (i = 0; i < POINTS; i++) {
+		switch (i % 3) {
+		case 0:
+			pts->latitudes[i] = asin(g_rand_double_range(rand,
+						-1, 1)) * 180 / G_PI;
+			pts->longitudes[i] = g_rand_double_range(rand,
+					-180, 180);
+			break;
+		case 1:
+			pts->latitudes[i] = g_rand_double_range(rand, -1, 1);
+			pts->longitudes[i] = fmod(g_rand_double_range(rand,
+						179, 181) + 180, 360) - 180;
+			break;
+		case 2:
+			pts->latitudes[i] = g_rand_double_range(rand, 89, 90);
+			pts->longitudes[i] = g_rand_double_range(rand,
+					-180, 180);
+			break;
+		}
+	}
+
+	g_rand_free(rand);
+}
+
+/* near a point half of the time, anywhere the other half */
+void random_query(GRand *rand, const Points *pts, double *lat, double *lon)
+{
+	guint i = g_rand_int_range(rand, 0, POINTS);
+
+	if (g_rand_int_range(rand, 0, 2)) {
+		*lat = CLAMP(pts->latitudes[i] + g_rand_double_range(rand,
+					-0.1, 0.1), -90, 90);
+		*lon = pts->longitudes[i] + g_rand_double_range(rand, -0.1, 0.1);
+	} else {
+		*lat = g_rand_double_range(rand, -90, 90);
+		*lon = g_rand_double_range(rand, -180, 180);
+	}
+}
+
+gint compare_hits(gconstpointer a, gconstpointer b)
+{
+	const Hit *x = a, *y = b;
+
+	return x->distance < y->distance ? -1 : x->distance > y->distance;
+}
+
+/* every point with its distance, nearest first */
+Hit *brute_force(const Points *pts, double lat, double lon)
+{
+	Hit *hits = g_new(Hit, POINTS);
+	guint i;
+
+	for (i = 0; i < POINTS; i++) {
+		hits[i].index = i;
+		hits[i].distance = location_geodesy_distance(
+				LOCATION_GEODESY_HAVERSINE, lat, lon,
+				pts->latitudes[i], pts->longitudes[i]);
+	}
+
+	qsort(hits, POINTS, sizeof(Hit), compare_hits);
+	return hits;
+}
+
+void on_within(guint index, double distance, gpointer data)
+{
+	GArray *found = data;
+	Hit hit = { index, distance };
+
+	g_array_append_val(found, hit);
+}
+
+void on_count(guint index, double distance, gpointer data)
+{
+	(*(guint *)data)++;
+}
+
+void test_nearest(void)
+{
+	static Points pts;
+	GRand *rand = g_rand_new_with_seed(1);
+	LocationKdTree *tree;
+	guint indices[K], q, i, n;
+	double distances[K], lat, lon;
+	Hit *hits;
+
+	random_points(&pts, 1);
+	tree = location_kdtree_new(pts.latitudes, pts.longitudes, POINTS);
+	g_assert_cmpuint(location_kdtree_get_size(tree), ==, POINTS);
+
+	for (q = 0; q < QUERIES; q++) {
+		random_query(rand, &pts, &lat, &lon);
+		hits = brute_force(&pts, lat, lon);
+
+		n = location_kdtree_nearest(tree, lat, lon, K, indices,
+				distances);
+		g_assert_cmpuint(n, ==, K);
+
+		/*
+		 * Points at the same distance may come in either order, so
+		 * the distances are compared rank by rank, and each index
+		 * has to be at the distance reported for it.
+		 */
+		for (i = 0; i < K; i++) {
+			g_assert_cmpfloat_with_epsilon(distances[i],
+					hits[i].distance, EPS);
+			g_assert_cmpfloat_with_epsilon(distances[i],
+					location_geodesy_distance(
+					LOCATION_GEODESY_HAVERSINE, lat, lon,
+					pts.latitudes[indices[i]],
+					pts.longitudes[indices[i]]), EPS);
+			if (i)
+				g_assert_cmpfloat(distances[i - 1], <=,
+						distances[i]);
+		}
+
+		g_free(hits);
+	}
+
+	/* asking for more than there is */
+	location_kdtree_free(tree);
+	tree = location_kdtree_new(pts.latitudes, pts.longitudes, 3);
+	g_assert_cmpuint(location_kdtree_nearest(tree, 0, 0, K, indices,
+				NULL), ==, 3);
+
+	location_kdtree_free(tree);
+	g_rand_free(rand);
+}
+
+void test_within(void)
+{
+	static const double radii[] = { 0, 1000, 50000, 2000000 };
+	static Points pts;
+	GRand *rand = g_rand_new_with_seed(2);
+	LocationKdTree *tree;
+	GArray *found;
+	gboolean *in;
+	double lat, lon;
+	guint q, r, i, n;
+	Hit *hits;
+
+	random_points(&pts, 2);
+	tree = location_kdtree_new(pts.latitudes, pts.longitudes, POINTS);
+	found = g_array_new(FALSE, FALSE, sizeof(Hit));
+	in = g_new(gboolean, POINTS);
+
+	for (q = 0; q < QUERIES; q++) {
+		random_query(rand, &pts, &lat, &lon);
+		hits = brute_force(&pts, lat, lon);
+
+		for (r = 0; r < G_N_ELEMENTS(radii); r++) {
+			g_array_set_size(found, 0);
+			n = location_kdtree_within(tree, lat, lon, radii[r],
+					on_within, found);
+			g_assert_cmpuint(n, ==, found->len);
+
+			memset(in, 0, POINTS * sizeof(gboolean));
+			for (i = 0; i < found->len; i++) {
+				Hit *hit = &g_array_index(found, Hit, i);
+
+				g_assert_false(in[hit->index]);
+				in[hit->index] = TRUE;
+				g_assert_cmpfloat(hit->distance, <=,
+						radii[r] + EPS);
+			}
+
+			/* all points clearly inside, none clearly outside */
+			for (i = 0; i < POINTS; i++) {
+				if (hits[i].distance < radii[r] - EPS)
+					g_assert_true(in[hits[i].index]);
+				else if (hits[i].distance > radii[r] + EPS)
+					g_assert_false(in[hits[i].index]);
+			}
+		}
+
+		g_free(hits);
+	}
+
+	g_free(in);
+	g_array_free(found, TRUE);
+	location_kdtree_free(tree);
+	g_rand_free(rand);
+}
+
+/* a saved and loaded tree answers exactly like the one it was saved from */
+void test_save_load(void)
+{
+	static Points pts;
+	GRand *rand = g_rand_new_with_seed(3);
+	LocationKdTree *tree, *loaded;
+	GError *err = NULL;
+	gchar *dir, *path;
+	guint a[K], b[K], q, na, nb;
+	double da[K], db[K], lat, lon;
+
+	random_points(&pts, 3);
+	tree = location_kdtree_new(pts.latitudes, pts.longitudes, POINTS);
+
+	dir = g_dir_make_tmp("test-kdtree-XXXXXX", &err);
+	g_assert_no_error(err);
+	path = g_build_filename(dir, "tree", NULL);
+
+	g_assert_true(location_kdtree_save(tree, path, &err));
+	g_assert_no_error(err);
+
+	loaded = location_kdtree_load(path, &err);
+	g_assert_no_error(err);
+	g_assert_nonnull(loaded);
+	g_assert_cmpuint(location_kdtree_get_size(loaded), ==, POINTS);
+
+	for (q = 0; q < QUERIES; q++) {
+		random_query(rand, &pts, &lat, &lon);
+		location_kdtree_nearest(tree, lat, lon, K, a, da);
+		location_kdtree_nearest(loaded, lat, lon, K, b, db);
+		g_assert_cmpmem(a, sizeof(a), b, sizeof(b));
+		g_assert_cmpmem(da, sizeof(da), db, sizeof(db));
+
+		na = nb = 0;
+		location_kdtree_within(tree, lat, lon, 1e5, on_count, &na);
+		location_kdtree_within(loaded, lat, lon, 1e5, on_count, &nb);
+		g_assert_cmpuint(na, ==, nb);
+	}
+
+	location_kdtree_free(loaded);
+	location_kdtree_free(tree);
+
+	g_unlink(path);
+	g_rmdir(dir);
+	g_free(path);
+	g_free(dir);
+	g_rand_free(rand);
+}
+
+/* anything but a whole tree is refused with an error */
+void test_load_invalid(void)
+{
+	static Points pts;
+	LocationKdTree *tree;
+	GError *err = NULL;
+	gchar *dir, *path, *contents;
+	gsize length;
+
+	random_points(&pts, 4);
+	tree = location_kdtree_new(pts.latitudes, pts.longitudes, 100);
+
+	dir = g_dir_make_tmp("test-kdtree-XXXXXX", &err);
+	g_assert_no_error(err);
+	path = g_build_filename(dir, "tree", NULL);
+
+	g_assert_null(location_kdtree_load(path, &err));
+	g_assert_nonnull(err);
+	g_clear_error(&err);
+
+	g_assert_true(location_kdtree_save(tree, path, NULL));
+	g_assert_true(g_file_get_contents(path, &contents, &length, NULL));
+
+	/* cut short */
+	g_assert_true(g_file_set_contents(path, contents, length - 1, NULL));
+	g_assert_null(location_kdtree_load(path, &err));
+	g_assert_nonnull(err);
+	g_clear_error(&err);
+
+	/* not a tree */
+	contents[0] ^= 0xff;
+	g_assert_true(g_file_set_contents(path, contents, length, NULL));
+	g_assert_null(location_kdtree_load(path, &err));
+	g_assert_nonnull(err);
+	g_clear_error(&err);
+
+	g_unlink(path);
+	g_rmdir(dir);
+	g_free(contents);
+	g_free(path);
+	g_free(dir);
+	location_kdtree_free(tree);
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/kdtree/nearest", test_nearest);
+	g_test_add_func("/kdtree/within", test_within);
+	g_test_add_func("/kdtree/save-load", test_save_load);
+	g_test_add_func("/kdtree/load-invalid", test_load_invalid);
+
+	return g_test_run();
+}
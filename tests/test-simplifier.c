@@ -0,0 +1,245 @@
+/*
+ * Copyright (c) 2020 Ivan J. <parazyd@dyne.org>
+ *
+ * This file is part of liblocation
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "location-distance-utils.h"
+#include "location-simplifier.h"
+
+/* meters per degree of latitude, as in the simplifier */
+#define METERS_PER_DEGREE 111318.84502145034
+
+#define FIXES 5000
+
+typedef struct {
+	GArray *kept;	/* of LocationGPSDeviceFix */
+} Track;
+
+/* function declarations */
+static void on_keep(const LocationGPSDeviceFix *, gpointer);
+static void make_track(LocationGPSDeviceFix *, guint, guint32);
+static double segment_distance(const LocationGPSDeviceFix *,
+		const LocationGPSDeviceFix *, const LocationGPSDeviceFix *);
+static void check_track(const LocationGPSDeviceFix *, guint, GArray *,
+		double, guint);
+static void test_tolerance(void);
+static void test_window(void);
+static void test_reset(void);
+
+void on_keep(const LocationGPSDeviceFix *fix, gpointer data)
+{
+	Track *t = data;
+
+	g_array_append_val(t->kept, *fix);
+}
+
+/* a drive that wanders, turns and stops, a fix a second; time is the index */
+void make_track(LocationGPSDeviceFix *fixes, guint n, guint32 seed)
+{
+	GRand *rand = g_rand_new_with_seed(seed);
+	double lat = 65.0121, lon = 25.4651, heading = 0, speed = 10;
+	guint i;
+
+	for (i = 0; i < n; i++) {
+		if (g_rand_int_range(rand, 0, 50) == 0)
+			heading += g_rand_double_range(rand, -120, 120);
+		else
+			heading += g_rand_double_range(rand, -3, 3);
+		if (g_rand_int_range(rand, 0, 200) == 0)
+			speed = g_rand_double_range(rand, 0, 30);
+
+		lat += speed * cos(heading * G_PI / 180) / METERS_PER_DEGREE
+			+ g_rand_double_range(rand, -2, 2) / METERS_PER_DEGREE;
+		lon += speed * sin(heading * G_PI / 180)
+			/ (METERS_PER_DEGREE * lng_scale(lat))
+			+ g_rand_double_range(rand, -2, 2) / METERS_PER_DEGREE;
+
+		memset(&fixes[i], 0, sizeof(LocationGPSDeviceFix));
+		fixes[i].fields = LOCATION_GPS_DEVICE_LATLONG_SET
+			| LOCATION_GPS_DEVICE_TIME_SET;
+		fixes[i].time = i;
+		fixes[i].latitude = lat;
+		fixes[i].longitude = lon;
+	}
+
+	g_rand_free(rand);
+}
+
+/* distance from p to the segment a - b, on the projection around a */
+double segment_distance(const LocationGPSDeviceFix *p,
+		const LocationGPSDeviceFix *a, const LocationGPSDeviceFix *b)
+{
+	double scale = lng_scale(a->latitude) * METERS_PER_DEGREE;
+	double px = (p->longitude - a->longitude) * scale;
+	double py = (p->latitude - a->latitude) * METERS_PER_DEGREE;
+	double bx = (b->longitude - a->longitude) * scale;
+	double by = (b->latitude - a->latitude) * METERS_PER_DEGREE;
+	double len2 = bx * bx + by * by, t = 0;
+
+	if (len2 > 0)
+		t = CLAMP((px * bx + py * by) / len2, 0, 1);
+
+	return hypot(px - t * bx, py - t * by);
+}
+
+/*
+ * The kept fixes are a subsequence of the track that starts and ends with
+ * it, every dropped fix is within tolerance of the segment around it, and
+ * no more than max_window - 1 fixes are dropped in a row.
+ */
+void check_track(const LocationGPSDeviceFix *fixes, guint n, GArray *kept,
+		double tolerance, guint max_window)
+{
+	const LocationGPSDeviceFix *a, *b;
+	guint k, i;
+
+	g_assert_cmpuint(kept->len, >=, 2);
+	g_assert_cmpfloat(g_array_index(kept, LocationGPSDeviceFix, 0).time,
+			==, 0);
+	g_assert_cmpfloat(g_array_index(kept, LocationGPSDeviceFix,
+				kept->len - 1).time, ==, n - 1);
+
+	for (k = 0; k + 1 < kept->len; k++) {
+		a = &g_array_index(kept, LocationGPSDeviceFix, k);
+		b = &g_array_index(kept, LocationGPSDeviceFix, k + 1);
+
+		g_assert_cmpfloat(a->time, <, b->time);
+		g_assert_cmpfloat(b->time - a->time, <=, max_window);
+		g_assert_cmpfloat(b->latitude, ==, fixes[(guint)b->time].latitude);
+		g_assert_cmpfloat(b->longitude, ==,
+				fixes[(guint)b->time].longitude);
+
+		for (i = a->time + 1; i < b->time; i++)
+			g_assert_cmpfloat(segment_distance(&fixes[i], a, b), <=,
+					tolerance + 1e-6);
+	}
+}
+
+void test_tolerance(void)
+{
+	static LocationGPSDeviceFix fixes[FIXES];
+	static const double tolerances[] = { 0, 1, 5, 25, 100 };
+	LocationSimplifier *s;
+	Track t;
+	guint i, j, n_in, n_out;
+
+	make_track(fixes, FIXES, 1);
+	t.kept = g_array_new(FALSE, FALSE, sizeof(LocationGPSDeviceFix));
+
+	for (j = 0; j < G_N_ELEMENTS(tolerances); j++) {
+		g_array_set_size(t.kept, 0);
+		s = location_simplifier_new(tolerances[j], 1000, on_keep, &t);
+
+		for (i = 0; i < FIXES; i++)
+			location_simplifier_add_fix(s, &fixes[i]);
+		location_simplifier_flush(s);
+
+		location_simplifier_get_counts(s, &n_in, &n_out);
+		g_assert_cmpuint(n_in, ==, FIXES);
+		g_assert_cmpuint(n_out, ==, t.kept->len);
+
+		check_track(fixes, FIXES, t.kept, tolerances[j], 1000);
+
+		/* meters of noise on a mostly straight drive thin out */
+		if (tolerances[j] >= 5)
+			g_assert_cmpuint(t.kept->len, <, FIXES / 4);
+
+		location_simplifier_free(s);
+	}
+
+	g_array_free(t.kept, TRUE);
+}
+
+void test_window(void)
+{
+	static LocationGPSDeviceFix fixes[FIXES];
+	LocationSimplifier *s;
+	Track t;
+	guint i;
+
+	/* a straight line would otherwise be thinned to its two ends */
+	for (i = 0; i < FIXES; i++) {
+		memset(&fixes[i], 0, sizeof(LocationGPSDeviceFix));
+		fixes[i].fields = LOCATION_GPS_DEVICE_LATLONG_SET;
+		fixes[i].time = i;
+		fixes[i].latitude = 65 + i * 1e-5;
+		fixes[i].longitude = 25;
+	}
+
+	t.kept = g_array_new(FALSE, FALSE, sizeof(LocationGPSDeviceFix));
+	s = location_simplifier_new(1, 16, on_keep, &t);
+
+	for (i = 0; i < FIXES; i++)
+		location_simplifier_add_fix(s, &fixes[i]);
+	location_simplifier_flush(s);
+
+	check_track(fixes, FIXES, t.kept, 1, 16);
+	g_assert_cmpuint(t.kept->len, ==, 1 + (FIXES - 1 + 15) / 16);
+
+	location_simplifier_free(s);
+	g_array_free(t.kept, TRUE);
+}
+
+void test_reset(void)
+{
+	LocationGPSDeviceFix fixes[100], missing;
+	LocationSimplifier *s;
+	Track t;
+	guint i, n_in;
+
+	make_track(fixes, 100, 2);
+	t.kept = g_array_new(FALSE, FALSE, sizeof(LocationGPSDeviceFix));
+	s = location_simplifier_new(10, 100, on_keep, &t);
+
+	/* fixes without a position are not fed */
+	memset(&missing, 0, sizeof(missing));
+	missing.latitude = missing.longitude = NAN;
+	location_simplifier_add_fix(s, &missing);
+
+	for (i = 0; i < 50; i++)
+		location_simplifier_add_fix(s, &fixes[i]);
+
+	/* the fixes held back are dropped, the next one is kept */
+	location_simplifier_reset(s);
+	g_array_set_size(t.kept, 0);
+	location_simplifier_add_fix(s, &fixes[50]);
+	g_assert_cmpuint(t.kept->len, ==, 1);
+	g_assert_cmpfloat(g_array_index(t.kept, LocationGPSDeviceFix, 0).time,
+			==, 50);
+
+	location_simplifier_get_counts(s, &n_in, NULL);
+	g_assert_cmpuint(n_in, ==, 51);
+
+	location_simplifier_free(s);
+	g_array_free(t.kept, TRUE);
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/simplifier/tolerance", test_tolerance);
+	g_test_add_func("/simplifier/window", test_window);
+	g_test_add_func("/simplifier/reset", test_reset);
+
+	return g_test_run();
+}
@@ -0,0 +1,401 @@
+/*
+ * Copyright (c) 2020 Ivan J. <parazyd@dyne.org>
+ *
+ * This file is part of liblocation
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "location-track-codec.h"
+
+#define FIXES 2000
+#define KEYFRAME_INTERVAL 7
+
+/* function declarations */
+static void random_track(LocationGPSDeviceFix *, guint, guint32);
+static guint decode(const guint8 *, gsize, LocationGPSDeviceFix *, guint);
+static void assert_close(double, double, double);
+static void assert_fix(const LocationGPSDeviceFix *,
+		const LocationGPSDeviceFix *, const LocationTrackPrecision *);
+static void test_round_trip(void);
+static void test_precision(void);
+static void test_clear(void);
+static void test_seek(void);
+static void test_invalid(void);
+
+static const LocationTrackPrecision default_precision = {
+	1e-7, 0.1, 0.001, 0.1, 0.1,
+};
+
+/*
+ * A drive at about one fix a second, turning through north now and then,
+ * with fields dropping out and the odd jump in time and position.
+ */
+void random_track(LocationGPSDeviceFix *fixes, guint n, guint32 seed)
+{
+	GRand *rand = g_rand_new_with_seed(seed);
+	LocationGPSDeviceFix *fix;
+	double time = 1600000000.123, lat = 60.1699, lon = 24.9384;
+	double alt = 20, speed = 50, track = 350;
+	guint i;
+
+	for (i = 0; i < n; i++) {
+		fix = &fixes[i];
+		memset(fix, 0, sizeof(LocationGPSDeviceFix));
+
+		time += g_rand_double_range(rand, 0.9, 1.1);
+		if (!g_rand_int_range(rand, 0, 100))
+			time += g_rand_double_range(rand, 60, 3600);
+		lat += g_rand_double_range(rand, -1e-4, 1e-4);
+		lon += g_rand_double_range(rand, -1e-4, 1e-4);
+		if (!g_rand_int_range(rand, 0, 200))
+			lon = g_rand_double_range(rand, -180, 180);
+		alt += g_rand_double_range(rand, -1, 1);
+		speed = MAX(speed + g_rand_double_range(rand, -5, 5), 0);
+		track = fmod(track + g_rand_double_range(rand, -10, 10) + 360,
+				360);
+
+		fix->mode = g_rand_int_range(rand, LOCATION_GPS_DEVICE_MODE_NOT_SEEN,
+				LOCATION_GPS_DEVICE_MODE_3D + 1);
+		fix->time = time;
+		fix->latitude = lat;
+		fix->longitude = lon;
+		fix->altitude = alt;
+		fix->speed = speed;
+		fix->track = track;
+
+		fix->fields = LOCATION_GPS_DEVICE_TIME_SET |
+			LOCATION_GPS_DEVICE_LATLONG_SET |
+			LOCATION_GPS_DEVICE_ALTITUDE_SET |
+			LOCATION_GPS_DEVICE_SPEED_SET |
+			LOCATION_GPS_DEVICE_TRACK_SET;
+
+		/* now and then a field is missing, flagged or not a number */
+		if (!g_rand_int_range(rand, 0, 10))
+			fix->fields &= ~LOCATION_GPS_DEVICE_ALTITUDE_SET;
+		if (!g_rand_int_range(rand, 0, 10))
+			fix->track = LOCATION_GPS_DEVICE_NAN;
+		if (!g_rand_int_range(rand, 0, 20))
+			fix->fields &= ~LOCATION_GPS_DEVICE_LATLONG_SET;
+		if (!g_rand_int_range(rand, 0, 50))
+			fix->fields &= ~LOCATION_GPS_DEVICE_TIME_SET;
+	}
+
+	g_rand_free(rand);
+}
+
+/* up to max fixes from a whole track */
+guint decode(const guint8 *data, gsize length, LocationGPSDeviceFix *fixes,
+		guint max)
+{
+	LocationTrackDecoder *dec;
+	GError *err = NULL;
+	guint n = 0;
+
+	dec = location_track_decoder_new(data, length, &err);
+	g_assert_no_error(err);
+	g_assert_nonnull(dec);
+
+	while (n < max && location_track_decoder_next(dec, &fixes[n]))
+		n++;
+
+	location_track_decoder_free(dec);
+	return n;
+}
+
+/* within half a step, give or take the rounding of the division back */
+void assert_close(double decoded, double value, double step)
+{
+	g_assert_cmpfloat(fabs(decoded - value), <=,
+			step / 2 + 16 * DBL_EPSILON * fabs(value));
+}
+
+void assert_fix(const LocationGPSDeviceFix *decoded,
+		const LocationGPSDeviceFix *fix,
+		const LocationTrackPrecision *precision)
+{
+	guint fields = fix->fields;
+	double turn;
+
+	if (isnan(fix->track))
+		fields &= ~LOCATION_GPS_DEVICE_TRACK_SET;
+
+	g_assert_cmpint(decoded->mode, ==, fix->mode);
+	g_assert_cmpuint(decoded->fields, ==, fields);
+
+	if (fields & LOCATION_GPS_DEVICE_TIME_SET)
+		assert_close(decoded->time, fix->time, precision->time);
+	else
+		g_assert_true(isnan(decoded->time));
+
+	if (fields & LOCATION_GPS_DEVICE_LATLONG_SET) {
+		assert_close(decoded->latitude, fix->latitude,
+				precision->latlong);
+		assert_close(decoded->longitude, fix->longitude,
+				precision->latlong);
+	} else {
+		g_assert_true(isnan(decoded->latitude));
+		g_assert_true(isnan(decoded->longitude));
+	}
+
+	if (fields & LOCATION_GPS_DEVICE_ALTITUDE_SET)
+		assert_close(decoded->altitude, fix->altitude,
+				precision->altitude);
+	else
+		g_assert_true(isnan(decoded->altitude));
+
+	assert_close(decoded->speed, fix->speed, precision->speed);
+
+	/* track comes back in [0, 360), the short way around from the fix */
+	if (fields & LOCATION_GPS_DEVICE_TRACK_SET) {
+		g_assert_cmpfloat(decoded->track, >=, 0);
+		g_assert_cmpfloat(decoded->track, <, 360);
+		turn = fmod(decoded->track - fix->track + 540, 360) - 180;
+		assert_close(turn, 0, precision->track);
+	} else {
+		g_assert_true(isnan(decoded->track));
+	}
+
+	g_assert_true(isnan(decoded->climb));
+	g_assert_true(isnan(decoded->eph));
+}
+
+void test_round_trip(void)
+{
+	static LocationGPSDeviceFix fixes[FIXES], decoded[FIXES + 1];
+	LocationTrackEncoder *enc;
+	const guint8 *data;
+	gsize length;
+	guint i;
+
+	random_track(fixes, FIXES, 1);
+
+	enc = location_track_encoder_new(NULL, KEYFRAME_INTERVAL);
+	for (i = 0; i < FIXES; i++)
+		location_track_encoder_add_fix(enc, &fixes[i]);
+
+	data = location_track_encoder_get_data(enc, &length);
+	g_assert_cmpuint(decode(data, length, decoded, FIXES + 1), ==, FIXES);
+
+	for (i = 0; i < FIXES; i++)
+		assert_fix(&decoded[i], &fixes[i], &default_precision);
+
+	location_track_encoder_free(enc);
+}
+
+/* a coarse precision is kept to as well, and takes fewer bytes */
+void test_precision(void)
+{
+	static const LocationTrackPrecision coarse = { 1e-5, 1, 1, 1, 5 };
+	static LocationGPSDeviceFix fixes[FIXES], decoded[FIXES];
+	LocationTrackEncoder *enc, *fine;
+	const guint8 *data;
+	gsize length, fine_length;
+	guint i;
+
+	random_track(fixes, FIXES, 2);
+
+	enc = location_track_encoder_new(&coarse, 0);
+	fine = location_track_encoder_new(NULL, 0);
+	for (i = 0; i < FIXES; i++) {
+		location_track_encoder_add_fix(enc, &fixes[i]);
+		location_track_encoder_add_fix(fine, &fixes[i]);
+	}
+
+	data = location_track_encoder_get_data(enc, &length);
+	location_track_encoder_get_data(fine, &fine_length);
+	g_assert_cmpuint(length, <, fine_length);
+
+	g_assert_cmpuint(decode(data, length, decoded, FIXES), ==, FIXES);
+	for (i = 0; i < FIXES; i++)
+		assert_fix(&decoded[i], &fixes[i], &coarse);
+
+	location_track_encoder_free(fine);
+	location_track_encoder_free(enc);
+}
+
+/* the pieces written between clears add up to the whole track */
+void test_clear(void)
+{
+	static LocationGPSDeviceFix fixes[FIXES];
+	LocationTrackEncoder *enc, *whole;
+	GByteArray *pieces;
+	const guint8 *data;
+	gsize length;
+	guint i;
+
+	random_track(fixes, FIXES, 3);
+
+	enc = location_track_encoder_new(NULL, KEYFRAME_INTERVAL);
+	whole = location_track_encoder_new(NULL, KEYFRAME_INTERVAL);
+	pieces = g_byte_array_new();
+
+	for (i = 0; i < FIXES; i++) {
+		location_track_encoder_add_fix(enc, &fixes[i]);
+		location_track_encoder_add_fix(whole, &fixes[i]);
+
+		if (i % 13 == 0) {
+			data = location_track_encoder_get_data(enc, &length);
+			g_byte_array_append(pieces, data, length);
+			location_track_encoder_clear(enc);
+		}
+	}
+
+	data = location_track_encoder_get_data(enc, &length);
+	g_byte_array_append(pieces, data, length);
+
+	data = location_track_encoder_get_data(whole, &length);
+	g_assert_cmpmem(pieces->data, pieces->len, data, length);
+
+	g_byte_array_free(pieces, TRUE);
+	location_track_encoder_free(whole);
+	location_track_encoder_free(enc);
+}
+
+/*
+ * Seeking lands on the last keyframe with a time at or before the one
+ * asked for, and decoding from there gives the same fixes as decoding
+ * from the start.
+ */
+void test_seek(void)
+{
+	static LocationGPSDeviceFix fixes[FIXES], decoded[FIXES];
+	LocationTrackEncoder *enc;
+	LocationTrackDecoder *dec;
+	LocationGPSDeviceFix fix;
+	GRand *rand = g_rand_new_with_seed(4);
+	const guint8 *data;
+	gsize length;
+	double time;
+	guint i, q, expected;
+
+	random_track(fixes, FIXES, 4);
+
+	enc = location_track_encoder_new(NULL, KEYFRAME_INTERVAL);
+	for (i = 0; i < FIXES; i++)
+		location_track_encoder_add_fix(enc, &fixes[i]);
+
+	data = location_track_encoder_get_data(enc, &length);
+	g_assert_cmpuint(decode(data, length, decoded, FIXES), ==, FIXES);
+
+	dec = location_track_decoder_new(data, length, NULL);
+	g_assert_nonnull(dec);
+
+	for (q = 0; q < 500; q++) {
+		/* between the fixes, on them and outside the track */
+		i = g_rand_int_range(rand, 0, FIXES);
+		switch (q % 4) {
+		case 0:
+			time = decoded[i].time;
+			break;
+		case 1:
+			time = fixes[i].time;
+			break;
+		case 2:
+			time = fixes[0].time - g_rand_double_range(rand, 0, 10);
+			break;
+		default:
+			time = fixes[FIXES - 1].time +
+				g_rand_double_range(rand, -100, 10);
+			break;
+		}
+		if (isnan(time))
+			continue;
+
+		expected = 0;
+		for (i = 0; i < FIXES; i += KEYFRAME_INTERVAL)
+			if ((decoded[i].fields & LOCATION_GPS_DEVICE_TIME_SET) &&
+					decoded[i].time <= time)
+				expected = i;
+
+		g_assert_true(location_track_decoder_seek(dec, time));
+
+		for (i = expected; i < MIN(expected + 2 * KEYFRAME_INTERVAL,
+					FIXES); i++) {
+			g_assert_true(location_track_decoder_next(dec, &fix));
+			g_assert_cmpmem(&fix, sizeof(fix),
+					&decoded[i], sizeof(fix));
+		}
+	}
+
+	location_track_decoder_free(dec);
+	location_track_encoder_free(enc);
+	g_rand_free(rand);
+}
+
+/* foreign data is refused, a cut track decodes up to the cut */
+void test_invalid(void)
+{
+	static LocationGPSDeviceFix fixes[100], decoded[100];
+	static const guint8 garbage[64] = { 'n', 'o', 't', ' ', 'a' };
+	LocationTrackEncoder *enc;
+	LocationTrackDecoder *dec;
+	GError *err = NULL;
+	const guint8 *data;
+	gsize ends[100], length, cut;
+	guint i, n;
+
+	g_assert_null(location_track_decoder_new(garbage, sizeof(garbage),
+				&err));
+	g_assert_nonnull(err);
+	g_clear_error(&err);
+
+	g_assert_null(location_track_decoder_new(garbage, 4, &err));
+	g_assert_nonnull(err);
+	g_clear_error(&err);
+
+	random_track(fixes, 100, 5);
+	enc = location_track_encoder_new(NULL, KEYFRAME_INTERVAL);
+	for (i = 0; i < 100; i++) {
+		location_track_encoder_add_fix(enc, &fixes[i]);
+		location_track_encoder_get_data(enc, &ends[i]);
+	}
+	data = location_track_encoder_get_data(enc, &length);
+
+	for (cut = ends[90]; cut < length; cut++) {
+		n = decode(data, cut, decoded, 100);
+		g_assert_cmpuint(ends[n - 1], <=, cut);
+		g_assert_cmpuint(ends[n], >, cut);
+		for (i = 0; i < n; i++)
+			assert_fix(&decoded[i], &fixes[i], &default_precision);
+
+		/* only a cut between records leaves a whole track */
+		dec = location_track_decoder_new(data, cut, NULL);
+		g_assert_cmpint(location_track_decoder_seek(dec,
+					fixes[99].time + 1), ==,
+				ends[n - 1] == cut);
+		location_track_decoder_free(dec);
+	}
+
+	location_track_encoder_free(enc);
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/track-codec/round-trip", test_round_trip);
+	g_test_add_func("/track-codec/precision", test_precision);
+	g_test_add_func("/track-codec/clear", test_clear);
+	g_test_add_func("/track-codec/seek", test_seek);
+	g_test_add_func("/track-codec/invalid", test_invalid);
+
+	return g_test_run();
+}
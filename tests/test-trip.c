@@ -0,0 +1,207 @@
+/*
+ * Copyright (c) 2020 Ivan J. <parazyd@dyne.org>
+ *
+ * This file is part of liblocation
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "location-geodesy.h"
+#include "location-trip.h"
+
+/* ten minutes driving north at 36 km/h and climbing, a fix a second */
+#define FIXES 601
+#define SPEED 10.0
+#define CLIMB 0.1
+
+/* function declarations */
+static void drive(LocationGPSDeviceFix *, guint);
+static void feed(LocationTrip *, const LocationGPSDeviceFix *, guint, guint);
+static void test_drive(void);
+static void test_standing(void);
+static void test_snapshot(void);
+static void test_bad_snapshot(void);
+
+void drive(LocationGPSDeviceFix *fixes, guint n)
+{
+	double step = SPEED / (LOCATION_GEODESY_EARTH_RADIUS * G_PI / 180);
+	guint i;
+
+	for (i = 0; i < n; i++) {
+		memset(&fixes[i], 0, sizeof(LocationGPSDeviceFix));
+		fixes[i].fields = LOCATION_GPS_DEVICE_TIME_SET
+			| LOCATION_GPS_DEVICE_LATLONG_SET
+			| LOCATION_GPS_DEVICE_ALTITUDE_SET
+			| LOCATION_GPS_DEVICE_SPEED_SET;
+		fixes[i].time = 1600000000 + i;
+		fixes[i].latitude = 60 + i * step;
+		fixes[i].longitude = 25;
+		fixes[i].eph = 500;
+		fixes[i].altitude = 100 + i * CLIMB;
+		fixes[i].epv = 5;
+		fixes[i].speed = SPEED * 3.6;
+		fixes[i].eps = 1;
+	}
+}
+
+void feed(LocationTrip *trip, const LocationGPSDeviceFix *fixes,
+		guint from, guint to)
+{
+	guint i;
+
+	for (i = from; i < to; i++)
+		location_trip_add_fix(trip, &fixes[i]);
+}
+
+void test_drive(void)
+{
+	static LocationGPSDeviceFix fixes[FIXES];
+	LocationTrip *trip = location_trip_new(NULL);
+	LocationTripStats stats;
+
+	drive(fixes, FIXES);
+	feed(trip, fixes, 0, FIXES);
+	location_trip_get_stats(trip, &stats);
+
+	/* distance is counted in steps past the jitter gate */
+	g_assert_cmpfloat_with_epsilon(stats.distance, (FIXES - 1) * SPEED, 30);
+	g_assert_cmpfloat(stats.moving_time, ==, FIXES - 1);
+	g_assert_cmpfloat(stats.elapsed_time, ==, FIXES - 1);
+	g_assert_cmpfloat(stats.max_speed, ==, SPEED * 3.6);
+	g_assert_cmpfloat_with_epsilon(stats.avg_speed, SPEED * 3.6, 0.2);
+
+	/* and elevation in steps past epv, behind the altitude filter */
+	g_assert_cmpfloat(stats.elevation_gain, <=, (FIXES - 1) * CLIMB);
+	g_assert_cmpfloat(stats.elevation_gain, >=, (FIXES - 1) * CLIMB - 10);
+	g_assert_cmpfloat(stats.elevation_loss, ==, 0);
+
+	location_trip_reset(trip);
+	location_trip_get_stats(trip, &stats);
+	g_assert_cmpfloat(stats.distance, ==, 0);
+	g_assert_cmpfloat(stats.elapsed_time, ==, 0);
+
+	location_trip_free(trip);
+}
+
+/* position noise while standing still adds neither distance nor time */
+void test_standing(void)
+{
+	static LocationGPSDeviceFix fixes[FIXES];
+	GRand *rand = g_rand_new_with_seed(1);
+	LocationTrip *trip = location_trip_new(NULL);
+	LocationTripStats stats;
+	guint i;
+
+	drive(fixes, FIXES);
+	for (i = 0; i < FIXES; i++) {
+		fixes[i].latitude = 60 + g_rand_double_range(rand, -5, 5) / 111000;
+		fixes[i].altitude = 100 + g_rand_double_range(rand, -2, 2);
+		fixes[i].speed = g_rand_double_range(rand, 0, 1);
+	}
+
+	feed(trip, fixes, 0, FIXES);
+	location_trip_get_stats(trip, &stats);
+
+	g_assert_cmpfloat(stats.distance, ==, 0);
+	g_assert_cmpfloat(stats.moving_time, ==, 0);
+	g_assert_cmpfloat(stats.elapsed_time, ==, FIXES - 1);
+	g_assert_cmpfloat(stats.elevation_gain, ==, 0);
+
+	g_rand_free(rand);
+	location_trip_free(trip);
+}
+
+/* a trip restored halfway ends up exactly where the original does */
+void test_snapshot(void)
+{
+	static LocationGPSDeviceFix fixes[FIXES];
+	LocationTrip *trip = location_trip_new(NULL);
+	LocationTrip *restored = location_trip_new(NULL);
+	LocationTripStats a, b;
+	gpointer data;
+	gsize length;
+
+	drive(fixes, FIXES);
+	feed(trip, fixes, 0, FIXES / 2);
+
+	data = location_trip_snapshot(trip, &length);
+	g_assert_true(location_trip_restore(restored, data, length));
+	g_free(data);
+
+	location_trip_get_stats(trip, &a);
+	location_trip_get_stats(restored, &b);
+	g_assert_cmpmem(&a, sizeof(a), &b, sizeof(b));
+
+	feed(trip, fixes, FIXES / 2, FIXES);
+	feed(restored, fixes, FIXES / 2, FIXES);
+
+	location_trip_get_stats(trip, &a);
+	location_trip_get_stats(restored, &b);
+	g_assert_cmpmem(&a, sizeof(a), &b, sizeof(b));
+
+	location_trip_free(trip);
+	location_trip_free(restored);
+}
+
+/* snapshots that are cut short or not ours leave the trip as it was */
+void test_bad_snapshot(void)
+{
+	static LocationGPSDeviceFix fixes[FIXES];
+	LocationTrip *trip = location_trip_new(NULL);
+	LocationTripStats before, after;
+	guint32 *data;
+	gsize length;
+
+	drive(fixes, FIXES);
+	feed(trip, fixes, 0, FIXES);
+	data = location_trip_snapshot(trip, &length);
+
+	location_trip_reset(trip);
+	feed(trip, fixes, 0, 10);
+	location_trip_get_stats(trip, &before);
+
+	g_assert_false(location_trip_restore(trip, NULL, 0));
+	g_assert_false(location_trip_restore(trip, data, length - 1));
+	g_assert_false(location_trip_restore(trip, data, length + 1));
+
+	/* the magic, then the version */
+	data[0] ^= 1;
+	g_assert_false(location_trip_restore(trip, data, length));
+	data[0] ^= 1;
+	data[1]++;
+	g_assert_false(location_trip_restore(trip, data, length));
+
+	location_trip_get_stats(trip, &after);
+	g_assert_cmpmem(&before, sizeof(before), &after, sizeof(after));
+
+	g_free(data);
+	location_trip_free(trip);
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/trip/drive", test_drive);
+	g_test_add_func("/trip/standing", test_standing);
+	g_test_add_func("/trip/snapshot", test_snapshot);
+	g_test_add_func("/trip/bad-snapshot", test_bad_snapshot);
+
+	return g_test_run();
+}